@@ -0,0 +1,147 @@
+/**
+ * Ast implementation. While the parser builds the tree, every finished node sits on the pending stack until the rule
+ * above it claims it, so a rule never has to know how many nodes the rules below it made
+*/
+
+#include "ast.h"
+#include "intern.h"
+
+
+uint32_t Ast::Add(NodeKind kind, uint8_t op, int line, uint32_t a, uint32_t b){
+	uint32_t node = (uint32_t)kinds.size();
+	kinds.push_back(kind);
+	ops.push_back(op);
+	lines.push_back(line);
+	types.push_back(ERR);
+	as.push_back(a);
+	bs.push_back(b);
+	pending.push_back(node);
+	return node;
+}
+
+
+uint32_t Ast::AddReal(double value, int line){
+	reals.push_back(value);
+	return Add(N_RCONST, RCONST, line, (uint32_t)(reals.size() - 1), 0);
+}
+
+
+uint32_t Ast::Take(){
+	uint32_t node = pending.back();
+	pending.pop_back();
+	return node;
+}
+
+
+uint32_t Ast::TakeList(size_t mark, const uint32_t* extra, size_t extraCount){
+	uint32_t start = (uint32_t)lists.size();
+	lists.insert(lists.end(), extra, extra + extraCount);
+	lists.insert(lists.end(), pending.begin() + mark, pending.end());
+	pending.resize(mark);
+	return start;
+}
+
+
+void Ast::Clear(){
+	kinds.clear();
+	ops.clear();
+	lines.clear();
+	types.clear();
+	as.clear();
+	bs.clear();
+	lists.clear();
+	reals.clear();
+	pending.clear();
+	root = NONE;
+}
+
+
+size_t Ast::Bytes() const {
+	return kinds.size() * (sizeof(uint8_t) * 3 + sizeof(int) + sizeof(uint32_t) * 2)
+		+ lists.size() * sizeof(uint32_t) + reals.size() * sizeof(double);
+}
+
+
+/**
+ * Print the tree one node per line, children indented under their parent
+*/
+void Ast::Dump(ostream& out) const {
+	if (root != NONE){
+		DumpNode(out, root, 0);
+	}
+}
+
+
+void Ast::DumpNode(ostream& out, uint32_t n, int depth) const {
+	out << string(2 * depth, ' ');
+	uint32_t a = as[n];
+	uint32_t b = bs[n];
+
+	switch (kinds[n]){
+		case N_PROGRAM:
+			out << "PROGRAM" << endl;
+			for (uint32_t i = a; i <= a + b; i++){
+				DumpNode(out, lists[i], depth + 1);
+			}
+			break;
+		case N_DECL:
+		case N_DECL_INIT:
+			out << "DECL " << tokenNames[ops[n]];
+			for (uint32_t i = a; i < a + b; i++){
+				out << " " << identifiers.GetName(lists[i]);
+			}
+			out << endl;
+			if (kinds[n] == N_DECL_INIT){
+				DumpNode(out, lists[a + b], depth + 1);
+			}
+			break;
+		case N_BLOCK:
+		case N_WRITELN:
+		case N_WRITE:
+			out << (kinds[n] == N_BLOCK ? "BLOCK" : kinds[n] == N_WRITELN ? "WRITELN" : "WRITE") << endl;
+			for (uint32_t i = a; i < a + b; i++){
+				DumpNode(out, lists[i], depth + 1);
+			}
+			break;
+		case N_ASSIGN:
+			out << "ASSIGN" << endl;
+			DumpNode(out, a, depth + 1);
+			DumpNode(out, b, depth + 1);
+			break;
+		case N_IF:
+			out << "IF" << endl;
+			DumpNode(out, a, depth + 1);
+			DumpNode(out, b, depth + 1);
+			break;
+		case N_IF_ELSE:
+			out << "IF" << endl;
+			DumpNode(out, a, depth + 1);
+			DumpNode(out, lists[b], depth + 1);
+			DumpNode(out, lists[b + 1], depth + 1);
+			break;
+		case N_BINARY:
+			out << tokenNames[ops[n]] << " : " << tokenNames[types[n]] << endl;
+			DumpNode(out, a, depth + 1);
+			DumpNode(out, b, depth + 1);
+			break;
+		case N_UNARY:
+			out << (ops[n] == MINUS ? "NEG" : "NOT") << " : " << tokenNames[types[n]] << endl;
+			DumpNode(out, a, depth + 1);
+			break;
+		case N_VAR:
+			out << "VAR " << identifiers.GetName(a) << " : " << tokenNames[types[n]] << endl;
+			break;
+		case N_ICONST:
+			out << "ICONST " << (int)a << endl;
+			break;
+		case N_RCONST:
+			out << "RCONST " << reals[a] << endl;
+			break;
+		case N_SCONST:
+			out << "SCONST '" << lexemes.GetName(a) << "'" << endl;
+			break;
+		case N_BCONST:
+			out << "BCONST " << (a ? "true" : "false") << endl;
+			break;
+	}
+}
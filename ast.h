@@ -0,0 +1,105 @@
+/*
+ * ast.h
+ *
+ * The syntax tree the parser builds when it is given one. Nodes live in flat parallel arrays
+ * (structure of arrays) and refer to each other by 32-bit index, so a whole tree is a handful of
+ * allocations, is walked front to back in memory, and is freed all at once. Children that come in
+ * lists of any length(the statements of a block, the expressions of a writeln) are stored back to
+ * back in one more array, and the node only keeps where its list starts and how long it is.
+ *
+ * Every node has a kind, an 8-bit op, a line, a type, and two 32-bit fields a and b. The type is the
+ * one the parser gave an expression(INTEGER, REAL, STRING or BOOLEAN), so nothing after it has to work
+ * types out again, and ERR for every other node. The fields are:
+ *	N_PROGRAM	lists[a .. a+b) are the DECL nodes, lists[a+b] is the body BLOCK
+ *	N_DECL	op is the type, lists[a .. a+b) are the identifier ids being declared
+ *	N_DECL_INIT	the same, and lists[a+b] is the initializer expression
+ *	N_BLOCK	lists[a .. a+b) are the statements
+ *	N_WRITELN, N_WRITE	lists[a .. a+b) are the expressions
+ *	N_ASSIGN	a is the VAR node assigned to, b is the expression
+ *	N_IF	a is the condition, b is the then statement
+ *	N_IF_ELSE	a is the condition, lists[b] is the then statement and lists[b+1] the else statement
+ *	N_BINARY	op is the operator token, a and b are the operands
+ *	N_UNARY	op is MINUS or NOT, a is the operand
+ *	N_VAR	a is the identifier id
+ *	N_ICONST	a is the value
+ *	N_RCONST	a indexes the real values
+ *	N_SCONST	a is the lexeme id(in lexemes)
+ *	N_BCONST	a is 0 or 1
+*/
+
+#ifndef AST_H_
+#define AST_H_
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+
+enum NodeKind : uint8_t {
+	N_PROGRAM, N_DECL, N_DECL_INIT, N_BLOCK, N_WRITELN, N_WRITE, N_ASSIGN, N_IF, N_IF_ELSE,
+	N_BINARY, N_UNARY, N_VAR, N_ICONST, N_RCONST, N_SCONST, N_BCONST,
+};
+
+
+//Class definition of Ast
+class Ast {
+	vector<uint8_t>	kinds;
+	vector<uint8_t>	ops;
+	vector<int>	lines;
+	vector<uint8_t>	types;
+	vector<uint32_t>	as;
+	vector<uint32_t>	bs;
+
+	//Child lists, back to back
+	vector<uint32_t>	lists;
+	vector<double>	reals;
+
+	//Nodes finished but not yet claimed by a parent, while the parser is building the tree
+	vector<uint32_t>	pending;
+	uint32_t	root;
+
+	void	DumpNode(ostream& out, uint32_t node, int depth) const;
+
+public:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	Ast() { root = NONE; }
+
+	//Building. Add makes a node and leaves it pending, Take claims the newest pending node, and TakeList claims
+	//every node pending since mark(in order) into the child lists. extra ids or nodes can go in front of them
+	uint32_t	Add(NodeKind kind, uint8_t op, int line, uint32_t a, uint32_t b);
+	uint32_t	AddReal(double value, int line);
+	//Give the node added last its type
+	void	SetType(Token type) { types.back() = type; }
+	uint32_t	Take();
+	uint32_t	TakeList(size_t mark, const uint32_t* extra = nullptr, size_t extraCount = 0);
+	size_t	Mark() const { return pending.size(); }
+	//Forget the pending nodes a failed rule left behind
+	void	Reset(size_t mark) { pending.resize(mark); }
+	void	SetRoot(uint32_t node) { root = node; }
+	void	Clear();
+
+	//Reading
+	uint32_t	Root() const { return root; }
+	size_t	Size() const { return kinds.size(); }
+	NodeKind	GetKind(uint32_t n) const { return (NodeKind)kinds[n]; }
+	Token	GetOp(uint32_t n) const { return (Token)ops[n]; }
+	int	GetLine(uint32_t n) const { return lines[n]; }
+	Token	GetType(uint32_t n) const { return (Token)types[n]; }
+	uint32_t	GetA(uint32_t n) const { return as[n]; }
+	uint32_t	GetB(uint32_t n) const { return bs[n]; }
+	uint32_t	GetListItem(uint32_t i) const { return lists[i]; }
+	double	GetReal(uint32_t n) const { return reals[as[n]]; }
+	int	GetInt(uint32_t n) const { return (int)as[n]; }
+
+	//Bytes the tree itself takes up(not counting spare capacity)
+	size_t	Bytes() const;
+	void	Dump(ostream& out) const;
+};
+
+
+#endif /* AST_H_ */
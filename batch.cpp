@@ -0,0 +1,205 @@
+/**
+ * Batch parsing on a work-stealing pool. Files are sorted biggest first and dealt out to the workers' queues in turn,
+ * so every worker starts with about the same amount of work. A worker takes from the front of its own queue, the
+ * biggest file it has left; one with nothing left takes from the back of the next queue that has anything, where the
+ * small files are. No work is ever added once the workers start, so a worker that finds every queue empty is done
+*/
+
+#include "batch.h"
+#include "parser.h"
+#include "source.h"
+#include "stream.h"
+#include "cache.h"
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+namespace {
+	//One worker's files, as indexes into the batch
+	struct Queue {
+		mutex	lock;
+		deque<uint32_t>	items;
+	};
+
+	//What parsing one file came to. text is everything it prints
+	struct Outcome {
+		string	text;
+		bool	opened;
+		bool	ok;
+		int	errors;
+		uint64_t	bytes;
+	};
+
+	//Parse one file on a context of its own, the way prog2 would: mapped if it can be, streamed if not
+	void parseFile(const string& filename, const BatchOptions& options, Outcome& result){
+		ostringstream text;
+		ParserContext parser(text);
+		parser.SetErrorLimit(options.errorLimit);
+		parser.SetStackBudget(options.stackBudget);
+		int line = 1;
+
+		text << "== " << filename << " ==" << endl;
+		result.opened = true;
+		result.bytes = 0;
+		SourceBuffer source;
+		int errors = 0;
+		if (IsRegularFile(filename) && source.Map(filename)){
+			result.bytes = source.GetSize();
+			LexCursor cursor = source.Cursor();
+			if (options.cache){
+				result.ok = CachedProg(*options.cache, parser, text, source.GetData(), source.GetSize(), false, errors);
+			} else {
+				result.ok = parser.Prog(cursor, line);
+				errors = parser.ErrCount();
+			}
+		} else {
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0){
+				result.opened = false;
+			} else {
+				{
+					StreamLexer stream(fd);
+					result.ok = parser.Prog(stream, line);
+					errors = parser.ErrCount();
+				}
+				close(fd);
+			}
+		}
+
+		if (!result.opened){
+			result.ok = false;
+			text << "CANNOT OPEN " << filename << endl;
+		} else if (result.ok){
+			text << "DONE" << endl << "Successful Parsing" << endl;
+		} else {
+			text << "Unsuccessful Parsing" << endl << "Number of Syntax Errors " << errors << endl;
+		}
+		result.errors = errors;
+		result.text = text.str();
+	}
+}
+
+
+BatchSummary ParseBatch(const vector<string>& files, const BatchOptions& options, ostream& out){
+	auto t0 = chrono::steady_clock::now();
+	BatchSummary summary = {};
+	summary.files = files.size();
+	summary.threads = max(1u, min(options.threads, (unsigned)max<size_t>(files.size(), 1)));
+
+	//Biggest first, dealt out in turn. Anything stat can't size goes last
+	vector<uint64_t> sizes(files.size(), 0);
+	vector<uint32_t> order(files.size());
+	for (uint32_t i = 0; i < files.size(); i++){
+		struct stat st;
+		sizes[i] = stat(files[i].c_str(), &st) == 0 ? st.st_size : 0;
+		order[i] = i;
+	}
+	stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){ return sizes[a] > sizes[b]; });
+	vector<Queue> queues(summary.threads);
+	for (size_t k = 0; k < order.size(); k++){
+		queues[k % summary.threads].items.push_back(order[k]);
+	}
+
+	vector<Outcome> results(files.size());
+	vector<uint8_t> finished(files.size(), 0);
+	mutex lock;
+	condition_variable ready;
+	uint64_t steals = 0;
+
+	//The next file for worker w: its own biggest, or else another's smallest
+	auto take = [&](unsigned w, uint32_t& file){
+		for (unsigned k = 0; k < summary.threads; k++){
+			Queue& q = queues[(w + k) % summary.threads];
+			lock_guard<mutex> guard(q.lock);
+			if (q.items.empty()){
+				continue;
+			}
+			if (k == 0){
+				file = q.items.front();
+				q.items.pop_front();
+			} else {
+				file = q.items.back();
+				q.items.pop_back();
+				lock_guard<mutex> count(lock);
+				steals++;
+			}
+			return true;
+		}
+		return false;
+	};
+
+	vector<thread> workers;
+	for (unsigned w = 0; w < summary.threads; w++){
+		workers.emplace_back([&, w](){
+			uint32_t file;
+			while (take(w, file)){
+				parseFile(files[file], options, results[file]);
+				//Nothing refers to the file's names any more, so the next file starts with empty interners
+				ClearInterned();
+				{
+					lock_guard<mutex> guard(lock);
+					finished[file] = 1;
+				}
+				ready.notify_one();
+			}
+		});
+	}
+
+	//Write each file out as soon as it and everything before it are done
+	for (size_t i = 0; i < files.size(); i++){
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [&](){ return finished[i] != 0; });
+		}
+		Outcome& r = results[i];
+		out << r.text;
+		string().swap(r.text);
+		summary.passed += r.ok;
+		summary.failed += r.opened && !r.ok;
+		summary.unreadable += !r.opened;
+		summary.errors += r.errors;
+		summary.bytes += r.bytes;
+	}
+	for (thread& t : workers){
+		t.join();
+	}
+
+	summary.steals = steals;
+	summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	double mb = summary.bytes / 1e6;
+	double sec = max(summary.seconds, 1e-9);
+	out << endl << "Batch Summary" << endl;
+	out << "Files " << summary.files << ", Passed " << summary.passed << ", Failed " << summary.failed
+		<< ", Cannot Open " << summary.unreadable << endl;
+	out << "Total Syntax Errors " << summary.errors << endl;
+	out << mb << " MB in " << summary.seconds << " s on " << summary.threads << " threads (" << summary.steals
+		<< " steals): " << mb / sec << " MB/s, " << summary.files / sec << " files/s" << endl;
+	return summary;
+}
+
+
+bool ReadManifest(const string& filename, vector<string>& files){
+	ifstream in(filename);
+	if (!in){
+		return false;
+	}
+	string name;
+	while (getline(in, name)){
+		while (!name.empty() && isspace((unsigned char)name.back())){
+			name.pop_back();
+		}
+		if (!name.empty()){
+			files.push_back(name);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+/*
+ * batch.h
+ *
+ * Batch parsing: many files checked in one run instead of one process per file. Every file is
+ * parsed with its own ParserContext(parser.h) on a pool of worker threads. Each worker has its own
+ * queue of files, biggest first, and a worker whose queue runs dry steals from the back of another's,
+ * so a few big files and a lot of small ones still keep every core busy to the end. What each file
+ * prints is held until every file before it has been written, so the output is the same, in input
+ * order, however the work was split up.
+*/
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+using namespace std;
+
+class ParseCache;
+
+
+//How a batch is parsed. errorLimit and stackBudget are the same as for a single file(SetErrorLimit, SetStackBudget).
+//With a cache(cache.h), files that are in it aren't parsed again
+struct BatchOptions {
+	unsigned	threads;
+	int	errorLimit;
+	size_t	stackBudget;
+	ParseCache*	cache;
+};
+
+//What a batch came to
+struct BatchSummary {
+	size_t	files;
+	size_t	passed;
+	size_t	failed;
+	//Files that couldn't be opened, counted apart from the ones that failed to parse
+	size_t	unreadable;
+	uint64_t	errors;
+	uint64_t	bytes;
+	double	seconds;
+	unsigned	threads;
+	//How many files were taken from another worker's queue
+	uint64_t	steals;
+};
+
+
+/**
+ * Parse every file, writing what each one prints(a "== name ==" line, then its messages and result, worded the same
+ * as prog2 on one file) to out in the order given, then the summary
+*/
+extern BatchSummary ParseBatch(const vector<string>& files, const BatchOptions& options, ostream& out);
+
+//Add the files named in a manifest, one per line(blank lines are skipped). Returns false if it can't be read
+extern bool ReadManifest(const string& filename, vector<string>& files);
+
+
+#endif /* BATCH_H_ */
@@ -0,0 +1,1262 @@
+/*
+ * bench.cpp
+ *
+ * Microbenchmarks for the lexer and parser. Build it with the rest of the sources, minus prog2.cpp:
+ *	g++ -std=c++17 -O2 -pthread -o bench bench.cpp lex.cpp parser.cpp source.cpp scan.cpp tokens.cpp intern.cpp \
+ *		incremental.cpp stream.cpp tokdump.cpp ast.cpp bytecode.cpp vm.cpp ssa.cpp optimize.cpp symtab.cpp
+ * and run "bench <name>" for one benchmark, or "bench" with no arguments for all of them.
+*/
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <atomic>
+
+#include "lex.h"
+#include "parser.h"
+#include "scan.h"
+#include "keywords.h"
+#include "tokens.h"
+#include "incremental.h"
+#include "stream.h"
+#include "tokdump.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "ssa.h"
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+
+//Cycle counter, where the CPU has one we can read. Elsewhere we fall back to nanoseconds
+static inline uint64_t cycles(){
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+//Keeps the compiler from throwing away a result we never use
+static volatile uint64_t sink;
+
+
+//Every heap allocation in the program goes through here, so benchmarks can count them. Some benchmarks allocate on
+//several threads at once
+static atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size){
+	allocations++;
+	void* p = malloc(size > 0 ? size : 1);
+	if (p == nullptr){
+		throw bad_alloc();
+	}
+	return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+/**
+ * Build a valid program of about the given size: a declaration block, then a long body of assignments, ifs and
+ * writelns with comments and indentation sprinkled in, the way our generated programs look. Even numbered variables
+ * are integers and odd ones reals, and each statement picks the ones it needs to type check. The parser remembers
+ * every variable it has ever seen, so programs parsed in the same run need different variable name prefixes
+*/
+static string syntheticProgram(uint64_t bytes, const string& prefix = "v"){
+	const int vars = 100;
+	string prog = "program bench;\nvar\n";
+	for (int i = 0; i < vars; i++){
+		prog += "\t" + prefix + to_string(i) + (i % 2 ? " : real := 1.5;\n" : " : integer := 0;\n");
+	}
+	string flag = prefix + "flag";
+	prog += "\t" + flag + " : boolean := true;\n\t" + prefix + "str : string := 'done';\nbegin\n";
+
+	for (int n = 0; prog.size() < bytes; n++){
+		string a = prefix + to_string(n % vars);
+		string b = prefix + to_string((n * 7 + 3) % vars);
+		string r = prefix + to_string(n % vars | 1);
+		string i = prefix + to_string(n % vars & ~1);
+		string j = prefix + to_string((n * 7 + 3) % vars & ~1);
+		switch (n % 4){
+			case 0:
+				prog += "\t" + r + " := (" + b + " + 3) * 2 - " + r + " / 4.25;\n";
+				break;
+			case 1:
+				prog += "\t{update the running value of " + a + "}\n\tif " + a + " > 10 and " + flag + " then\n\t\t"
+					+ b + " := " + b + " - 1\n\telse\n\t\t" + b + " := " + b + " + 1;\n";
+				break;
+			case 2:
+				prog += "\twriteln('value of " + a + " is ', " + a + ", ' and ', " + b + ");\n";
+				break;
+			case 3:
+				prog += "\tbegin\n\t\t" + i + " := 0 - " + j + " mod 7;\n\t\t" + flag + " := not (" + i + " = " + j + ")\n\tend;\n";
+				break;
+		}
+	}
+	prog += "\twriteln(" + prefix + "str)\nend.\n";
+	return prog;
+}
+
+
+/**
+ * Whole lexer throughput on a synthetic program, the original istream lexer against the buffer lexer
+*/
+static void benchLexer(){
+	string prog = syntheticProgram(32 << 20);
+	double mb = prog.size() / 1e6;
+
+	istringstream in(prog);
+	int line = 1;
+	uint64_t tokens = 0;
+	auto t0 = chrono::steady_clock::now();
+	while (getNextToken(in, line) != DONE){
+		tokens++;
+	}
+	auto t1 = chrono::steady_clock::now();
+
+	LexCursor cursor(prog.data(), prog.size());
+	line = 1;
+	uint64_t viewTokens = 0;
+	uint64_t c0 = cycles();
+	auto t2 = chrono::steady_clock::now();
+	while (getNextToken(cursor, line) != DONE){
+		viewTokens++;
+	}
+	auto t3 = chrono::steady_clock::now();
+	uint64_t c1 = cycles();
+
+	double istreamSec = chrono::duration<double>(t1 - t0).count();
+	double bufferSec = chrono::duration<double>(t3 - t2).count();
+	cout << "lexer: " << mb << " MB, " << viewTokens << " tokens" << (tokens != viewTokens ? " (COUNT MISMATCH)" : "") << endl;
+	cout << "  istream " << mb / istreamSec << " MB/s" << endl;
+	cout << "  buffer  " << mb / bufferSec << " MB/s, " << (double)(c1 - c0) / prog.size() << " cycles/byte" << endl;
+}
+
+
+/**
+ * Parsing straight off the lexer against lexing everything into a TokenBuffer first and parsing from that, with
+ * the lexing and the parsing timed separately
+*/
+static void benchParse(){
+	string streamed = syntheticProgram(16 << 20, "s");
+	string buffered = syntheticProgram(16 << 20, "b");
+	double mb = buffered.size() / 1e6;
+
+	LexCursor cursor(streamed.data(), streamed.size());
+	int line = 1;
+	auto t0 = chrono::steady_clock::now();
+	bool ok = Prog(cursor, line);
+	auto t1 = chrono::steady_clock::now();
+
+	TokenBuffer tokens;
+	auto t2 = chrono::steady_clock::now();
+	tokens.Tokenize(buffered.data(), buffered.size());
+	auto t3 = chrono::steady_clock::now();
+	line = 1;
+	ok = Prog(tokens, line) && ok;
+	auto t4 = chrono::steady_clock::now();
+
+	auto ms = [](chrono::steady_clock::duration d){ return chrono::duration<double, milli>(d).count(); };
+	cout << "parse: " << mb << " MB, " << tokens.Size() << " tokens" << (ok ? "" : " (PARSE FAILED)") << endl;
+	cout << "  lex+parse together  " << ms(t1 - t0) << " ms" << endl;
+	cout << "  pretokenize         " << ms(t3 - t2) << " ms" << endl;
+	cout << "  parse token buffer  " << ms(t4 - t3) << " ms" << endl;
+}
+
+
+/**
+ * Expression parsing on its own: one program of long flat expressions that use every precedence level, and one of
+ * expressions nested deep in parentheses. Both are pretokenized, so only the parser is timed
+*/
+static void benchExpr(){
+	auto ns = [](chrono::steady_clock::duration d, size_t n){ return chrono::duration<double, nano>(d).count() / n; };
+	const char* ops[] = {" + ", " * ", " - ", " div ", " mod ", " / "};
+
+	string flat = "program flat;\nvar\n\tfx : integer := 1;\n\tfr : real;\n\tfb : boolean;\nbegin\n";
+	for (int n = 0; flat.size() < (16 << 20); n++){
+		flat += "\tfr := fx";
+		for (int i = 1; i < 1000; i++){
+			flat += ops[(n + i) % 6] + to_string(i);
+		}
+		flat += ";\n\tfb := fx > 1 and fx < 10 or fx = 3;\n";
+	}
+	flat += "\tfx := 0\nend.\n";
+
+	const int depth = 1000;
+	string nested = "program nested;\nvar\n\tnx : integer := 1;\nbegin\n";
+	for (int n = 0; nested.size() < (16 << 20); n++){
+		nested += "\tnx := ";
+		for (int i = 0; i < depth; i++){
+			nested += i % 2 ? "-(" : "(nx + ";
+		}
+		nested += "1";
+		for (int i = 0; i < depth; i++){
+			nested += ")";
+		}
+		nested += ";\n";
+	}
+	nested += "\tnx := 0\nend.\n";
+
+	cout << "expr:" << endl;
+	for (int k = 0; k < 2; k++){
+		TokenBuffer tokens;
+		tokens.Tokenize(k == 0 ? flat.data() : nested.data(), k == 0 ? flat.size() : nested.size());
+		int line = 1;
+		streambuf* console = cout.rdbuf(nullptr);
+		auto t0 = chrono::steady_clock::now();
+		bool ok = Prog(tokens, line);
+		auto t1 = chrono::steady_clock::now();
+		cout.rdbuf(console);
+		cout << (k == 0 ? "  flat    " : "  nested  ") << tokens.Size() << " tokens, " << ns(t1 - t0, tokens.Size())
+			<< " ns per token" << (ok ? "" : " (PARSE FAILED)") << endl;
+	}
+}
+
+
+/**
+ * Nesting stress for the explicit stack parser: parentheses, BEGIN blocks and IF statements nested from a thousand to a
+ * million deep, and a writeln with that many arguments. The time per level should stay flat as depth grows. The
+ * recursive parser is timed next to it as far as the C stack lets it go
+*/
+static void benchDeep(){
+	auto ns = [](chrono::steady_clock::duration d, size_t n){ return chrono::duration<double, nano>(d).count() / n; };
+	const char* kinds[] = {"parens", "begin", "if", "args"};
+
+	cout << "deep:" << endl;
+	for (int kind = 0; kind < 4; kind++){
+		for (size_t depth = 1000; depth <= 1000000; depth *= 10){
+			string prog = "program deep;\nvar\n\tdx : integer;\n\tdb : boolean := true;\nbegin\n\t";
+			string open = kind == 0 ? "(" : kind == 1 ? "begin " : kind == 2 ? "if db then " : "";
+			string close = kind == 0 ? ")" : kind == 1 ? " end" : "";
+			if (kind == 0){
+				prog += "dx := ";
+			} else if (kind == 3){
+				prog += "writeln(1";
+				open = ", 1";
+				close = ")";
+			}
+			prog.reserve(prog.size() + depth * (open.size() + close.size()) + 64);
+			for (size_t i = 0; i < depth; i++){
+				prog += open;
+			}
+			prog += kind == 0 ? "1" : kind == 3 ? "" : "dx := 1";
+			for (size_t i = 0; i < (kind == 3 ? 1 : depth); i++){
+				prog += close;
+			}
+			prog += "\nend.\n";
+
+			TokenBuffer tokens;
+			tokens.Tokenize(prog.data(), prog.size());
+			cout << "  " << kinds[kind] << " " << depth << "  ";
+			for (int explicitStack = 1; explicitStack >= 0; explicitStack--){
+				if (!explicitStack && depth > 10000 && kind != 3){
+					continue;
+				}
+				ResetParser();
+				SetStackBudget(explicitStack ? 1 << 30 : 0);
+				int line = 1;
+				streambuf* console = cout.rdbuf(nullptr);
+				auto t0 = chrono::steady_clock::now();
+				bool ok = Prog(tokens, line);
+				auto t1 = chrono::steady_clock::now();
+				cout.rdbuf(console);
+				cout << (explicitStack ? "explicit " : "  recursive ") << ns(t1 - t0, depth) << " ns per level"
+					<< (ok ? "" : " (PARSE FAILED)");
+			}
+			cout << endl;
+		}
+	}
+	SetStackBudget(0);
+}
+
+
+/**
+ * Error recovery. A valid program parsed with recovery off and on, which should cost the same, and the same program
+ * with an error put in every thousandth assignment, which one pass with recovery on reports every one of. All three
+ * are pretokenized, under different names
+*/
+static void benchRecover(){
+	auto ms = [](chrono::steady_clock::duration d){ return chrono::duration<double, milli>(d).count(); };
+	string programs[3] = {syntheticProgram(16 << 20, "ro"), syntheticProgram(16 << 20, "rn"), syntheticProgram(16 << 20, "rb")};
+	string& broken = programs[2];
+	int planted = 0;
+	size_t n = 0;
+	for (size_t at = broken.find(":= ("); at != string::npos; at = broken.find(":= (", at + 1)){
+		if (++n % 1000 == 0){
+			broken.insert(at + 4, "* ");
+			planted++;
+		}
+	}
+
+	cout << "recover:" << endl;
+	const char* names[3] = {"valid, recovery off", "valid, recovery on ", "with errors        "};
+	for (int i = 0; i < 3; i++){
+		TokenBuffer tokens;
+		tokens.Tokenize(programs[i].data(), programs[i].size());
+		SetErrorLimit(i == 0 ? 0 : 1 << 30);
+		int errors = ErrCount();
+		int line = 1;
+		streambuf* console = cout.rdbuf(nullptr);
+		auto t0 = chrono::steady_clock::now();
+		bool ok = Prog(tokens, line);
+		auto t1 = chrono::steady_clock::now();
+		cout.rdbuf(console);
+		cout << "  " << names[i] << "  " << ms(t1 - t0) << " ms";
+		if (i == 2){
+			cout << ", " << planted << " errors planted, " << ErrCount() - errors << " messages";
+		}
+		cout << ((i == 2) == ok ? " (WRONG RESULT)" : "") << endl;
+	}
+	SetErrorLimit(0);
+}
+
+
+/**
+ * What building the syntax tree costs on top of validating only, and how big the tree is next to the tokens. Both parses
+ * read the same pretokenized program(under different names, the symbol table outlives a parse)
+*/
+static void benchAst(){
+	string plain = syntheticProgram(16 << 20, "p");
+	string built = syntheticProgram(16 << 20, "t");
+	auto ms = [](chrono::steady_clock::duration d){ return chrono::duration<double, milli>(d).count(); };
+
+	TokenBuffer tokens;
+	tokens.Tokenize(plain.data(), plain.size());
+	int line = 1;
+	auto t0 = chrono::steady_clock::now();
+	bool ok = Prog(tokens, line);
+	auto t1 = chrono::steady_clock::now();
+
+	tokens.Tokenize(built.data(), built.size());
+	Ast ast;
+	SetAst(&ast);
+	line = 1;
+	auto t2 = chrono::steady_clock::now();
+	ok = Prog(tokens, line) && ok;
+	auto t3 = chrono::steady_clock::now();
+	SetAst(nullptr);
+
+	cout << "ast: " << tokens.Size() << " tokens" << (ok ? "" : " (PARSE FAILED)") << endl;
+	cout << "  validate only       " << ms(t1 - t0) << " ms" << endl;
+	cout << "  build ast           " << ms(t3 - t2) << " ms" << endl;
+	cout << "  " << ast.Size() << " nodes, " << ast.Bytes() / 1e6 << " MB, "
+		<< (double)ast.Bytes() / tokens.Size() << " bytes per token" << endl;
+
+	auto f0 = chrono::steady_clock::now();
+	//Freeing the whole tree is one free per array
+	ast = Ast();
+	auto f1 = chrono::steady_clock::now();
+	cout << "  free                " << ms(f1 - f0) << " ms" << endl;
+}
+
+
+/**
+ * A program the VM can run: like syntheticProgram, but every statement type checks, nothing divides by zero and no
+ * variable is read before it has a value. One statement in eight writes a line
+*/
+static string runnableProgram(uint64_t bytes, const string& prefix){
+	const int vars = 50;
+	string prog = "program run;\nvar\n";
+	for (int i = 0; i < vars; i++){
+		prog += "\t" + prefix + "i" + to_string(i) + " : integer := " + to_string(i) + ";\n";
+		prog += "\t" + prefix + "r" + to_string(i) + " : real := 1.5;\n";
+	}
+	string flag = prefix + "flag";
+	prog += "\t" + flag + " : boolean := true;\nbegin\n";
+
+	for (int n = 0; prog.size() < bytes; n++){
+		string i = prefix + "i" + to_string(n % vars);
+		string j = prefix + "i" + to_string((n * 7 + 3) % vars);
+		string r = prefix + "r" + to_string(n % vars);
+		string q = prefix + "r" + to_string((n * 3 + 1) % vars);
+		switch (n % 8){
+			case 0:
+			case 4:
+				prog += "\t" + i + " := (" + j + " + 3) * 2 - " + i + " div 4;\n";
+				break;
+			case 1:
+			case 5:
+				prog += "\t" + r + " := " + q + " * 0.5 + " + i + " / 4.0;\n";
+				break;
+			case 2:
+			case 6:
+				prog += "\tif " + i + " > 10 and " + flag + " then\n\t\t" + j + " := " + j + " - 1\n\telse\n\t\t"
+					+ j + " := " + j + " + 1;\n";
+				break;
+			case 3:
+				prog += "\tbegin\n\t\t" + i + " := 0 - " + j + " mod 7;\n\t\t" + flag + " := not (" + i + " = " + j + ")\n\tend;\n";
+				break;
+			case 7:
+				prog += "\twriteln('value of " + i + " is ', " + i + ", ' and ', " + r + ");\n";
+				break;
+		}
+	}
+	prog += "\twriteln(" + flag + ")\nend.\n";
+	return prog;
+}
+
+
+//Parse and compile a program, without letting parse errors through to the console. The tree is kept in tree if given
+static bool compileProgram(const string& text, Bytecode& program, Ast* tree = nullptr){
+	Ast local;
+	Ast& ast = tree != nullptr ? *tree : local;
+	SetAst(&ast);
+	LexCursor cursor(text.data(), text.size());
+	int line = 1;
+	streambuf* console = cout.rdbuf(nullptr);
+	bool ok = Prog(cursor, line) && Compile(ast, program);
+	cout.rdbuf(console);
+	SetAst(nullptr);
+	return ok;
+}
+
+
+/**
+ * Running compiled programs: every sample program that compiles, many times over, then one large generated program.
+ * Program output goes to a stream with no buffer, so only the VM is timed
+*/
+static void benchVm(){
+	auto ms = [](chrono::steady_clock::duration d){ return chrono::duration<double, milli>(d).count(); };
+	ostream discard(nullptr);
+	VM vm;
+
+	cout << "vm:" << endl;
+	for (int i = 1; i <= 19; i++){
+		ifstream file("PA_2_Test_Cases/testprog" + to_string(i));
+		stringstream text;
+		text << file.rdbuf();
+		Bytecode program;
+		ResetParser();
+		if (!file || !compileProgram(text.str(), program)){
+			continue;
+		}
+		const int runs = 100000;
+		auto t0 = chrono::steady_clock::now();
+		for (int n = 0; n < runs; n++){
+			vm.Run(program, discard);
+		}
+		auto t1 = chrono::steady_clock::now();
+		cout << "  testprog" << i << "  " << program.Size() << " instructions, " << ms(t1 - t0) * 1e3 / runs
+			<< " us per run" << endl;
+	}
+
+	string text = runnableProgram(16 << 20, "g");
+	Bytecode program;
+	ResetParser();
+	auto t0 = chrono::steady_clock::now();
+	bool ok = compileProgram(text, program);
+	auto t1 = chrono::steady_clock::now();
+	ok = ok && vm.Run(program, discard);
+	auto t2 = chrono::steady_clock::now();
+	cout << "  generated  " << text.size() / 1e6 << " MB, " << program.Size() << " instructions, "
+		<< program.Registers() << " registers" << (ok ? "" : " (FAILED)") << endl;
+	cout << "    parse+compile     " << ms(t1 - t0) << " ms" << endl;
+	cout << "    run               " << ms(t2 - t1) << " ms, " << ms(t2 - t1) * 1e6 / program.Size()
+		<< " ns per instruction" << endl;
+}
+
+
+/**
+ * A program with plenty for the optimizer to do, the way hand written ones have: settings fixed in the declarations,
+ * debugging output behind a flag that is off, values worked out from constants, and variables assigned and then
+ * assigned again before anything reads them. Every block also does some work on the variables that does have to run
+*/
+static string foldableProgram(uint64_t bytes, const string& prefix){
+	const int vars = 20;
+	string debug = prefix + "debug";
+	string scale = prefix + "scale";
+	string prog = "program fold;\nvar\n\t" + debug + " : boolean := false;\n\t" + scale + " : integer := 4;\n";
+	for (int i = 0; i < vars; i++){
+		prog += "\t" + prefix + "i" + to_string(i) + " : integer := " + to_string(i + 1) + ";\n";
+		prog += "\t" + prefix + "r" + to_string(i) + " : real := 2.5;\n";
+	}
+	prog += "begin\n";
+
+	for (int n = 0; prog.size() < bytes; n++){
+		string i = prefix + "i" + to_string(n % vars);
+		string j = prefix + "i" + to_string((n * 7 + 3) % vars);
+		string r = prefix + "r" + to_string(n % vars);
+		switch (n % 6){
+			case 0:
+				prog += "\t" + i + " := " + scale + " * 8 + 2;\n\t" + i + " := " + i + " * " + scale + " - " + j + " mod 5;\n";
+				break;
+			case 1:
+				prog += "\tif " + debug + " then\n\t\twriteln('debug ', " + i + ", ' ', " + r + ")\n\telse\n\t\t" + r + " := "
+					+ r + " * 0.5 + " + scale + ";\n";
+				break;
+			case 2:
+				prog += "\t" + r + " := " + to_string(n % 9) + ".25 * " + scale + " / 2.0 + 1.0;\n";
+				break;
+			case 3:
+				prog += "\tif " + scale + " > 2 and " + debug + " = false then\n\t\t" + j + " := " + j + " + " + scale + " div 2;\n";
+				break;
+			case 4:
+				prog += "\t" + j + " := (" + i + " + 1) * 3;\n\t" + j + " := " + i + " - " + scale + ";\n";
+				break;
+			case 5:
+				prog += "\twriteln('value of " + i + " is ', " + i + ", ' and ', " + r + ");\n";
+				break;
+		}
+	}
+	prog += "\twriteln(" + scale + ")\nend.\n";
+	return prog;
+}
+
+
+/**
+ * The optimizer on a corpus of every sample program that compiles, a generated program like the one benchVm runs, and
+ * one written to have a lot to fold. Each is compiled as is and optimized, both are run, and the output has to match
+ */
+static void benchOptimize(){
+	auto ms = [](chrono::steady_clock::duration d){ return chrono::duration<double, milli>(d).count(); };
+	VM vm;
+	vector<pair<string, string>> corpus;
+	for (int i = 1; i <= 19; i++){
+		ifstream file("PA_2_Test_Cases/testprog" + to_string(i));
+		stringstream text;
+		text << file.rdbuf();
+		if (file){
+			corpus.emplace_back("testprog" + to_string(i), text.str());
+		}
+	}
+	corpus.emplace_back("runnable", runnableProgram(4 << 20, "g"));
+	corpus.emplace_back("foldable", foldableProgram(4 << 20, "f"));
+
+	cout << "optimize:" << endl;
+	size_t before = 0, after = 0;
+	for (auto& sample : corpus){
+		Ast ast;
+		Bytecode program, optimized;
+		ResetParser();
+		if (!compileProgram(sample.second, program, &ast)){
+			continue;
+		}
+		auto t0 = chrono::steady_clock::now();
+		Optimize(ast, optimized);
+		auto t1 = chrono::steady_clock::now();
+
+		//Small programs run many times over so there is something to time
+		const int runs = max<int>(1, (int)(2000000 / program.Size()));
+		string plain, fast;
+		chrono::steady_clock::duration times[2];
+		for (int k = 0; k < 2; k++){
+			const Bytecode& code = k == 0 ? program : optimized;
+			ostringstream out;
+			bool ok = vm.Run(code, out);
+			(k == 0 ? plain : fast) = out.str() + (ok ? "" : vm.GetError());
+			ostream discard(nullptr);
+			auto start = chrono::steady_clock::now();
+			for (int n = 0; n < runs; n++){
+				vm.Run(code, discard);
+			}
+			times[k] = (chrono::steady_clock::now() - start) / runs;
+		}
+		before += program.Size();
+		after += optimized.Size();
+		cout << "  " << sample.first << "  " << program.Size() << " -> " << optimized.Size() << " instructions, "
+			<< program.Registers() << " -> " << optimized.Registers() << " registers, run " << ms(times[0]) * 1e3
+			<< " -> " << ms(times[1]) * 1e3 << " us, optimize " << ms(t1 - t0) * 1e3 << " us"
+			<< (plain == fast ? "" : " (OUTPUT DIFFERS)") << endl;
+	}
+	cout << "  total  " << before << " -> " << after << " instructions" << endl;
+}
+
+
+/**
+ * Scaling of the parallel tokenizer from one thread up to one per core, checked against the sequential tokenizer
+*/
+static void benchParallelLex(){
+	string prog = syntheticProgram(128 << 20);
+	double mb = prog.size() / 1e6;
+	unsigned cores = max(1u, thread::hardware_concurrency());
+
+	TokenBuffer expected;
+	auto t0 = chrono::steady_clock::now();
+	expected.Tokenize(prog.data(), prog.size());
+	auto t1 = chrono::steady_clock::now();
+	double base = chrono::duration<double>(t1 - t0).count();
+
+	cout << "parlex: " << mb << " MB, " << cores << " cores" << endl;
+	cout << "  sequential  " << mb / base << " MB/s" << endl;
+	for (unsigned threads = 1; threads <= cores; threads = threads < cores && threads * 2 > cores ? cores : threads * 2){
+		TokenBuffer tokens;
+		auto t2 = chrono::steady_clock::now();
+		tokens.TokenizeParallel(prog.data(), prog.size(), threads);
+		auto t3 = chrono::steady_clock::now();
+
+		bool same = tokens.Size() == expected.Size();
+		for (size_t i = 0; same && i < tokens.Size(); i++){
+			same = tokens.GetToken(i) == expected.GetToken(i) && tokens.GetOffset(i) == expected.GetOffset(i)
+				&& tokens.GetLinenum(i) == expected.GetLinenum(i) && tokens.GetId(i) == expected.GetId(i);
+		}
+
+		double sec = chrono::duration<double>(t3 - t2).count();
+		cout << "  " << threads << " threads   " << mb / sec << " MB/s, " << base / sec << "x" << (same ? "" : " (MISMATCH)") << endl;
+		if (threads == cores){
+			break;
+		}
+	}
+}
+
+
+//Peak resident set size so far, in MB
+static double peakMB(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+/**
+ * The streaming lexer reading a pipe. The same program is written down the pipe over and over, so the input is far
+ * bigger than anything we keep in memory, and the peak RSS shouldn't move by more than the stream's four blocks
+*/
+static void benchStream(){
+	string prog = syntheticProgram(4 << 20);
+	const int copies = 128;
+	double mb = (double)prog.size() * copies / 1e6;
+
+	int fds[2];
+	if (pipe(fds) != 0){
+		cout << "stream: no pipe" << endl;
+		return;
+	}
+	thread writer([&]{
+		for (int i = 0; i < copies; i++){
+			for (size_t done = 0; done < prog.size(); ){
+				ssize_t n = write(fds[1], prog.data() + done, prog.size() - done);
+				if (n <= 0){
+					break;
+				}
+				done += n;
+			}
+		}
+		close(fds[1]);
+	});
+
+	double before = peakMB();
+	uint64_t tokens = 0;
+	auto t0 = chrono::steady_clock::now();
+	{
+		StreamLexer stream(fds[0]);
+		int line = 1;
+		while (stream.Next(line) != DONE){
+			tokens++;
+		}
+	}
+	auto t1 = chrono::steady_clock::now();
+	writer.join();
+	close(fds[0]);
+
+	double sec = chrono::duration<double>(t1 - t0).count();
+	cout << "stream: " << mb << " MB through a pipe, " << tokens << " tokens" << endl;
+	cout << "  " << mb / sec << " MB/s, peak RSS " << before << " MB -> " << peakMB() << " MB" << endl;
+}
+
+
+/**
+ * Dumping every token to /dev/null: LexItems through operator<< and an ofstream, against a TokenWriter in text and in
+ * binary. Throughput is in MB of source
+*/
+static void benchDump(){
+	string prog = syntheticProgram(64 << 20, "d");
+	double mb = prog.size() / 1e6;
+	auto sec = [](chrono::steady_clock::time_point from){
+		return chrono::duration<double>(chrono::steady_clock::now() - from).count();
+	};
+
+	istringstream in(prog);
+	ofstream null("/dev/null");
+	int line = 1;
+	auto t0 = chrono::steady_clock::now();
+	LexItem item;
+	do {
+		item = getNextToken(in, line);
+		null << item << "\n";
+	} while (item != DONE);
+	null.flush();
+	double iostreamSec = sec(t0);
+
+	cout << "dump: " << mb << " MB" << endl;
+	cout << "  operator<<  " << mb / iostreamSec << " MB/s" << endl;
+
+	for (bool binary : {false, true}){
+		int fd = open("/dev/null", O_WRONLY);
+		auto t1 = chrono::steady_clock::now();
+		{
+			TokenWriter out(fd, binary);
+			LexCursor cursor(prog.data(), prog.size());
+			line = 1;
+			LexView tok;
+			do {
+				tok = getNextToken(cursor, line);
+				out.Write(tok);
+			} while (tok != DONE);
+		}
+		double writerSec = sec(t1);
+		close(fd);
+		cout << "  " << (binary ? "binary    " : "text      ") << "  " << mb / writerSec << " MB/s" << endl;
+	}
+}
+
+
+/**
+ * A program that is mostly numeric constants: lexing it, where every constant is decoded as it is lexed, and then the
+ * cost of decoding the same constants again from their text, with DecodeInt/DecodeReal against stoi/stod
+*/
+static void benchLiterals(){
+	string prog = "program lit;\nvar\n\tx : real := 0;\nbegin\n";
+	uint64_t seed = 12345;
+	auto next = [&seed](){
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		return seed >> 33;
+	};
+	while (prog.size() < (32 << 20)){
+		prog += "\tx := ";
+		for (int i = 0; i < 8; i++){
+			uint64_t r = next();
+			prog += i ? " + " : "";
+			prog += r % 2 ? to_string(r % 100000) : to_string(r % 10000) + "." + to_string(r % 997);
+		}
+		prog += ";\n";
+	}
+	prog += "\tx := 0\nend.\n";
+	double mb = prog.size() / 1e6;
+
+	vector<LexView> constants;
+	LexCursor cursor(prog.data(), prog.size());
+	int line = 1;
+	uint64_t tokens = 0;
+	auto t0 = chrono::steady_clock::now();
+	LexView tok;
+	do {
+		tok = getNextToken(cursor, line);
+		tokens++;
+	} while (tok != DONE);
+	auto t1 = chrono::steady_clock::now();
+
+	cursor.pos = 0;
+	do {
+		tok = getNextToken(cursor, line);
+		if (tok == ICONST || tok == RCONST){
+			constants.push_back(tok);
+		}
+	} while (tok != DONE);
+
+	auto t2 = chrono::steady_clock::now();
+	double sum = 0;
+	for (const LexView& c : constants){
+		int i;
+		double d;
+		c == ICONST ? (DecodeInt(c.GetLexeme(), i), sum += i) : (DecodeReal(c.GetLexeme(), d), sum += d);
+	}
+	auto t3 = chrono::steady_clock::now();
+	double oldSum = 0;
+	for (const LexView& c : constants){
+		string text(c.GetLexeme());
+		oldSum += c == ICONST ? stoi(text) : stod(text);
+	}
+	auto t4 = chrono::steady_clock::now();
+	double lexedSum = 0;
+	for (const LexView& c : constants){
+		lexedSum += c == ICONST ? c.GetIntValue() : c.GetRealValue();
+	}
+	sink = (uint64_t)(sum + oldSum);
+
+	auto ns = [&](chrono::steady_clock::duration d){ return chrono::duration<double, nano>(d).count() / constants.size(); };
+	cout << "literals: " << mb << " MB, " << tokens << " tokens, " << constants.size() << " constants"
+		<< (sum == oldSum && sum == lexedSum ? "" : " (VALUE MISMATCH)") << endl;
+	cout << "  lexer with decoding  " << mb / chrono::duration<double>(t1 - t0).count() << " MB/s" << endl;
+	cout << "  DecodeInt/DecodeReal " << ns(t3 - t2) << " ns/constant" << endl;
+	cout << "  stoi/stod            " << ns(t4 - t3) << " ns/constant" << endl;
+}
+
+
+/**
+ * Heap allocations on the lex->parse path. Every token is a LexItem, and a LexItem never allocates, so the only
+ * allocations left are the interners and tables growing, which doubles them and so happens a few times more for each
+ * time the program doubles in size. A 1 MB and an 8 MB program are parsed from scratch(after one parse to give the
+ * thread's tables the room they keep). Returns false if the bigger one takes more than GROWTH more allocations for
+ * each doubling, which even one allocation every few thousand tokens would
+*/
+static bool benchAllocs(){
+	const uint64_t GROWTH = 16;
+	auto parse = [](uint64_t bytes, uint64_t& tokens, bool& ok){
+		string prog = syntheticProgram(bytes, "alloc");
+		LexCursor counter(prog.data(), prog.size());
+		int line = 1;
+		tokens = 0;
+		while (getNextToken(counter, line) != DONE){
+			tokens++;
+		}
+
+		ClearInterned();
+		ParserContext parser;
+		LexCursor cursor(prog.data(), prog.size());
+		line = 1;
+		uint64_t before = allocations;
+		ok = parser.Prog(cursor, line);
+		return allocations - before;
+	};
+
+	uint64_t tokens[2];
+	bool ok[2];
+	parse(1 << 20, tokens[0], ok[0]);
+	uint64_t small = parse(1 << 20, tokens[0], ok[0]);
+	uint64_t big = parse(8 << 20, tokens[1], ok[1]);
+
+	bool pass = ok[0] && ok[1] && big <= small + 3 * GROWTH;
+	cout << "allocs: " << tokens[0] << " tokens " << small << " allocations, " << tokens[1] << " tokens " << big
+		<< " allocations, " << (double)big / tokens[1] << " per token" << (ok[0] && ok[1] ? "" : " (PARSE FAILED)")
+		<< (pass ? "" : " FAIL") << endl;
+	return pass;
+}
+
+
+/**
+ * Many files parsed at once, one ParserContext per file, on one thread per core, against the same files parsed one
+ * after another. Every file has its own errors planted in it, so the messages each context writes and counts are
+ * checked as well as the results. Returns false if any file comes out different
+*/
+static bool benchThreads(){
+	const int files = 256;
+	vector<string> programs(files);
+	for (int f = 0; f < files; f++){
+		programs[f] = syntheticProgram(64 << 10, "t" + to_string(f));
+		size_t n = 0;
+		for (size_t at = programs[f].find(":= ("); at != string::npos; at = programs[f].find(":= (", at + 1)){
+			if (++n % (f + 10) == 0){
+				programs[f].insert(at + 4, "* ");
+			}
+		}
+	}
+
+	struct Result {
+		bool	ok;
+		int	errors;
+		string	messages;
+	};
+	auto parse = [&](int f, Result& result){
+		ostringstream messages;
+		ParserContext parser(messages);
+		parser.SetErrorLimit(f % 2 == 0 ? 1 << 30 : 0);
+		LexCursor cursor(programs[f].data(), programs[f].size());
+		int line = 1;
+		result.ok = parser.Prog(cursor, line);
+		result.errors = parser.ErrCount();
+		result.messages = messages.str();
+	};
+
+	vector<Result> expected(files);
+	auto t0 = chrono::steady_clock::now();
+	for (int f = 0; f < files; f++){
+		parse(f, expected[f]);
+	}
+	auto t1 = chrono::steady_clock::now();
+
+	unsigned cores = max(2u, thread::hardware_concurrency());
+	vector<Result> results(files);
+	atomic<int> next{0};
+	vector<thread> workers;
+	auto t2 = chrono::steady_clock::now();
+	for (unsigned i = 0; i < cores; i++){
+		workers.emplace_back([&](){
+			for (int f = next++; f < files; f = next++){
+				parse(f, results[f]);
+			}
+		});
+	}
+	for (thread& t : workers){
+		t.join();
+	}
+	auto t3 = chrono::steady_clock::now();
+
+	int wrong = 0;
+	for (int f = 0; f < files; f++){
+		const Result& a = expected[f];
+		const Result& b = results[f];
+		wrong += a.ok != b.ok || a.errors != b.errors || a.messages != b.messages;
+	}
+
+	double seq = chrono::duration<double, milli>(t1 - t0).count();
+	double par = chrono::duration<double, milli>(t3 - t2).count();
+	cout << "threads: " << files << " files, sequential " << seq << " ms, " << cores << " threads " << par << " ms, "
+		<< seq / par << "x" << (wrong ? ", " + to_string(wrong) + " files differ FAIL" : "") << endl;
+	return wrong == 0;
+}
+
+
+/**
+ * Type errors don't stop the parse, so what stops them being reported is the error limit. A program with far more of
+ * them than the limit, parsed recursively and on the explicit stack with a few limits, has to report exactly as many
+ * as the limit allows(one when errors aren't recovered from). Returns false if any parse reports more or fewer
+*/
+static bool benchTypeErrors(){
+	string prog = syntheticProgram(1 << 20, "te");
+	int planted = 0;
+	size_t n = 0;
+	for (size_t at = prog.find(":= ("); at != string::npos; at = prog.find(":= (", at + 1)){
+		if (++n % 10 == 0){
+			prog.insert(at + 3, "'x' + ");
+			planted++;
+		}
+	}
+
+	int wrong = 0;
+	double ms = 0;
+	for (int limit : {0, 1, 5, 100}){
+		for (size_t budget : {(size_t)0, (size_t)1 << 20}){
+			ostringstream messages;
+			ParserContext parser(messages);
+			parser.SetErrorLimit(limit);
+			parser.SetStackBudget(budget);
+			LexCursor cursor(prog.data(), prog.size());
+			int line = 1;
+			auto t0 = chrono::steady_clock::now();
+			bool ok = parser.Prog(cursor, line);
+			ms += chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+			string text = messages.str();
+			int expected = min(planted, max(limit, 1));
+			if (ok || parser.ErrCount() != expected || count(text.begin(), text.end(), '\n') != expected){
+				cout << "typeerrors: limit " << limit << (budget ? ", explicit stack" : "") << ": " << parser.ErrCount()
+					<< " errors reported, expected " << expected << endl;
+				wrong++;
+			}
+		}
+	}
+	cout << "typeerrors: " << planted << " planted, 8 parses " << ms << " ms" << (wrong ? " FAIL" : "") << endl;
+	return wrong == 0;
+}
+
+
+/**
+ * The symbol table with a lot of variables: a program declaring 100k of them and using every one, parsed straight
+ * off the lexer(the table grows as it goes) and from a TokenBuffer(sized up front). Then small programs, each on a
+ * fresh context, once the thread's interner holds all those names, which is what a batch or server thread looks like
+*/
+static void benchSymbols(){
+	const int vars = 100000;
+	auto program = [&](const string& prefix){
+		string prog = "program symbols;\nvar\n";
+		for (int i = 0; i < vars; i++){
+			prog += "\t" + prefix + to_string(i) + (i % 2 ? " : real;\n" : " : integer;\n");
+		}
+		prog += "begin\n";
+		for (int i = 0; i < vars; i++){
+			prog += "\t" + prefix + to_string(i) + " := " + prefix + to_string((i * 7 + 4) % vars) + " + 1;\n";
+		}
+		prog += "\twriteln(" + prefix + "0)\nend.\n";
+		return prog;
+	};
+	auto ms = [](chrono::steady_clock::duration d){ return chrono::duration<double, milli>(d).count(); };
+
+	string streamed = program("ys");
+	string buffered = program("yb");
+
+	ParserContext grown(cout);
+	LexCursor cursor(streamed.data(), streamed.size());
+	int line = 1;
+	auto t0 = chrono::steady_clock::now();
+	bool ok = grown.Prog(cursor, line);
+	auto t1 = chrono::steady_clock::now();
+
+	TokenBuffer tokens;
+	tokens.Tokenize(buffered.data(), buffered.size());
+	ParserContext sized(cout);
+	line = 1;
+	auto t2 = chrono::steady_clock::now();
+	ok = sized.Prog(tokens, line) && ok;
+	auto t3 = chrono::steady_clock::now();
+
+	cout << "symbols: " << vars << " variables, " << streamed.size() / 1e6 << " MB" << (ok ? "" : " (PARSE FAILED)") << endl;
+	cout << "  lex+parse, growing   " << ms(t1 - t0) << " ms, " << grown.Symbols().Bytes() / 1024 << " KB table" << endl;
+	cout << "  token buffer, sized  " << ms(t3 - t2) << " ms, " << sized.Symbols().Bytes() / 1024 << " KB table" << endl;
+
+	const int small = 2000;
+	string text = syntheticProgram(4 << 10, "yz");
+	size_t bytes = 0;
+	auto t4 = chrono::steady_clock::now();
+	for (int i = 0; i < small; i++){
+		ParserContext parser(cout);
+		LexCursor src(text.data(), text.size());
+		line = 1;
+		ok = parser.Prog(src, line) && ok;
+		bytes = parser.Symbols().Bytes();
+	}
+	auto t5 = chrono::steady_clock::now();
+	cout << "  small programs       " << ms(t5 - t4) * 1000 / small << " us each, " << bytes / 1024 << " KB table"
+		<< (ok ? "" : " (PARSE FAILED)") << endl;
+}
+
+
+/**
+ * Per-edit latency of the incremental lexer for files of different sizes, against lexing the whole file again.
+ * The edits are someone typing in the middle of the file, including opening and closing a comment, which forces
+ * relexing up to the next '}'
+*/
+static void benchRelex(){
+	const char* typed = "x := x + 1; {note} ";
+
+	cout << "relex: microseconds per edit" << endl;
+	for (uint64_t size : {1ull << 20, 8ull << 20, 64ull << 20}){
+		string prog = syntheticProgram(size);
+		IncrementalLexer inc;
+		inc.Load(prog.data(), prog.size());
+
+		uint64_t at = prog.size() / 2;
+		while (prog[at] != '\n'){
+			at++;
+		}
+		at++;
+
+		//The first edit moves both gaps to the middle of the file, which is a one time cost
+		RelexResult r;
+		inc.Edit(at++, 0, " ", r);
+
+		//Time every edit on its own. The gap buffers occasionally double, which shows up in the max, not the median
+		uint64_t relexed = 0;
+		vector<double> times;
+		for (int rep = 0; rep < 200; rep++){
+			for (const char* c = typed; *c; c++){
+				auto t0 = chrono::steady_clock::now();
+				inc.Edit(at++, 0, string_view(c, 1), r);
+				auto t1 = chrono::steady_clock::now();
+				times.push_back(chrono::duration<double, micro>(t1 - t0).count());
+				relexed += r.relexedBytes;
+			}
+		}
+		sort(times.begin(), times.end());
+
+		//What every edit costs without incremental relexing
+		LexCursor cursor(prog.data(), prog.size());
+		int line = 1;
+		auto t2 = chrono::steady_clock::now();
+		while (getNextToken(cursor, line) != DONE){
+		}
+		auto t3 = chrono::steady_clock::now();
+
+		cout << "  " << (size >> 20) << " MB: incremental median " << times[times.size() / 2] << " max " << times.back()
+			<< " (" << relexed / times.size() << " bytes relexed), full relex " << chrono::duration<double, micro>(t3 - t2).count() << endl;
+	}
+}
+
+
+/**
+ * Bytes per cycle for each scanning kernel in each lexer state that uses them. Every buffer is built so the
+ * kernel has to scan the whole thing before it finds what it is looking for
+*/
+static void benchScan(){
+	const uint64_t size = 1 << 20;
+	const int reps = 200;
+
+	//Indentation heavy whitespace, a comment body, and a string body
+	string space(size, ' ');
+	for (uint64_t i = 0; i < size; i += 64){
+		space[i] = '\n';
+		space[i + 1] = '\t';
+	}
+	string comment(size, 'c');
+	for (uint64_t i = 0; i < size; i += 80){
+		comment[i] = '\n';
+	}
+	string str(size, 's');
+
+	const ScanKernels* all[] = {&scalarKernels, &sse2Kernels, &avx2Kernels};
+
+	cout << "scan: bytes/cycle (" << size << " byte buffers, best kernels: " << GetScanKernels().name << ")" << endl;
+	for (const ScanKernels* k : all){
+		if (!ScanKernelsSupported(*k)){
+			cout << "  " << k->name << ": not supported on this CPU" << endl;
+			continue;
+		}
+
+		int lines = 0;
+		uint64_t t0 = cycles();
+		for (int r = 0; r < reps; r++){
+			sink = k->skipSpace(space.data(), 0, size, lines);
+		}
+		uint64_t t1 = cycles();
+		for (int r = 0; r < reps; r++){
+			sink = k->skipComment(comment.data(), 0, size, lines);
+		}
+		uint64_t t2 = cycles();
+		for (int r = 0; r < reps; r++){
+			sink = k->skipString(str.data(), 0, size);
+		}
+		uint64_t t3 = cycles();
+
+		double bytes = (double)size * reps;
+		cout << "  " << k->name
+			<< "  START(whitespace) " << bytes / (t1 - t0)
+			<< "  INCOMMENT " << bytes / (t2 - t1)
+			<< "  INSTRING " << bytes / (t3 - t2) << endl;
+	}
+}
+
+
+//The keyword lookup lex.cpp used before the perfect hash, kept here to compare against
+static map<string, Token> keywordMap = {
+	{"IF", IF}, {"ELSE", ELSE}, {"THEN", THEN}, {"WRITELN", WRITELN}, {"WRITE", WRITE},
+	{"INTEGER", INTEGER}, {"REAL", REAL}, {"BOOLEAN", BOOLEAN}, {"STRING", STRING}, {"BEGIN", BEGIN},
+	{"END", END}, {"VAR", VAR}, {"PROGRAM", PROGRAM}, {"DIV", IDIV}, {"MOD", MOD}, {"AND", AND},
+	{"OR", OR}, {"NOT", NOT}, {"TRUE", BCONST}, {"FALSE", BCONST}
+};
+
+static Token mapKeyword(const string& lexeme){
+	string lexemeUpper = lexeme;
+	transform(lexemeUpper.begin(), lexemeUpper.end(), lexemeUpper.begin(), ::toupper);
+	auto i = keywordMap.find(lexemeUpper);
+	return i != keywordMap.end() ? i->second : IDENT;
+}
+
+
+/**
+ * Keyword classification, the old map lookup against the perfect hash, over a mix that looks like real code:
+ * mostly identifiers of all lengths, and keywords in whatever case people type them in
+*/
+static void benchKeywords(){
+	const char* mix[] = {
+		"r", "a", "p", "b", "flag", "str", "i", "j", "counter", "total_sum", "x1", "averageValue",
+		"begin", "end", "if", "then", "Else", "writeln", "integer", "real", "DIV", "mod", "and", "true"
+	};
+	vector<string> lexemes;
+	for (int i = 0; i < 1 << 16; i++){
+		lexemes.push_back(mix[(i * 7919) % (sizeof(mix) / sizeof(mix[0]))]);
+	}
+	const int reps = 50;
+
+	uint64_t check = 0;
+	auto t0 = chrono::steady_clock::now();
+	for (int r = 0; r < reps; r++){
+		for (const string& l : lexemes){
+			check += mapKeyword(l);
+		}
+	}
+	auto t1 = chrono::steady_clock::now();
+	for (int r = 0; r < reps; r++){
+		for (const string& l : lexemes){
+			check -= Keywords::Lookup(l.data(), l.size());
+		}
+	}
+	auto t2 = chrono::steady_clock::now();
+	sink = check;
+
+	double n = (double)lexemes.size() * reps;
+	double mapNs = chrono::duration<double, nano>(t1 - t0).count() / n;
+	double hashNs = chrono::duration<double, nano>(t2 - t1).count() / n;
+	cout << "keywords: ns/lookup  map " << mapNs << "  perfect hash " << hashNs
+		<< "  (" << mapNs / hashNs << "x)" << (check != 0 ? "  MISMATCH" : "") << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char* name = argc > 1 ? argv[1] : "";
+	bool all = argc == 1;
+
+	if( all || strcmp(name, "scan") == 0 )
+	{
+		benchScan();
+	}
+	if( all || strcmp(name, "lexer") == 0 )
+	{
+		benchLexer();
+	}
+	if( all || strcmp(name, "parse") == 0 )
+	{
+		benchParse();
+	}
+	if( all || strcmp(name, "expr") == 0 )
+	{
+		benchExpr();
+	}
+	if( all || strcmp(name, "deep") == 0 )
+	{
+		benchDeep();
+	}
+	if( all || strcmp(name, "recover") == 0 )
+	{
+		benchRecover();
+	}
+	if( all || strcmp(name, "ast") == 0 )
+	{
+		benchAst();
+	}
+	if( all || strcmp(name, "vm") == 0 )
+	{
+		benchVm();
+	}
+	if( all || strcmp(name, "opt") == 0 )
+	{
+		benchOptimize();
+	}
+	if( all || strcmp(name, "parlex") == 0 )
+	{
+		benchParallelLex();
+	}
+	if( all || strcmp(name, "stream") == 0 )
+	{
+		benchStream();
+	}
+	if( all || strcmp(name, "relex") == 0 )
+	{
+		benchRelex();
+	}
+	if( all || strcmp(name, "keywords") == 0 )
+	{
+		benchKeywords();
+	}
+	if( all || strcmp(name, "literals") == 0 )
+	{
+		benchLiterals();
+	}
+	if( all || strcmp(name, "dump") == 0 )
+	{
+		benchDump();
+	}
+	if( all || strcmp(name, "symbols") == 0 )
+	{
+		benchSymbols();
+	}
+	//Not just benchmarks, these fail the run if parsing on several threads at once goes wrong, if the parser
+	//allocates per token, or if type errors get past the error limit
+	if( all || strcmp(name, "threads") == 0 )
+	{
+		if( !benchThreads() )
+		{
+			return 1;
+		}
+	}
+	if( all || strcmp(name, "allocs") == 0 )
+	{
+		if( !benchAllocs() )
+		{
+			return 1;
+		}
+	}
+	if( all || strcmp(name, "typeerrors") == 0 )
+	{
+		if( !benchTypeErrors() )
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
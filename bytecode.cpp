@@ -0,0 +1,536 @@
+/**
+ * Bytecode implementation, and the compiler from the syntax tree. The compiler walks the tree once. Expressions are
+ * compiled into a stack of temporary registers that starts over at every statement, so a program needs only as many
+ * temporaries as its deepest expression
+*/
+
+#include "bytecode.h"
+#include "ast.h"
+#include "intern.h"
+#include "symtab.h"
+#include <unordered_map>
+#include <cstring>
+
+
+const char* const opNames[OP_COUNT] = {
+	"MOV", "I2R",
+	"ADD_I", "ADD_R", "SUB_I", "SUB_R", "MUL_I", "MUL_R", "DIV_R", "IDIV", "MOD", "CONCAT",
+	"NEG_I", "NEG_R", "NOT", "AND", "OR",
+	"EQ_I", "EQ_R", "EQ_S", "EQ_B", "LT_I", "LT_R", "LT_S", "GT_I", "GT_R", "GT_S",
+	"JMP", "JMPF",
+	"CHECK", "MARK",
+	"WRITE_I", "WRITE_R", "WRITE_S", "WRITE_B", "WRITELN",
+	"HALT",
+};
+
+
+uint32_t Bytecode::Emit(Op op, int line, uint32_t a, uint32_t b, uint32_t c){
+	code.push_back(Instr{op, a, b, c});
+	lines.push_back(line);
+	return (uint32_t)(code.size() - 1);
+}
+
+
+uint32_t Bytecode::AddRegister(Token type, Slot value){
+	registers.push_back(value);
+	types.push_back(type);
+	return (uint32_t)(registers.size() - 1);
+}
+
+
+uint32_t Bytecode::AddConstant(Token type, Slot value){
+	constants.push_back(AddRegister(type, value));
+	return constants.back();
+}
+
+
+uint32_t Bytecode::AddString(string_view text){
+	strings.emplace_back(text);
+	return (uint32_t)(strings.size() - 1);
+}
+
+
+//Point the jump at instruction at to target
+void Bytecode::SetJump(uint32_t at, uint32_t target){
+	if (code[at].op == OP_JMP){
+		code[at].a = target;
+	} else {
+		code[at].b = target;
+	}
+}
+
+
+void Bytecode::Clear(){
+	code.clear();
+	lines.clear();
+	registers.clear();
+	types.clear();
+	constants.clear();
+	strings.clear();
+	vars = 0;
+}
+
+
+//How many registers each op names, in a, b, c order
+static int operandCount(Op op){
+	switch (op){
+		case OP_JMP: case OP_CHECK: case OP_MARK:
+		case OP_WRITE_I: case OP_WRITE_R: case OP_WRITE_S: case OP_WRITE_B:
+			return 1;
+		case OP_MOV: case OP_I2R: case OP_NEG_I: case OP_NEG_R: case OP_NOT: case OP_JMPF:
+			return 2;
+		case OP_WRITELN: case OP_HALT: case OP_COUNT:
+			return 0;
+		default:
+			return 3;
+	}
+}
+
+
+void Bytecode::Disassemble(ostream& out) const {
+	out << registers.size() << " registers, " << vars << " variables, " << code.size() << " instructions" << endl;
+	for (uint32_t r : constants){
+		switch (types[r]){
+			case INTEGER: out << "  r" << r << " = " << registers[r].i << endl; break;
+			case REAL: out << "  r" << r << " = " << registers[r].r << endl; break;
+			case STRING: out << "  r" << r << " = '" << strings[registers[r].s] << "'" << endl; break;
+			case BOOLEAN: out << "  r" << r << " = " << (registers[r].b ? "true" : "false") << endl; break;
+			default: break;
+		}
+	}
+
+	for (size_t i = 0; i < code.size(); i++){
+		const Instr& in = code[i];
+		out << i << "\t" << opNames[in.op];
+		if (in.op == OP_JMP){
+			out << "\t-> " << in.a;
+		} else if (in.op == OP_JMPF){
+			out << "\tr" << in.a << " -> " << in.b;
+		} else {
+			uint32_t operands[3] = { in.a, in.b, in.c };
+			for (int k = 0; k < operandCount(in.op); k++){
+				out << (k == 0 ? "\tr" : " r") << operands[k];
+			}
+		}
+		out << endl;
+	}
+}
+
+
+/**
+ * The type rules, which the parser checks programs by as well. BinaryOp gives the op for operator token op on operands
+ * of types left and right, and the type of the result, or OP_COUNT if the operator doesn't take those types. real is
+ * set when integer operands have to be made reals first. "/" is always real division, div and mod are for integers only
+*/
+Op BinaryOp(Token op, Token left, Token right, Token& type, bool& real){
+	bool ints = left == INTEGER && right == INTEGER;
+	bool numbers = (left == INTEGER || left == REAL) && (right == INTEGER || right == REAL);
+	bool texts = left == STRING && right == STRING;
+	real = numbers && !ints;
+
+	switch (op){
+		case PLUS:
+			type = ints ? INTEGER : numbers ? REAL : STRING;
+			return ints ? OP_ADD_I : numbers ? OP_ADD_R : texts ? OP_CONCAT : OP_COUNT;
+		case MINUS:
+			type = ints ? INTEGER : REAL;
+			return ints ? OP_SUB_I : numbers ? OP_SUB_R : OP_COUNT;
+		case MULT:
+			type = ints ? INTEGER : REAL;
+			return ints ? OP_MUL_I : numbers ? OP_MUL_R : OP_COUNT;
+		case DIV:
+			type = REAL;
+			real = numbers;
+			return numbers ? OP_DIV_R : OP_COUNT;
+		case IDIV:
+			type = INTEGER;
+			return ints ? OP_IDIV : OP_COUNT;
+		case MOD:
+			type = INTEGER;
+			return ints ? OP_MOD : OP_COUNT;
+		case EQ:
+			type = BOOLEAN;
+			return ints ? OP_EQ_I : numbers ? OP_EQ_R : texts ? OP_EQ_S
+				: left == BOOLEAN && right == BOOLEAN ? OP_EQ_B : OP_COUNT;
+		case LTHAN:
+			type = BOOLEAN;
+			return ints ? OP_LT_I : numbers ? OP_LT_R : texts ? OP_LT_S : OP_COUNT;
+		case GTHAN:
+			type = BOOLEAN;
+			return ints ? OP_GT_I : numbers ? OP_GT_R : texts ? OP_GT_S : OP_COUNT;
+		case AND:
+		case OR:
+			type = BOOLEAN;
+			return left == BOOLEAN && right == BOOLEAN ? (op == AND ? OP_AND : OP_OR) : OP_COUNT;
+		default:
+			type = ERR;
+			return OP_COUNT;
+	}
+}
+
+
+//The same for MINUS and NOT in front of a factor. The result has the operand's type
+Op UnaryOp(Token op, Token operand){
+	if (op == MINUS){
+		return operand == INTEGER ? OP_NEG_I : operand == REAL ? OP_NEG_R : OP_COUNT;
+	}
+	return operand == BOOLEAN ? OP_NOT : OP_COUNT;
+}
+
+
+namespace {
+
+//Class definition of Compiler
+class Compiler {
+	const Ast&	ast;
+	Bytecode&	out;
+	//Cleared by anything the parser should have reported as a type error
+	bool	ok;
+
+	//Every declared variable. Variables get the first registers in the order they are declared, so a variable's
+	//register is its index
+	SymbolTable	vars;
+	//Which variables are sure to have a value at this point of the program, by register. trail lists the ones
+	//that got one, in order, so an if statement can take back what only one of its arms did
+	vector<uint8_t>	assigned;
+	vector<uint32_t>	trail;
+	vector<uint32_t>	stamps;
+	uint32_t	stamp;
+
+	//Constants already given a register
+	unordered_map<int32_t, uint32_t>	ints;
+	unordered_map<uint64_t, uint32_t>	reals;
+	unordered_map<uint32_t, uint32_t>	strings;
+	uint32_t	bools[2];
+
+	//Temporaries, used like a stack: top is the next free one, and temps are every temporary register made so far
+	vector<uint32_t>	temps;
+	size_t	top;
+
+	uint32_t	Temp();
+	uint32_t	Constant(Token type, Slot value, uint64_t key);
+	void	Assigned(uint32_t reg);
+	void	Undo(size_t mark);
+
+	uint32_t	Expr(uint32_t n, Token& type, uint32_t dest = Ast::NONE);
+	uint32_t	Binary(uint32_t n, Token& type, uint32_t dest);
+	uint32_t	ToReal(uint32_t reg, Token type, int line);
+	void	Store(uint32_t var, uint32_t expr, int line);
+	void	Stmt(uint32_t n);
+
+public:
+	Compiler(const Ast& ast, Bytecode& out) : ast(ast), out(out) {
+		ok = true;
+		stamp = 0;
+		bools[0] = bools[1] = Ast::NONE;
+		top = 0;
+	}
+
+	bool	Program();
+};
+
+
+uint32_t Compiler::Temp(){
+	if (top == temps.size()){
+		temps.push_back(out.AddRegister(ERR, Slot{0}));
+	}
+	return temps[top++];
+}
+
+
+//The register holding a constant, made the first time the constant is seen. key is the constant's bits
+uint32_t Compiler::Constant(Token type, Slot value, uint64_t key){
+	switch (type){
+		case INTEGER: {
+			auto found = ints.find(value.i);
+			if (found != ints.end()){
+				return found->second;
+			}
+			return ints[value.i] = out.AddConstant(type, value);
+		}
+		case REAL: {
+			auto found = reals.find(key);
+			if (found != reals.end()){
+				return found->second;
+			}
+			return reals[key] = out.AddConstant(type, value);
+		}
+		case STRING: {
+			auto found = strings.find((uint32_t)key);
+			if (found != strings.end()){
+				return found->second;
+			}
+			value.s = out.AddString(lexemes.GetName((uint32_t)key));
+			return strings[(uint32_t)key] = out.AddConstant(type, value);
+		}
+		default:
+			if (bools[value.b] == Ast::NONE){
+				bools[value.b] = out.AddConstant(type, value);
+			}
+			return bools[value.b];
+	}
+}
+
+
+void Compiler::Assigned(uint32_t reg){
+	if (!assigned[reg]){
+		assigned[reg] = 1;
+		trail.push_back(reg);
+	}
+}
+
+
+//Forget every variable that got a value since mark
+void Compiler::Undo(size_t mark){
+	for (size_t i = mark; i < trail.size(); i++){
+		assigned[trail[i]] = 0;
+	}
+	trail.resize(mark);
+}
+
+
+uint32_t Compiler::ToReal(uint32_t reg, Token type, int line){
+	if (type != INTEGER){
+		return reg;
+	}
+	uint32_t real = Temp();
+	out.Emit(OP_I2R, line, real, reg);
+	return real;
+}
+
+
+/**
+ * Compile an expression. Returns the register its value ends up in, and sets type to the type the parser gave it.
+ * When the value has to be computed by an instruction anyway and dest is given, it is computed straight into dest
+*/
+uint32_t Compiler::Expr(uint32_t n, Token& type, uint32_t dest){
+	int line = ast.GetLine(n);
+	Slot value = {0};
+
+	switch (ast.GetKind(n)){
+		case N_VAR: {
+			uint32_t reg = vars.Find(ast.GetA(n))->index;
+			type = out.GetType(reg);
+			//Once the check passes, the variable has a value from here on
+			if (!assigned[reg]){
+				out.Emit(OP_CHECK, line, reg);
+				Assigned(reg);
+			}
+			return reg;
+		}
+		case N_ICONST:
+			type = INTEGER;
+			value.i = ast.GetInt(n);
+			return Constant(type, value, 0);
+		case N_RCONST: {
+			type = REAL;
+			value.r = ast.GetReal(n);
+			uint64_t bits;
+			memcpy(&bits, &value.r, sizeof(bits));
+			return Constant(type, value, bits);
+		}
+		case N_SCONST:
+			type = STRING;
+			return Constant(type, value, ast.GetA(n));
+		case N_BCONST:
+			type = BOOLEAN;
+			value.b = ast.GetA(n) != 0;
+			return Constant(type, value, 0);
+		case N_UNARY: {
+			size_t mark = top;
+			Token operand;
+			uint32_t reg = Expr(ast.GetA(n), operand);
+			top = mark;
+			Op op = UnaryOp(ast.GetOp(n), operand);
+			type = ast.GetType(n);
+			if (op == OP_COUNT){
+				ok = false;
+				return reg;
+			}
+			uint32_t result = dest != Ast::NONE ? dest : Temp();
+			out.Emit(op, line, result, reg);
+			return result;
+		}
+		case N_BINARY:
+			return Binary(n, type, dest);
+		default:
+			type = ERR;
+			return 0;
+	}
+}
+
+
+uint32_t Compiler::Binary(uint32_t n, Token& type, uint32_t dest){
+	int line = ast.GetLine(n);
+	size_t mark = top;
+	Token lt, rt;
+	uint32_t left = Expr(ast.GetA(n), lt);
+	uint32_t right = Expr(ast.GetB(n), rt);
+
+	bool real;
+	Op op = BinaryOp(ast.GetOp(n), lt, rt, type, real);
+	type = ast.GetType(n);
+	if (op == OP_COUNT){
+		ok = false;
+		top = mark;
+		return left;
+	}
+
+	//An integer mixed with a real is made a real first
+	if (real){
+		left = ToReal(left, lt, line);
+		right = ToReal(right, rt, line);
+	}
+	top = mark;
+	uint32_t result = dest != Ast::NONE ? dest : Temp();
+	out.Emit(op, line, result, left, right);
+	return result;
+}
+
+
+//Assign the value of expression node expr to the variable in register var
+void Compiler::Store(uint32_t var, uint32_t expr, int line){
+	Token want = out.GetType(var);
+	Token type;
+	uint32_t reg = Expr(expr, type, var);
+
+	if (type == INTEGER && want == REAL){
+		out.Emit(OP_I2R, line, var, reg);
+	} else if (type != want){
+		ok = false;
+		return;
+	} else if (reg != var){
+		out.Emit(OP_MOV, line, var, reg);
+	}
+
+	if (!assigned[var]){
+		out.Emit(OP_MARK, line, var);
+		Assigned(var);
+	}
+}
+
+
+void Compiler::Stmt(uint32_t n){
+	int line = ast.GetLine(n);
+	top = 0;
+
+	switch (ast.GetKind(n)){
+		case N_BLOCK:
+			for (uint32_t i = 0; i < ast.GetB(n); i++){
+				Stmt(ast.GetListItem(ast.GetA(n) + i));
+			}
+			break;
+		case N_ASSIGN:
+			Store(vars.Find(ast.GetA(ast.GetA(n)))->index, ast.GetB(n), line);
+			break;
+		case N_WRITE:
+		case N_WRITELN:
+			for (uint32_t i = 0; i < ast.GetB(n); i++){
+				Token type;
+				uint32_t reg = Expr(ast.GetListItem(ast.GetA(n) + i), type);
+				top = 0;
+				switch (type){
+					case INTEGER: out.Emit(OP_WRITE_I, line, reg); break;
+					case REAL: out.Emit(OP_WRITE_R, line, reg); break;
+					case STRING: out.Emit(OP_WRITE_S, line, reg); break;
+					case BOOLEAN: out.Emit(OP_WRITE_B, line, reg); break;
+					default: break;
+				}
+			}
+			if (ast.GetKind(n) == N_WRITELN){
+				out.Emit(OP_WRITELN, line);
+			}
+			break;
+		case N_IF:
+		case N_IF_ELSE: {
+			bool both = ast.GetKind(n) == N_IF_ELSE;
+			Token type;
+			uint32_t cond = Expr(ast.GetA(n), type);
+			ok = ok && type == BOOLEAN;
+			uint32_t skip = out.Emit(OP_JMPF, line, cond);
+
+			//Only what both arms assign is sure to be assigned after the if
+			size_t mark = trail.size();
+			Stmt(both ? ast.GetListItem(ast.GetB(n)) : ast.GetB(n));
+			vector<uint32_t> thenAssigned(trail.begin() + mark, trail.end());
+			Undo(mark);
+			if (!both){
+				out.SetJump(skip, (uint32_t)out.Size());
+				break;
+			}
+
+			uint32_t end = out.Emit(OP_JMP, line);
+			out.SetJump(skip, (uint32_t)out.Size());
+			Stmt(ast.GetListItem(ast.GetB(n) + 1));
+			out.SetJump(end, (uint32_t)out.Size());
+
+			stamp++;
+			for (uint32_t reg : thenAssigned){
+				stamps[reg] = stamp;
+			}
+			size_t kept = mark;
+			for (size_t i = mark; i < trail.size(); i++){
+				if (stamps[trail[i]] == stamp){
+					trail[kept++] = trail[i];
+				} else {
+					assigned[trail[i]] = 0;
+				}
+			}
+			trail.resize(kept);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+
+bool Compiler::Program(){
+	uint32_t root = ast.Root();
+	uint32_t start = ast.GetA(root);
+	uint32_t decls = ast.GetB(root);
+
+	//Every variable gets its register before anything else does
+	for (uint32_t d = 0; d < decls; d++){
+		uint32_t decl = ast.GetListItem(start + d);
+		for (uint32_t i = 0; i < ast.GetB(decl); i++){
+			vars.Declare(ast.GetListItem(ast.GetA(decl) + i), ast.GetLine(decl));
+			out.AddRegister(ast.GetOp(decl), Slot{0});
+		}
+	}
+	out.SetVars(out.Registers());
+	assigned.assign(out.Registers(), 0);
+	stamps.assign(out.Registers(), 0);
+
+	//Initializers run first, in order. The first variable gets the value and the rest copy it
+	for (uint32_t d = 0; d < decls; d++){
+		uint32_t decl = ast.GetListItem(start + d);
+		if (ast.GetKind(decl) != N_DECL_INIT){
+			continue;
+		}
+		uint32_t first = vars.Find(ast.GetListItem(ast.GetA(decl)))->index;
+		top = 0;
+		Store(first, ast.GetListItem(ast.GetA(decl) + ast.GetB(decl)), ast.GetLine(decl));
+		for (uint32_t i = 1; i < ast.GetB(decl); i++){
+			uint32_t var = vars.Find(ast.GetListItem(ast.GetA(decl) + i))->index;
+			out.Emit(OP_MOV, ast.GetLine(decl), var, first);
+			Assigned(var);
+		}
+	}
+
+	Stmt(ast.GetListItem(start + decls));
+	out.Emit(OP_HALT, ast.GetLine(root));
+	return ok;
+}
+
+}
+
+
+bool Compile(const Ast& ast, Bytecode& out){
+	out.Clear();
+	if (ast.Root() == Ast::NONE){
+		return false;
+	}
+	Compiler compiler(ast, out);
+	return compiler.Program();
+}
@@ -0,0 +1,123 @@
+/*
+ * bytecode.h
+ *
+ * The register bytecode programs are compiled to, and the compiler from the syntax tree(ast.h).
+ * Every value a program touches lives in one flat register file: first one register per
+ * variable, then the constants and the temporaries expressions need. Instructions are three
+ * address, "a = b op c", with every operand a register index, so the VM never decodes operand
+ * kinds and never pushes or pops. Constants are loaded by copying the initial register file.
+ *
+ * Types have already been checked by the parser, and every node of the tree has its type, so every
+ * instruction is for one type(ADD_I, ADD_R) and the VM never checks a type. Integers mixed with
+ * reals are turned into reals first(I2R), and an integer can be assigned to a real variable, but
+ * not the other way. A type error anywhere in the program is reported and counted like a syntax error, and the
+ * parse carries on but fails, so a program with one never gets here, whether that statement would ever run or not.
+ * What is left for run time is dividing by zero and reading a variable that may not have
+ * been given a value yet; the compiler only emits the CHECK for that where the variable isn't
+ * assigned on every path to the read.
+*/
+
+#ifndef BYTECODE_H_
+#define BYTECODE_H_
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+class Ast;
+
+
+enum Op : uint8_t {
+	//a = b, whatever the type
+	OP_MOV,
+	OP_I2R,
+	OP_ADD_I, OP_ADD_R, OP_SUB_I, OP_SUB_R, OP_MUL_I, OP_MUL_R, OP_DIV_R, OP_IDIV, OP_MOD, OP_CONCAT,
+	OP_NEG_I, OP_NEG_R, OP_NOT, OP_AND, OP_OR,
+	OP_EQ_I, OP_EQ_R, OP_EQ_S, OP_EQ_B, OP_LT_I, OP_LT_R, OP_LT_S, OP_GT_I, OP_GT_R, OP_GT_S,
+	//Jump to a, jump to b if register a is false
+	OP_JMP, OP_JMPF,
+	//Fail if variable a has not been given a value, record that it has. The compiler gives variable n register n
+	OP_CHECK, OP_MARK,
+	OP_WRITE_I, OP_WRITE_R, OP_WRITE_S, OP_WRITE_B, OP_WRITELN,
+	OP_HALT,
+	OP_COUNT,
+};
+
+//Printable name of every op, in the same order as the enum
+extern const char* const opNames[OP_COUNT];
+
+
+//One instruction. Jump targets are instruction indexes
+struct Instr {
+	Op	op;
+	uint32_t	a;
+	uint32_t	b;
+	uint32_t	c;
+};
+
+
+//One register. Which member is live is known from the instruction reading it. A string is an index into the
+//program's strings. The real comes first so Slot{0} clears all 8 bytes
+union Slot {
+	double	r;
+	int32_t	i;
+	uint32_t	s;
+	bool	b;
+};
+static_assert(sizeof(Slot) == 8, "a register is 8 bytes");
+
+
+//Class definition of Bytecode
+class Bytecode {
+	vector<Instr>	code;
+	//Source line of every instruction, only read to report a run time error
+	vector<int>	lines;
+	//The register file as it is before the program starts: variables zeroed, constants, temporaries zeroed
+	vector<Slot>	registers;
+	//Type of every variable and constant register(INTEGER, REAL, STRING or BOOLEAN), ERR for a temporary
+	vector<Token>	types;
+	//Registers that hold constants
+	vector<uint32_t>	constants;
+	vector<string>	strings;
+	uint32_t	vars;
+
+public:
+	Bytecode() { vars = 0; }
+
+	//Building
+	uint32_t	Emit(Op op, int line, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+	uint32_t	AddRegister(Token type, Slot value);
+	uint32_t	AddConstant(Token type, Slot value);
+	uint32_t	AddString(string_view text);
+	void	SetJump(uint32_t at, uint32_t target);
+	void	SetVars(uint32_t count) { vars = count; }
+	void	Clear();
+
+	size_t	Size() const { return code.size(); }
+	const Instr&	Get(size_t i) const { return code[i]; }
+	const Instr*	Code() const { return code.data(); }
+	int	GetLine(size_t i) const { return lines[i]; }
+	uint32_t	Registers() const { return (uint32_t)registers.size(); }
+	const vector<Slot>&	InitialRegisters() const { return registers; }
+	Token	GetType(uint32_t reg) const { return types[reg]; }
+	uint32_t	Vars() const { return vars; }
+	const vector<string>&	Strings() const { return strings; }
+
+	//One instruction per line, with the constants written out
+	void	Disassemble(ostream& out) const;
+};
+
+
+extern Op BinaryOp(Token op, Token left, Token right, Token& type, bool& real);
+extern Op UnaryOp(Token op, Token operand);
+
+//Compile the tree of a program that parsed, and so type checked. Returns false for a tree that doesn't
+extern bool Compile(const Ast& ast, Bytecode& out);
+
+
+#endif /* BYTECODE_H_ */
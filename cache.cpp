@@ -0,0 +1,369 @@
+/**
+ * The parse cache. An entry file is a fixed header(which repeats the whole key, so a file can be checked against what
+ * was asked for), then the messages. A hit costs hashing the source, then an open, an fstat and an mmap.
+ *
+ * How recently an entry was used is its modification time. Touching every entry on every hit would cost a write per
+ * file, so a hit only touches an entry that hasn't been touched for an hour, which is close enough to pick what to evict.
+ * The total in the size file only ever counts up between evictions(an entry written over is counted again), and every
+ * eviction measures the cache from scratch, so it can't drift far
+*/
+
+#include "cache.h"
+#include "parser.h"
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+
+namespace {
+	const char MAGIC[8] = {'P', 'A', 'R', 'S', 'E', 'C', 'H', 'E'};
+
+	//Start of every entry file
+	struct Header {
+		char	magic[8];
+		uint32_t	version;
+		int32_t	errorLimit;
+		uint64_t	stackBudget;
+		uint64_t	hash;
+		uint64_t	size;
+		int32_t	ok;
+		int32_t	errors;
+		uint64_t	messageBytes;
+	};
+
+	//An entry file found while measuring a directory
+	struct EntryFile {
+		string	path;
+		uint64_t	bytes;
+		time_t	used;
+	};
+
+	//Temporary files left behind by a writer that died are removed once they are this old
+	const time_t STALE_SECONDS = 3600;
+
+	const uint64_t P1 = 11400714785074694791ULL;
+	const uint64_t P2 = 14029467366897019727ULL;
+	const uint64_t P3 = 1609587929392839161ULL;
+	const uint64_t P4 = 9650029242287828579ULL;
+	const uint64_t P5 = 2870177450012600261ULL;
+
+	inline uint64_t rotl(uint64_t x, int r){
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t read64(const char* p){
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t read32(const char* p){
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t mixLane(uint64_t acc, uint64_t lane){
+		return rotl(acc + lane * P2, 31) * P1;
+	}
+
+	inline uint64_t mergeLane(uint64_t h, uint64_t v){
+		return (h ^ mixLane(0, v)) * P1 + P4;
+	}
+
+	/**
+	 * Add every entry in a bucket directory to files, and return their total size. Temporary files don't count, and
+	 * ones that have been lying around too long are removed
+	*/
+	uint64_t scanBucket(const string& path, vector<EntryFile>& files){
+		uint64_t total = 0;
+		DIR* d = opendir(path.c_str());
+		if (d == nullptr){
+			return 0;
+		}
+		time_t now = time(nullptr);
+		while (dirent* e = readdir(d)){
+			string name = e->d_name;
+			struct stat st;
+			if (name == "." || name == ".." || stat((path + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)){
+				continue;
+			}
+			if (name[0] == '.'){
+				if (now - st.st_mtime > STALE_SECONDS){
+					unlink((path + "/" + name).c_str());
+				}
+				continue;
+			}
+			total += st.st_size;
+			files.push_back(EntryFile{path + "/" + name, (uint64_t)st.st_size, st.st_mtime});
+		}
+		closedir(d);
+		return total;
+	}
+}
+
+
+/**
+ * XXH64 with a seed of 0: four independent lanes over 32 byte stripes, so it runs at memory speed, then the tail a
+ * word, a half word and a byte at a time
+*/
+uint64_t ContentHash(const char* buf, uint64_t size){
+	const char* p = buf;
+	const char* end = buf + size;
+	uint64_t h;
+
+	if (size >= 32){
+		uint64_t v1 = P1 + P2;
+		uint64_t v2 = P2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - P1;
+		do {
+			v1 = mixLane(v1, read64(p));
+			v2 = mixLane(v2, read64(p + 8));
+			v3 = mixLane(v3, read64(p + 16));
+			v4 = mixLane(v4, read64(p + 24));
+			p += 32;
+		} while (end - p >= 32);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeLane(h, v1);
+		h = mergeLane(h, v2);
+		h = mergeLane(h, v3);
+		h = mergeLane(h, v4);
+	} else {
+		h = P5;
+	}
+	h += size;
+
+	for (; end - p >= 8; p += 8){
+		h = rotl(h ^ mixLane(0, read64(p)), 27) * P1 + P4;
+	}
+	if (end - p >= 4){
+		h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+		p += 4;
+	}
+	for (; p < end; p++){
+		h = rotl(h ^ ((unsigned char)*p * P5), 11) * P1;
+	}
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+void CacheEntry::Close(){
+	if (data != nullptr){
+		munmap(const_cast<char*>(data), size);
+	}
+	data = nullptr;
+	size = 0;
+	messages = string_view();
+}
+
+
+ParseCache::ParseCache(const string& dir, uint64_t maxBytes) : dir(dir), maxBytes(maxBytes) {
+}
+
+
+bool ParseCache::Open(string& error){
+	if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST){
+		error = "CANNOT CREATE CACHE " + dir + ": " + strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || access(dir.c_str(), R_OK | W_OK | X_OK) != 0){
+		error = "CANNOT USE CACHE " + dir;
+		return false;
+	}
+	return true;
+}
+
+
+CacheKey ParseCache::Key(const char* buf, uint64_t size, int errorLimit, size_t stackBudget){
+	return CacheKey{ContentHash(buf, size), size, errorLimit, stackBudget};
+}
+
+
+//dir/hh/<hash>.<size>.<error limit>.<stack budget>, where hh is the top byte of the hash
+string ParseCache::PathOf(const CacheKey& key) const{
+	char name[96];
+	snprintf(name, sizeof(name), "/%02x/%016llx.%llx.%x.%llx", (unsigned)(key.hash >> 56), (unsigned long long)key.hash,
+		(unsigned long long)key.size, (unsigned)key.errorLimit, (unsigned long long)key.stackBudget);
+	return dir + name;
+}
+
+
+bool ParseCache::Lookup(const CacheKey& key, CacheEntry& entry){
+	entry.Close();
+	int fd = open(PathOf(key).c_str(), O_RDONLY);
+	if (fd < 0){
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(Header)){
+		close(fd);
+		return false;
+	}
+	void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr != MAP_FAILED && time(nullptr) - st.st_mtime > STALE_SECONDS){
+		futimens(fd, nullptr);
+	}
+	close(fd);
+	if (addr == MAP_FAILED){
+		return false;
+	}
+
+	const char* data = static_cast<const char*>(addr);
+	uint64_t size = st.st_size;
+	Header h;
+	memcpy(&h, data, sizeof(h));
+	bool whole = memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 && h.version == CACHE_VERSION
+		&& h.hash == key.hash && h.size == key.size && h.errorLimit == key.errorLimit && h.stackBudget == key.stackBudget
+		&& h.messageBytes == size - sizeof(h);
+	if (!whole){
+		munmap(addr, size);
+		return false;
+	}
+
+	entry.data = data;
+	entry.size = size;
+	entry.ok = h.ok != 0;
+	entry.errors = h.errors;
+	entry.messages = string_view(data + sizeof(h), h.messageBytes);
+	return true;
+}
+
+
+bool ParseCache::Store(const CacheKey& key, bool ok, int errors, string_view messages){
+	Header h;
+	memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = CACHE_VERSION;
+	h.errorLimit = key.errorLimit;
+	h.stackBudget = key.stackBudget;
+	h.hash = key.hash;
+	h.size = key.size;
+	h.ok = ok;
+	h.errors = errors;
+	h.messageBytes = messages.size();
+
+	string blob((const char*)&h, sizeof(h));
+	blob.append(messages);
+
+	//Written under a name no other writer can be using, then renamed over the real one in a single step
+	static atomic<uint64_t> written{0};
+	string path = PathOf(key);
+	string bucketDir = path.substr(0, dir.size() + 3);
+	string temp = bucketDir + "/." + to_string(getpid()) + "." + to_string(written++);
+	int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0 && errno == ENOENT && (mkdir(bucketDir.c_str(), 0755) == 0 || errno == EEXIST)){
+		fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+	}
+	if (fd < 0){
+		return false;
+	}
+	size_t done = 0;
+	while (done < blob.size()){
+		ssize_t put = write(fd, blob.data() + done, blob.size() - done);
+		if (put < 0 && errno == EINTR){
+			continue;
+		}
+		if (put <= 0){
+			break;
+		}
+		done += put;
+	}
+	bool whole = close(fd) == 0 && done == blob.size();
+	if (!whole || rename(temp.c_str(), path.c_str()) != 0){
+		unlink(temp.c_str());
+		return false;
+	}
+
+	Account(blob.size());
+	return true;
+}
+
+
+//Add bytes to the cache's total, and evict if that takes it over the limit. The lock on the size file keeps writers
+//in every process from counting over each other, or evicting at the same time
+void ParseCache::Account(uint64_t bytes){
+	int fd = open((dir + "/size").c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0){
+		return;
+	}
+	if (flock(fd, LOCK_EX) == 0){
+		uint64_t total = 0;
+		if (pread(fd, &total, sizeof(total), 0) != sizeof(total)){
+			total = 0;
+		}
+		total += bytes;
+		if (total > maxBytes){
+			total = Evict();
+		}
+		ssize_t put = pwrite(fd, &total, sizeof(total), 0);
+		(void)put;
+	}
+	close(fd);
+}
+
+
+/**
+ * Measure every entry, and bring a cache that has gone over its limit down to three quarters of it, least recently
+ * used first, so the next few writes don't each have to evict again. Returns what is left
+*/
+uint64_t ParseCache::Evict(){
+	vector<EntryFile> files;
+	uint64_t total = 0;
+	for (unsigned bucket = 0; bucket < 256; bucket++){
+		char hex[4];
+		snprintf(hex, sizeof(hex), "/%02x", bucket);
+		total += scanBucket(dir + hex, files);
+	}
+	sort(files.begin(), files.end(), [](const EntryFile& a, const EntryFile& b){ return a.used < b.used; });
+	for (const EntryFile& f : files){
+		if (total <= maxBytes / 4 * 3){
+			break;
+		}
+		if (unlink(f.path.c_str()) == 0){
+			total -= f.bytes;
+		}
+	}
+	return total;
+}
+
+
+bool CachedProg(ParseCache& cache, ParserContext& parser, ostringstream& messages, const char* buf, uint64_t size,
+	bool reparse, int& errors){
+	CacheKey key = ParseCache::Key(buf, size, parser.GetErrorLimit(), parser.GetStackBudget());
+	bool hit;
+	{
+		CacheEntry entry;
+		hit = cache.Lookup(key, entry);
+		if (hit && (!reparse || !entry.Ok())){
+			messages << entry.Messages();
+			errors = entry.Errors();
+			return entry.Ok();
+		}
+	}
+
+	auto from = messages.tellp();
+	LexCursor cursor(buf, size);
+	int line = 1;
+	bool ok = parser.Prog(cursor, line);
+	errors = parser.ErrCount();
+	if (!hit){
+		cache.Store(key, ok, errors, string_view(messages.str()).substr(from));
+	}
+	return ok;
+}
@@ -0,0 +1,109 @@
+/*
+ * cache.h
+ *
+ * A content addressed cache of parse results on disk, so files that haven't changed since the last
+ * run aren't lexed and parsed again. An entry is keyed by a hash of the source text together with
+ * everything else that changes what the parser says about it(the cache version, the error limit and
+ * the stack budget), and holds the verdict and the messages the parser wrote.
+ *
+ * Entries are read with mmap, and written to a temporary file that is renamed into place, so a reader
+ * only ever sees a whole entry, even with other processes writing to the same cache. Entries are
+ * spread over 256 directories by the first byte of the hash. The total size is kept in a file that
+ * writers update under a lock, and when it goes over the limit the entries that were used longest ago
+ * are removed.
+*/
+
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <cstdint>
+
+using namespace std;
+
+class ParserContext;
+
+
+//Bump whenever the parser's verdicts or messages change, or the layout of an entry does
+const uint32_t CACHE_VERSION = 3;
+
+//What an entry is looked up by
+struct CacheKey {
+	uint64_t	hash;
+	uint64_t	size;
+	int32_t	errorLimit;
+	uint64_t	stackBudget;
+};
+
+//Fast 64-bit hash of the bytes in buf. Not cryptographic: it tells unchanged files apart from edited ones
+extern uint64_t ContentHash(const char* buf, uint64_t size);
+
+
+//Class definition of CacheEntry. A cached parse, read straight out of the mapped entry file
+class CacheEntry {
+	const char*	data;
+	uint64_t	size;
+	bool	ok;
+	int	errors;
+	string_view	messages;
+
+	friend class ParseCache;
+	void	Close();
+
+public:
+	CacheEntry() {
+		data = nullptr;
+		size = 0;
+		ok = false;
+		errors = 0;
+	}
+	~CacheEntry() { Close(); }
+
+	CacheEntry(const CacheEntry&) = delete;
+	CacheEntry& operator=(const CacheEntry&) = delete;
+
+	bool	Ok() const { return ok; }
+	int	Errors() const { return errors; }
+	string_view	Messages() const { return messages; }
+};
+
+
+//Class definition of ParseCache. One can be shared by any number of threads, and any number of processes can use the
+//same directory
+class ParseCache {
+	string	dir;
+	uint64_t	maxBytes;
+
+	string	PathOf(const CacheKey& key) const;
+	void	Account(uint64_t bytes);
+	uint64_t	Evict();
+
+public:
+	static const uint64_t DEFAULT_BYTES = 256 << 20;
+
+	ParseCache(const string& dir, uint64_t maxBytes = DEFAULT_BYTES);
+
+	//Make the cache's directories if they aren't there. Returns false, with error saying why, if it can't
+	bool	Open(string& error);
+
+	static CacheKey	Key(const char* buf, uint64_t size, int errorLimit, size_t stackBudget);
+	//Find the entry for key. Returns false if there isn't a whole one
+	bool	Lookup(const CacheKey& key, CacheEntry& entry);
+	//Save a parse. Returns false if it couldn't be written, which only costs a miss next time
+	bool	Store(const CacheKey& key, bool ok, int errors, string_view messages);
+};
+
+
+/**
+ * Parse the program in buf on parser through cache, where messages is the stream parser writes to. On a hit nothing is
+ * lexed or parsed, the cached messages are written to messages and the cached verdict comes back. A miss is parsed
+ * and saved. errors is how many errors there were either way. With reparse, a hit on a program that parsed is parsed
+ * again anyway, for its syntax tree
+*/
+extern bool CachedProg(ParseCache& cache, ParserContext& parser, ostringstream& messages, const char* buf, uint64_t size,
+	bool reparse, int& errors);
+
+
+#endif /* CACHE_H_ */
@@ -0,0 +1,428 @@
+/**
+ * C translation implementation. The output is a fixed runtime(a handful of static functions for strings, output and
+ * errors), the program's string constants, and main, which holds the variables and the statements. Operations that
+ * can't fail are plain C; the ones that can have their check written out in front of them
+*/
+
+#include "cgen.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "intern.h"
+#include "symtab.h"
+#include <unordered_map>
+#include <vector>
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+
+//Everything a translated program needs besides its own code. Output and error reports match prog2 --run
+static const char* const runtime = R"(#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+typedef struct { const char* p; size_t n; } Str;
+
+#define RT_DIVIDE "Illegal division by Zero"
+#define RT_UNINIT "Using uninitialized Variable"
+
+static void rt_fail(int line, const char* msg){
+	printf("\n%d: Run-Time Error-%s\n\nUnsuccessful Interpretation \nNumber of Errors 1\n", line, msg);
+	exit(1);
+}
+
+/* Strings made while the program runs are never freed: there are at most as many as there are + in the program */
+static inline Str rt_concat(Str a, Str b){
+	char* p = (char*)malloc(a.n + b.n + 1);
+	if (p == NULL){
+		fputs("out of memory\n", stderr);
+		exit(2);
+	}
+	memcpy(p, a.p, a.n);
+	memcpy(p + a.n, b.p, b.n);
+	Str s = {p, a.n + b.n};
+	return s;
+}
+
+static inline int rt_compare(Str a, Str b){
+	int c = memcmp(a.p, b.p, a.n < b.n ? a.n : b.n);
+	return c != 0 ? c : (a.n > b.n) - (a.n < b.n);
+}
+
+static inline int32_t rt_wrap(uint32_t v){
+	return (int32_t)v;
+}
+
+static inline void rt_write_i(int32_t v){ printf("%d", (int)v); }
+static inline void rt_write_r(double v){ printf("%.2f", v); }
+static inline void rt_write_s(Str v){ fwrite(v.p, 1, v.n, stdout); }
+static inline void rt_write_b(bool v){ fputs(v ? "true" : "false", stdout); }
+)";
+
+
+namespace {
+
+//Class definition of CTranslator
+class CTranslator {
+	const Ast&	ast;
+	bool	ok;
+
+	//main's statements, and the string constants, which have to come before it
+	string	body;
+	string	constants;
+	//Name of the constant for each string lexeme id already used
+	unordered_map<uint32_t, string>	strings;
+	int	depth;
+	uint32_t	temps;
+	//Every declared variable, with the type from its declaration
+	SymbolTable	vars;
+
+	void	Line(const string& text);
+	string	Var(uint32_t id) const;
+	string	Temp(Token type, const string& value);
+	string	Literal(uint32_t n, Token& type);
+	string	Expr(uint32_t n, Token& type);
+	void	Store(uint32_t id, const string& value, Token type);
+	void	Stmt(uint32_t n);
+
+public:
+	CTranslator(const Ast& ast) : ast(ast) {
+		ok = true;
+		depth = 1;
+		temps = 0;
+	}
+
+	bool	Program(ostream& out);
+};
+
+
+static const char* CType(Token type){
+	switch (type){
+		case INTEGER: return "int32_t";
+		case REAL: return "double";
+		case STRING: return "Str";
+		default: return "bool";
+	}
+}
+
+
+void CTranslator::Line(const string& text){
+	body.append(depth, '\t');
+	body += text;
+	body += '\n';
+}
+
+
+//A variable's C name: its id keeps it unique and the part of its name C allows keeps it readable
+string CTranslator::Var(uint32_t id) const {
+	string name = "v" + to_string(id) + "_";
+	for (char c : identifiers.GetName(id)){
+		if (isalnum((unsigned char)c) || c == '_'){
+			name += c;
+		}
+	}
+	return name;
+}
+
+
+//A new temporary of type holding value
+string CTranslator::Temp(Token type, const string& value){
+	string name = "t" + to_string(temps++);
+	Line(string("const ") + CType(type) + " " + name + " = " + value + ";");
+	return name;
+}
+
+
+//C for a constant node. Reals are written in hex so they come back bit for bit
+string CTranslator::Literal(uint32_t n, Token& type){
+	switch (ast.GetKind(n)){
+		case N_ICONST: {
+			type = INTEGER;
+			int32_t v = ast.GetInt(n);
+			return v == INT32_MIN ? "(-2147483647 - 1)" : v < 0 ? "(" + to_string(v) + ")" : to_string(v);
+		}
+		case N_RCONST: {
+			type = REAL;
+			double v = ast.GetReal(n);
+			if (isnan(v)){
+				return "NAN";
+			}
+			if (isinf(v)){
+				return v < 0 ? "(-INFINITY)" : "INFINITY";
+			}
+			char text[64];
+			snprintf(text, sizeof(text), "%a", v);
+			return v < 0 ? string("(") + text + ")" : string(text);
+		}
+		case N_BCONST:
+			type = BOOLEAN;
+			return ast.GetA(n) != 0 ? "true" : "false";
+		default: {
+			type = STRING;
+			uint32_t id = ast.GetA(n);
+			auto found = strings.find(id);
+			if (found != strings.end()){
+				return found->second;
+			}
+			//Anything that isn't plain printable text is escaped in octal, always three digits so a digit after it
+			//can't be taken as part of it. ? is escaped too, so nothing can make a trigraph
+			string_view text = lexemes.GetName(id);
+			string name = "k" + to_string(strings.size());
+			constants += "static const Str " + name + " = {\"";
+			for (unsigned char c : text){
+				if (c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?'){
+					constants += (char)c;
+				} else {
+					char escape[8];
+					snprintf(escape, sizeof(escape), "\\%03o", c);
+					constants += escape;
+				}
+			}
+			constants += "\", " + to_string(text.size()) + "};\n";
+			return strings[id] = name;
+		}
+	}
+}
+
+
+/**
+ * Translate an expression, returning the C operand holding its value(a variable, a constant or a temporary). Operands
+ * are done left to right before the operation, each into its own temporary, so errors happen in the VM's order
+*/
+string CTranslator::Expr(uint32_t n, Token& type){
+	string line = to_string(ast.GetLine(n));
+
+	switch (ast.GetKind(n)){
+		case N_VAR: {
+			uint32_t id = ast.GetA(n);
+			type = vars.Find(id)->type;
+			Line("if (!" + Var(id) + "_set) rt_fail(" + line + ", RT_UNINIT);");
+			return Var(id);
+		}
+		case N_UNARY: {
+			Token operand;
+			string a = Expr(ast.GetA(n), operand);
+			type = operand;
+			switch (UnaryOp(ast.GetOp(n), operand)){
+				case OP_NEG_I: return Temp(type, "rt_wrap(0u - (uint32_t)" + a + ")");
+				case OP_NEG_R: return Temp(type, "-" + a);
+				case OP_NOT: return Temp(type, "!" + a);
+				default:
+					ok = false;
+					return a;
+			}
+		}
+		case N_BINARY: {
+			Token lt, rt;
+			string a = Expr(ast.GetA(n), lt);
+			string b = Expr(ast.GetB(n), rt);
+			bool real;
+			Op op = BinaryOp(ast.GetOp(n), lt, rt, type, real);
+			if (real && lt == INTEGER){
+				a = "(double)" + a;
+			}
+			if (real && rt == INTEGER){
+				b = "(double)" + b;
+			}
+			switch (op){
+				case OP_ADD_I: return Temp(type, "rt_wrap((uint32_t)" + a + " + (uint32_t)" + b + ")");
+				case OP_SUB_I: return Temp(type, "rt_wrap((uint32_t)" + a + " - (uint32_t)" + b + ")");
+				case OP_MUL_I: return Temp(type, "rt_wrap((uint32_t)" + a + " * (uint32_t)" + b + ")");
+				case OP_ADD_R: return Temp(type, a + " + " + b);
+				case OP_SUB_R: return Temp(type, a + " - " + b);
+				case OP_MUL_R: return Temp(type, a + " * " + b);
+				case OP_DIV_R:
+					Line("if (" + b + " == 0) rt_fail(" + line + ", RT_DIVIDE);");
+					return Temp(type, a + " / " + b);
+				//Dividing the smallest integer by -1 wraps like everything else
+				case OP_IDIV:
+					Line("if (" + b + " == 0) rt_fail(" + line + ", RT_DIVIDE);");
+					return Temp(type, b + " == -1 ? rt_wrap(0u - (uint32_t)" + a + ") : " + a + " / " + b);
+				case OP_MOD:
+					Line("if (" + b + " == 0) rt_fail(" + line + ", RT_DIVIDE);");
+					return Temp(type, b + " == -1 ? 0 : " + a + " % " + b);
+				case OP_CONCAT: return Temp(type, "rt_concat(" + a + ", " + b + ")");
+				case OP_AND: return Temp(type, a + " && " + b);
+				case OP_OR: return Temp(type, a + " || " + b);
+				case OP_EQ_I: case OP_EQ_R: case OP_EQ_B: return Temp(type, a + " == " + b);
+				case OP_LT_I: case OP_LT_R: return Temp(type, a + " < " + b);
+				case OP_GT_I: case OP_GT_R: return Temp(type, a + " > " + b);
+				case OP_EQ_S: return Temp(type, "rt_compare(" + a + ", " + b + ") == 0");
+				case OP_LT_S: return Temp(type, "rt_compare(" + a + ", " + b + ") < 0");
+				case OP_GT_S: return Temp(type, "rt_compare(" + a + ", " + b + ") > 0");
+				default:
+					ok = false;
+					return a;
+			}
+		}
+		default:
+			return Literal(n, type);
+	}
+}
+
+
+//Assign value, of type, to the variable with identifier id
+void CTranslator::Store(uint32_t id, const string& value, Token type){
+	Token want = vars.Find(id)->type;
+	if (type == INTEGER && want == REAL){
+		Line(Var(id) + " = (double)" + value + ";");
+	} else if (type == want){
+		Line(Var(id) + " = " + value + ";");
+	} else {
+		ok = false;
+		return;
+	}
+	Line(Var(id) + "_set = true;");
+}
+
+
+void CTranslator::Stmt(uint32_t n){
+	switch (ast.GetKind(n)){
+		case N_BLOCK:
+			for (uint32_t i = 0; i < ast.GetB(n); i++){
+				Stmt(ast.GetListItem(ast.GetA(n) + i));
+			}
+			break;
+		case N_ASSIGN: {
+			Token type;
+			string value = Expr(ast.GetB(n), type);
+			Store(ast.GetA(ast.GetA(n)), value, type);
+			break;
+		}
+		case N_WRITE:
+		case N_WRITELN:
+			for (uint32_t i = 0; i < ast.GetB(n); i++){
+				Token type;
+				string value = Expr(ast.GetListItem(ast.GetA(n) + i), type);
+				const char* write = type == INTEGER ? "rt_write_i" : type == REAL ? "rt_write_r" : type == STRING ? "rt_write_s"
+					: "rt_write_b";
+				Line(string(write) + "(" + value + ");");
+			}
+			if (ast.GetKind(n) == N_WRITELN){
+				Line("putchar('\\n');");
+			}
+			break;
+		case N_IF:
+		case N_IF_ELSE: {
+			bool both = ast.GetKind(n) == N_IF_ELSE;
+			Token type;
+			string cond = Expr(ast.GetA(n), type);
+			ok = ok && type == BOOLEAN;
+			Line("if (" + cond + ") {");
+			depth++;
+			Stmt(both ? ast.GetListItem(ast.GetB(n)) : ast.GetB(n));
+			depth--;
+			if (both){
+				Line("} else {");
+				depth++;
+				Stmt(ast.GetListItem(ast.GetB(n) + 1));
+				depth--;
+			}
+			Line("}");
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+
+bool CTranslator::Program(ostream& out){
+	uint32_t root = ast.Root();
+	uint32_t start = ast.GetA(root);
+	uint32_t decls = ast.GetB(root);
+
+	//Every variable, unassigned, then the initializers in order
+	for (uint32_t d = 0; d < decls; d++){
+		uint32_t decl = ast.GetListItem(start + d);
+		for (uint32_t i = 0; i < ast.GetB(decl); i++){
+			uint32_t id = ast.GetListItem(ast.GetA(decl) + i);
+			Token type = vars.Declare(id, ast.GetLine(decl))->type = ast.GetOp(decl);
+			const char* zero = type == INTEGER ? "0" : type == REAL ? "0.0" : type == STRING ? "{\"\", 0}" : "false";
+			Line(string(CType(type)) + " " + Var(id) + " = " + zero + ";");
+			Line("bool " + Var(id) + "_set = false;");
+		}
+	}
+	for (uint32_t d = 0; d < decls; d++){
+		uint32_t decl = ast.GetListItem(start + d);
+		if (ast.GetKind(decl) != N_DECL_INIT){
+			continue;
+		}
+		Token type;
+		string value = Expr(ast.GetListItem(ast.GetA(decl) + ast.GetB(decl)), type);
+		for (uint32_t i = 0; i < ast.GetB(decl); i++){
+			Store(ast.GetListItem(ast.GetA(decl) + i), value, type);
+		}
+	}
+
+	Stmt(ast.GetListItem(start + decls));
+	if (!ok){
+		return false;
+	}
+
+	out << runtime << endl << constants << (constants.empty() ? "" : "\n");
+	out << "int main(void){" << endl;
+	out << "\tstatic char buffer[1 << 16];" << endl;
+	out << "\tsetvbuf(stdout, buffer, _IOFBF, sizeof(buffer));" << endl;
+	out << body;
+	out << "\tfputs(\"\\n(DONE)\\n\", stdout);" << endl;
+	out << "\treturn 0;" << endl;
+	out << "}" << endl;
+	return true;
+}
+
+}
+
+
+bool TranslateC(const Ast& ast, ostream& out){
+	if (ast.Root() == Ast::NONE){
+		return false;
+	}
+	CTranslator translator(ast);
+	return translator.Program(out);
+}
+
+
+/**
+ * The source goes to a file next to the executable, exe.c, which is removed again once the compiler is done with it.
+ * The compiler is run directly rather than through a shell, so no name needs quoting
+*/
+bool BuildNative(const string& source, const string& exe, string& error){
+	const char* cc = getenv("CC");
+	if (cc == nullptr || *cc == 0){
+		cc = "cc";
+	}
+	string file = exe + ".c";
+	{
+		ofstream out(file, ios::binary);
+		out << source;
+		if (!out.flush()){
+			error = "CANNOT WRITE " + file;
+			return false;
+		}
+	}
+
+	pid_t child = fork();
+	if (child == 0){
+		execlp(cc, cc, "-O2", "-o", exe.c_str(), file.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+	int status = 0;
+	bool built = child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	if (child < 0){
+		error = string("CANNOT RUN ") + cc + ": " + strerror(errno);
+	} else if (!built){
+		error = WIFEXITED(status) && WEXITSTATUS(status) == 127 ? string("CANNOT RUN ") + cc : string(cc) + " FAILED ON " + file;
+	}
+	if (built){
+		remove(file.c_str());
+	}
+	return built;
+}
@@ -0,0 +1,33 @@
+/*
+ * cgen.h
+ *
+ * Ahead of time translation to C. A program that compiles(bytecode.h) is turned into one self
+ * contained C translation unit that needs nothing but the C library: every variable becomes a C
+ * variable of the type it was declared with, and every expression is broken
+ * into one C statement per operation, in the order the VM would do them, so a run time error is
+ * the first one the VM would hit. The C program prints exactly what prog2 --run prints, the
+ * (DONE) or error report included. Checks for unassigned variables are emitted on every read, and
+ * left to the C compiler to prove away.
+ *
+ * BuildNative hands the translation to the system C compiler($CC, or cc) to get an executable.
+*/
+
+#ifndef CGEN_H_
+#define CGEN_H_
+
+#include <string>
+#include <iostream>
+
+using namespace std;
+
+class Ast;
+
+
+//Write the C for a program Compile accepted. Returns false if it doesn't type check after all
+extern bool TranslateC(const Ast& ast, ostream& out);
+
+//Compile C source text to the executable exe. On failure error says why, and the compiler's own messages go to stderr
+extern bool BuildNative(const string& source, const string& exe, string& error);
+
+
+#endif /* CGEN_H_ */
@@ -0,0 +1,199 @@
+/**
+ * IncrementalLexer implementation. Every token starts with the lexer in its START state, and a token only depends on
+ * the bytes from its first character up to the one the lexer stopped on. So after an edit we can restart right after
+ * the last token that ends before the edit, and once the new lexer produces a token that starts at the same(shifted)
+ * position as an old token past the edit, the rest of the two streams are the same, only moved
+*/
+
+#include "incremental.h"
+#include <algorithm>
+
+
+IncrementalLexer::Record IncrementalLexer::MakeRecord(const LexView& tok, uint64_t base, uint64_t end, int line){
+	Record r;
+	//The lexeme of a string constant leaves off the opening quote, but the token starts on it
+	r.start = (int64_t)(base + tok.GetOffset()) - (tok == SCONST ? 1 : 0);
+	r.length = (uint32_t)tok.GetLength();
+	r.span = (uint32_t)(end - r.start);
+	r.line = line;
+	r.kind = (uint8_t)tok.GetToken();
+	return r;
+}
+
+
+int64_t IncrementalLexer::StartOf(size_t i) const {
+	return i < tokens.GapPos() ? tokens[i].start : tokens[i].start + (int64_t)text.Size();
+}
+
+
+int IncrementalLexer::LineOf(size_t i) const {
+	return i < tokens.GapPos() ? tokens[i].line : tokens[i].line + lastLine;
+}
+
+
+uint64_t IncrementalLexer::GetOffset(size_t i) const {
+	return StartOf(i) + (tokens[i].kind == SCONST ? 1 : 0);
+}
+
+
+string IncrementalLexer::GetLexeme(size_t i) const {
+	string lexeme(tokens[i].length, '\0');
+	uint64_t from = GetOffset(i);
+	text.CopyOut(from, from + lexeme.size(), &lexeme[0]);
+	return lexeme;
+}
+
+
+string IncrementalLexer::GetText() const {
+	string all(text.Size(), '\0');
+	text.CopyOut(0, all.size(), &all[0]);
+	return all;
+}
+
+
+/**
+ * Take a copy of the text and lex all of it. This is the only time the whole file gets lexed
+*/
+void IncrementalLexer::Load(const char* buf, uint64_t size, int line){
+	text.Clear();
+	text.Insert(buf, size);
+	tokens.Clear();
+	firstLine = line;
+
+	vector<Record> all;
+	LexCursor cursor(buf, size);
+	LexView tok;
+	do {
+		tok = getNextToken(cursor, line);
+		all.push_back(MakeRecord(tok, 0, cursor.pos, line));
+	} while (tok != DONE);
+
+	tokens.Insert(all.data(), all.size());
+	lastLine = line;
+
+	//Growing a gap buffer copies all of it, so pay for that now instead of in the middle of someone's typing
+	text.Reserve(size / 8 + 4096);
+	tokens.Reserve(all.size() / 8 + 1024);
+}
+
+
+/**
+ * Replace removed bytes at offset with inserted, and bring the token stream up to date. Returns false, and changes
+ * nothing, if the edit doesn't fit inside the text
+*/
+bool IncrementalLexer::Edit(uint64_t offset, uint64_t removed, string_view inserted, RelexResult& result){
+	const uint64_t oldSize = text.Size();
+	if (offset > oldSize || removed > oldSize - offset){
+		return false;
+	}
+
+	//Find the first token that the edit could have changed. The lexer looked at every byte of a token up to and
+	//including the one at start + span(a token that backs up has read one byte past itself), so a token is safe
+	//only if that is before offset. DONE always ends at the end of the text, so it is never safe
+	size_t lo = 0;
+	size_t hi = tokens.Size() - 1;
+	while (lo < hi){
+		size_t mid = (lo + hi) / 2;
+		if (StartOf(mid) + tokens[mid].span < (int64_t)offset){
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	const size_t keep = lo;
+
+	//Restart right after the last safe token, in the START state
+	uint64_t restart = keep > 0 ? StartOf(keep - 1) + tokens[keep - 1].span : 0;
+	int restartLine = keep > 0 ? LineOf(keep - 1) : firstLine;
+
+	//Put every token from keep on after the gap, so they are relative to the end of the(old) text
+	tokens.MoveGap(keep, [&](Record& r, bool toAfterGap){
+		if (toAfterGap){
+			r.start -= (int64_t)oldSize;
+			r.line -= lastLine;
+		} else {
+			r.start += (int64_t)oldSize;
+			r.line += lastLine;
+		}
+	});
+
+	//Now change the text
+	text.MoveGap(offset);
+	text.Erase(removed);
+	text.Insert(inserted.data(), inserted.size());
+	const uint64_t newSize = text.Size();
+
+	//Lex a copy of the text from restart on. We don't know how far we'll need to go, so start with a window a
+	//little bigger than the edit and double it whenever the lexer runs off the end of it before matching back up
+	vector<char> scratch;
+	vector<Record> fresh;
+	uint64_t window = max<uint64_t>(4096, 2 * (offset + inserted.size() - restart));
+	size_t match = 0;
+	int lineShift = 0;
+	uint64_t lexed = 0;
+
+	while (true){
+		uint64_t end = min(newSize, restart + window);
+		bool toEnd = end == newSize;
+		scratch.resize(end - restart);
+		text.CopyOut(restart, end, scratch.data());
+
+		LexCursor cursor(scratch.data(), scratch.size());
+		int line = restartLine;
+		bool ranOut = false;
+		fresh.clear();
+		match = keep;
+
+		while (true){
+			LexView tok = getNextToken(cursor, line);
+			//A token that stops at the end of the window might really keep going
+			if (!toEnd && cursor.pos == scratch.size()){
+				ranOut = true;
+				break;
+			}
+			Record r = MakeRecord(tok, restart, restart + cursor.pos, line);
+
+			//Skip old tokens that started inside the removed bytes, or before this token. Old starts are relative
+			//to the old end, so the same token in the new text would start at old start + newSize
+			while (match < tokens.Size()){
+				int64_t oldStart = tokens[match].start + (int64_t)oldSize;
+				if (oldStart < (int64_t)(offset + removed) || tokens[match].start + (int64_t)newSize < r.start){
+					match++;
+				} else {
+					break;
+				}
+			}
+
+			//Same start in unchanged text, so from here on the streams are the same
+			if (match < tokens.Size() && tokens[match].start + (int64_t)newSize == r.start && tokens[match].kind == r.kind){
+				lineShift = line - (tokens[match].line + lastLine);
+				break;
+			}
+
+			fresh.push_back(r);
+			//DONE always matches the old DONE, so this is only a safety net: replace everything to the end
+			if (tok == DONE){
+				match = tokens.Size();
+				lineShift = line - lastLine;
+				break;
+			}
+		}
+
+		lexed = cursor.pos;
+		if (!ranOut){
+			break;
+		}
+		window *= 2;
+	}
+
+	//Swap the changed tokens for the new ones. The tokens after them keep their relative positions
+	tokens.Erase(match - keep);
+	tokens.Insert(fresh.data(), fresh.size());
+	lastLine += lineShift;
+
+	result.first = keep;
+	result.removed = match - keep;
+	result.inserted = fresh.size();
+	result.relexedBytes = lexed;
+	return true;
+}
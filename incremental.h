@@ -0,0 +1,165 @@
+/*
+ * incremental.h
+ *
+ * Incremental relexing for editors. An IncrementalLexer keeps the source text and its token stream,
+ * and on every edit(offset, bytes removed, text inserted) it relexes only from the last token the
+ * edit can't have changed until the new tokens line up with the old ones again. A ' string or a
+ * { } comment opened or closed by the edit is handled the same way, the relexing just runs further.
+ *
+ * Both the text and the tokens are kept in gap buffers with the gap at the last edit. Tokens after
+ * the gap store their offset and line relative to the end of the file, so an edit never has to touch
+ * the tokens past the point where the streams match again, and the cost of an edit depends on how
+ * much it changed rather than on the size of the file.
+*/
+
+#ifndef INCREMENTAL_H_
+#define INCREMENTAL_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+
+//A vector with a movable hole in it, so inserting and erasing at the hole is cheap
+template <class T>
+class GapBuffer {
+	vector<T>	buf;
+	size_t	gapStart;
+	size_t	gapEnd;
+
+	//Make room for at least n more elements in the gap
+	void Grow(size_t n) {
+		size_t tail = buf.size() - gapEnd;
+		size_t capacity = max(buf.size() * 2, buf.size() + n + 64);
+		vector<T> bigger(capacity);
+		copy(buf.begin(), buf.begin() + gapStart, bigger.begin());
+		copy(buf.begin() + gapEnd, buf.end(), bigger.end() - tail);
+		gapEnd = capacity - tail;
+		buf.swap(bigger);
+	}
+
+public:
+	GapBuffer() {
+		gapStart = 0;
+		gapEnd = 0;
+	}
+
+	size_t	Size() const { return buf.size() - (gapEnd - gapStart); }
+	size_t	GapPos() const { return gapStart; }
+	const T&	operator[](size_t i) const { return i < gapStart ? buf[i] : buf[i + (gapEnd - gapStart)]; }
+
+	//Move the gap so it sits right before element pos. moved(element, toAfterGap) is called on every element
+	//that changes sides
+	template <class F>
+	void MoveGap(size_t pos, F moved) {
+		while (gapStart > pos) {
+			buf[--gapEnd] = buf[--gapStart];
+			moved(buf[gapEnd], true);
+		}
+		while (gapStart < pos) {
+			buf[gapStart] = buf[gapEnd++];
+			moved(buf[gapStart++], false);
+		}
+	}
+	void MoveGap(size_t pos) { MoveGap(pos, [](T&, bool) {}); }
+
+	//Make sure the gap can take n more elements without growing
+	void Reserve(size_t n) {
+		if (gapEnd - gapStart < n) {
+			Grow(n);
+		}
+	}
+
+	//Erase the n elements right after the gap
+	void	Erase(size_t n) { gapEnd += n; }
+
+	//Insert right before the gap
+	void Insert(const T* items, size_t n) {
+		Reserve(n);
+		copy(items, items + n, buf.begin() + gapStart);
+		gapStart += n;
+	}
+
+	//Copy elements [from, to) out into contiguous memory
+	void CopyOut(size_t from, size_t to, T* out) const {
+		for (size_t i = from; i < to && i < gapStart; i++) {
+			*out++ = buf[i];
+		}
+		for (size_t i = max(from, gapStart); i < to; i++) {
+			*out++ = buf[i + (gapEnd - gapStart)];
+		}
+	}
+
+	void Clear() {
+		buf.clear();
+		gapStart = 0;
+		gapEnd = 0;
+	}
+};
+
+
+//What one edit changed in the token stream: tokens [first, first + removed) were replaced by
+//tokens [first, first + inserted). Everything after that only moved
+struct RelexResult {
+	size_t	first;
+	size_t	removed;
+	size_t	inserted;
+	//Bytes the lexer actually looked at
+	uint64_t	relexedBytes;
+};
+
+
+//Class definition of IncrementalLexer
+class IncrementalLexer {
+	//One token. Before the gap, start and line are absolute. After it, start is relative to the end of the
+	//text and line is relative to the line of the final DONE token, so edits before them don't move them
+	struct Record {
+		int64_t	start;
+		uint32_t	length;
+		//How far the lexer moved for this token, counting the quotes of a string and the newline that
+		//ends a bad string
+		uint32_t	span;
+		int	line;
+		uint8_t	kind;
+	};
+
+	GapBuffer<char>	text;
+	GapBuffer<Record>	tokens;
+	int	firstLine;
+	int	lastLine;
+
+	//Absolute position and line of token i, wherever it is
+	int64_t	StartOf(size_t i) const;
+	int	LineOf(size_t i) const;
+
+	static Record	MakeRecord(const LexView& tok, uint64_t base, uint64_t end, int line);
+
+public:
+	IncrementalLexer() {
+		firstLine = 1;
+		lastLine = 1;
+	}
+
+	void	Load(const char* buf, uint64_t size, int line = 1);
+	bool	Edit(uint64_t offset, uint64_t removed, string_view inserted, RelexResult& result);
+
+	//Always at least one token, the last one is DONE
+	size_t	Size() const { return tokens.Size(); }
+	uint64_t	GetTextSize() const { return text.Size(); }
+	string	GetText() const;
+
+	Token	GetToken(size_t i) const { return (Token)tokens[i].kind; }
+	uint64_t	GetOffset(size_t i) const;
+	uint64_t	GetLength(size_t i) const { return tokens[i].length; }
+	int	GetLinenum(size_t i) const { return LineOf(i); }
+	string	GetLexeme(size_t i) const;
+};
+
+
+#endif /* INCREMENTAL_H_ */
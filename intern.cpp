@@ -0,0 +1,76 @@
+/**
+ * Interner implementation. Lookups hash the name (FNV-1a), then probe linearly through the slot table comparing
+ * the saved hash first and the bytes only when the hashes match. The table is kept at most half full
+*/
+
+#include "intern.h"
+
+
+thread_local Interner identifiers;
+thread_local Interner lexemes;
+
+
+static inline uint32_t hashName(string_view name){
+	uint32_t h = 2166136261u;
+	for (char c : name){
+		h = (h ^ (unsigned char)c) * 16777619u;
+	}
+	return h;
+}
+
+
+/**
+ * Get the id for a name, giving it the next id if we have never seen it before
+*/
+uint32_t Interner::Intern(string_view name){
+	uint32_t h = hashName(name);
+	size_t mask = slots.size() - 1;
+
+	for (size_t i = h & mask; ; i = (i + 1) & mask){
+		uint32_t slot = slots[i];
+
+		//Empty slot, the name is new
+		if (slot == 0){
+			uint32_t id = Size();
+			offsets.push_back(arena.size());
+			lengths.push_back((uint32_t)name.size());
+			hashes.push_back(h);
+			arena.append(name);
+			slots[i] = id + 1;
+
+			if (2 * (size_t)Size() > slots.size()){
+				Grow();
+			}
+			return id;
+		}
+
+		if (hashes[slot - 1] == h && GetName(slot - 1) == name){
+			return slot - 1;
+		}
+	}
+}
+
+
+//Double the slot table and put every id back in. The saved hashes mean no name gets hashed twice
+void Interner::Grow(){
+	slots.assign(slots.size() * 2, 0);
+	size_t mask = slots.size() - 1;
+
+	for (uint32_t id = 0; id < Size(); id++){
+		size_t i = hashes[id] & mask;
+		while (slots[i] != 0){
+			i = (i + 1) & mask;
+		}
+		slots[i] = id + 1;
+	}
+}
+
+
+//Forget every name, ids start over from 0
+void Interner::Clear(){
+	arena.clear();
+	offsets.clear();
+	lengths.clear();
+	hashes.clear();
+	slots.assign(256, 0);
+}
@@ -0,0 +1,57 @@
+/*
+ * intern.h
+ *
+ * Identifier interning. Every distinct identifier name is given a dense 32-bit id the first time
+ * it is seen, so everything after the lexer can index arrays by id instead of looking names up
+ * in string keyed maps over and over. Names are case sensitive, like variables are.
+*/
+
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+
+//Class definition of Interner
+class Interner {
+	//Every name back to back, found by offset and length
+	string	arena;
+	vector<uint64_t>	offsets;
+	vector<uint32_t>	lengths;
+	vector<uint32_t>	hashes;
+
+	//Open addressing table, each slot holds id + 1, or 0 if empty. Always a power of two in size
+	vector<uint32_t>	slots;
+
+	void	Grow();
+
+public:
+	//Id of a token that isn't an identifier
+	static const uint32_t NO_ID = UINT32_MAX;
+
+	Interner() {
+		slots.assign(256, 0);
+	}
+
+	uint32_t	Intern(string_view name);
+	void	Clear();
+
+	uint32_t	Size() const { return (uint32_t)offsets.size(); }
+	string_view	GetName(uint32_t id) const { return string_view(arena.data() + offsets[id], lengths[id]); }
+};
+
+
+//The identifiers the parser has seen. Every token stream that feeds the parser interns into this one. Each
+//thread has its own, so threads can lex at the same time
+extern thread_local Interner identifiers;
+//The lexemes of every other token that carries one: keywords, constants and errors. Only ever used to
+//get the text of a LexItem back. One per thread as well
+extern thread_local Interner lexemes;
+
+
+#endif /* INTERN_H_ */
@@ -0,0 +1,113 @@
+/*
+ * keywords.h
+ *
+ * Compile time perfect hash over the reserved words. Every keyword differs from every other one
+ * in its (first letter, last letter, length), so those three are packed into one key and a
+ * multiplicative hash picks a table slot. The multiplier is searched for by the compiler so that
+ * no two keywords share a slot; a lookup is then one multiply, one shift, and at most one
+ * case-insensitive compare, with no allocation.
+*/
+
+#ifndef KEYWORDS_H_
+#define KEYWORDS_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#include "lex.h"
+
+
+namespace Keywords {
+	struct Keyword {
+		const char*	word;
+		uint8_t	len;
+		Token	token;
+	};
+
+	//TRUE and FALSE are both boolean constants, and DIV is integer division
+	constexpr Keyword words[] = {
+		{"IF", 2, IF}, {"ELSE", 4, ELSE}, {"THEN", 4, THEN}, {"WRITELN", 7, WRITELN},
+		{"WRITE", 5, WRITE}, {"INTEGER", 7, INTEGER}, {"REAL", 4, REAL}, {"BOOLEAN", 7, BOOLEAN},
+		{"STRING", 6, STRING}, {"BEGIN", 5, BEGIN}, {"END", 3, END}, {"VAR", 3, VAR},
+		{"PROGRAM", 7, PROGRAM}, {"DIV", 3, IDIV}, {"MOD", 3, MOD}, {"AND", 3, AND},
+		{"OR", 2, OR}, {"NOT", 3, NOT}, {"TRUE", 4, BCONST}, {"FALSE", 5, BCONST},
+	};
+	constexpr size_t count = sizeof(words) / sizeof(words[0]);
+
+	constexpr size_t minLen = 2;
+	constexpr size_t maxLen = 7;
+
+	//Table size is a power of two, so the hash is the top bits of the product
+	constexpr int slotBits = 6;
+	constexpr size_t slots = size_t(1) << slotBits;
+
+	//Uppercase a letter, leave everything else alone
+	constexpr unsigned char fold(char c) {
+		return (c >= 'a' && c <= 'z') ? (unsigned char)(c - 'a' + 'A') : (unsigned char)c;
+	}
+
+	constexpr uint32_t slot(const char* s, size_t len, uint32_t mult) {
+		uint32_t key = fold(s[0]) | (uint32_t)fold(s[len - 1]) << 8 | (uint32_t)len << 16;
+		return (uint32_t)(key * mult) >> (32 - slotBits);
+	}
+
+	//First odd multiplier at or after the golden ratio constant that puts every keyword in its own slot
+	constexpr uint32_t findMultiplier() {
+		for (uint32_t mult = 0x9E3779B1u; ; mult += 2) {
+			bool used[slots] = {};
+			bool ok = true;
+			for (size_t i = 0; i < count && ok; i++) {
+				uint32_t h = slot(words[i].word, words[i].len, mult);
+				ok = !used[h];
+				used[h] = true;
+			}
+			if (ok) {
+				return mult;
+			}
+		}
+	}
+	constexpr uint32_t multiplier = findMultiplier();
+
+	//Slot table, holds the index into words + 1, or 0 for an empty slot
+	struct Table {
+		uint8_t entry[slots];
+	};
+	constexpr Table buildTable() {
+		Table t = {};
+		for (size_t i = 0; i < count; i++) {
+			t.entry[slot(words[i].word, words[i].len, multiplier)] = (uint8_t)(i + 1);
+		}
+		return t;
+	}
+	constexpr Table table = buildTable();
+
+	/**
+	 * Find the token for an identifier-shaped lexeme: the keyword token if it is a reserved word
+	 * (in any case), IDENT otherwise
+	*/
+	constexpr Token Lookup(const char* s, size_t len) {
+		if (len < minLen || len > maxLen) {
+			return IDENT;
+		}
+
+		uint8_t e = table.entry[slot(s, len, multiplier)];
+		if (e == 0 || words[e - 1].len != len) {
+			return IDENT;
+		}
+
+		const char* w = words[e - 1].word;
+		for (size_t i = 0; i < len; i++) {
+			if (fold(s[i]) != (unsigned char)w[i]) {
+				return IDENT;
+			}
+		}
+		return words[e - 1].token;
+	}
+
+	static_assert(Lookup("program", 7) == PROGRAM && Lookup("Div", 3) == IDIV && Lookup("true", 4) == BCONST
+		&& Lookup("FALSE", 5) == BCONST && Lookup("writelnx", 8) == IDENT && Lookup("els", 3) == IDENT,
+		"keyword hash is broken");
+}
+
+
+#endif /* KEYWORDS_H_ */
@@ -5,97 +5,180 @@
 */
 
 #include "lex.h"
-#include <map>
-#include <algorithm>
+#include "scan.h"
+#include "keywords.h"
+#include "intern.h"
+#include <vector>
+#include <charconv>
 
 using namespace std;
 
-// we will need a map of all possible token types
-static map<Token, string> tokenMap = {
-    //identifiers
-    {IDENT, "IDENT"},
-
-    // Booleans
-    {TRUE, "TRUE"},
-    {FALSE, "FALSE"},
-
-    //keywords - these will also need their own map for id_or_kw
-    {IF, "IF"}, 
-    {ELSE, "ELSE"},
-    {THEN, "THEN"},
-    {WRITELN, "WRITELN"},
-    {WRITE, "WRITE"},
-    {INTEGER, "INTEGER"},
-    {REAL, "REAL"},
-	{BOOLEAN, "BOOLEAN"},
-    {STRING, "STRING"},
-    {BEGIN, "BEGIN"},
-    {END, "END"},
-    {VAR, "VAR"},
-    {THEN, "THEN"},
-    {PROGRAM, "PROGRAM"},
-
-
-    //int, real or string const
-    {ICONST, "ICONST"},
-    {RCONST, "RCONST"},
-    {SCONST, "SCONST"},
-    {BCONST, "BCONST"},
-
-    //operators
-    {PLUS, "PLUS"},
-    {MINUS, "MINUS"},
-    {MULT, "MULT"},
-    {DIV, "DIV"},
-    {IDIV, "IDIV"},
-    {MOD, "MOD"},
-    {ASSOP, "ASSOP"},
-    {EQ, "EQ"},
-    {GTHAN, "GTHAN"},
-    {LTHAN, "LTHAN"},
-    {AND, "AND"},
-    {OR, "OR"},
-    {NOT, "NOT"},
-
-    //Delimiters
-    {COMMA, "COMMA"},
-    {SEMICOL, "SEMICOL"},
-    {LPAREN, "LPAREN"},
-    {RPAREN, "RPAREN"},
-    {DOT, "DOT"},
-    {COLON, "COLON"},
-
-    //these will make the program terminate
-    {ERR, "ERR"},
-    {DONE, "DONE"}
-}; 
-
-
-//Additionally, we need a separate map of all keywords for id_or_kw
-// This map has the keys and values reversed, so that we can search for tokens by lexeme
-static map<string, Token> keywordMap = {
-    {"IF", IF}, 
-    {"ELSE", ELSE},
-    {"THEN", THEN},
-    {"WRITELN", WRITELN},
-    {"WRITE", WRITE},
-    {"INTEGER", INTEGER},
-    {"REAL", REAL},
-	{"BOOLEAN", BOOLEAN},
-    {"STRING", STRING},
-    {"BEGIN", BEGIN},
-    {"END", END},
-    {"VAR", VAR},
-    {"THEN", THEN},
-    {"PROGRAM", PROGRAM},
-    {"DIV", IDIV},
-    {"MOD", MOD},
-    {"AND", AND},
-    {"OR", OR},
-    {"NOT", NOT},
-    {"TRUE", BCONST},
-    {"FALSE", BCONST}
+//The only lexeme a token can have, for the tokens that can only have one. nullptr means it has to be interned
+struct FixedLexemeTable {
+    const char* text[DONE + 1];
 };
+static constexpr FixedLexemeTable buildFixedLexemes(){
+    FixedLexemeTable t = {};
+    t.text[PLUS] = "+";
+    t.text[MINUS] = "-";
+    t.text[MULT] = "*";
+    t.text[DIV] = "/";
+    t.text[ASSOP] = ":=";
+    t.text[EQ] = "=";
+    t.text[GTHAN] = ">";
+    t.text[LTHAN] = "<";
+    t.text[COMMA] = ",";
+    t.text[SEMICOL] = ";";
+    t.text[LPAREN] = "(";
+    t.text[RPAREN] = ")";
+    t.text[DOT] = ".";
+    t.text[COLON] = ":";
+    t.text[DONE] = "";
+    return t;
+}
+static constexpr FixedLexemeTable fixedLexeme = buildFixedLexemes();
+
+
+/*
+* Integer constants are ints, real constants are doubles. Short constants, which is nearly all of them, are decoded by
+* hand: up to 9 digits always fit in an int, and a real with at most 15 significant digits is an exact integer divided
+* by an exact power of ten, so one division gives the correctly rounded double(Clinger's fast path). Anything longer
+* goes to from_chars, which only takes exactly the digits we give it, so being out of range is the only way either of
+* these can fail
+*/
+bool DecodeInt(string_view text, int& value){
+    if (text.size() <= 9){
+        int v = 0;
+        for (char c : text){
+            v = v * 10 + (c - '0');
+        }
+        value = v;
+        return true;
+    }
+    from_chars_result r = from_chars(text.data(), text.data() + text.size(), value);
+    return r.ec == errc() && r.ptr == text.data() + text.size();
+}
+
+bool DecodeReal(string_view text, double& value){
+    static constexpr double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+    if (text.size() <= 16){
+        uint64_t digits = 0;
+        size_t dot = text.size();
+        for (size_t i = 0; i < text.size(); i++){
+            if (text[i] == '.'){
+                dot = i;
+            } else {
+                digits = digits * 10 + (text[i] - '0');
+            }
+        }
+        size_t fraction = dot < text.size() ? text.size() - dot - 1 : 0;
+        //16 characters with the dot is at most 15 digits
+        if (dot < text.size() || text.size() <= 15){
+            value = (double)digits / pow10[fraction];
+            return true;
+        }
+    }
+    from_chars_result r = from_chars(text.data(), text.data() + text.size(), value, chars_format::fixed);
+    return r.ec == errc() && r.ptr == text.data() + text.size();
+}
+
+
+/*
+* The message for an ERR token. The lexer only hands back a well formed number as ERR when its value is out of range
+*/
+string_view ErrMessage(string_view lexeme){
+    size_t dots = 0;
+    for (char c : lexeme){
+        if (c == '.'){
+            dots++;
+        } else if (c < '0' || c > '9'){
+            return "Unrecognized Lexeme";
+        }
+    }
+    if (lexeme.empty() || lexeme[0] == '.' || dots > 1){
+        return "Unrecognized Lexeme";
+    }
+    return dots == 0 ? "Integer constant out of range" : "Real constant out of range";
+}
+
+
+//Decoded value of every ICONST and RCONST lexeme, indexed by its id in lexemes(so one table per thread, like lexemes),
+//so each distinct constant is only decoded the first time it is seen
+namespace {
+    enum LiteralState : uint8_t { LIT_UNKNOWN, LIT_OK, LIT_RANGE };
+    struct Literal {
+        union {
+            int ival;
+            double rval;
+        };
+        LiteralState state;
+    };
+}
+static thread_local vector<Literal> literalValues;
+
+//Decode lexeme id as a token of kind t, if it hasn't been already. Returns false if it is out of range
+static bool decodeLiteral(Token t, uint32_t id, string_view lexeme){
+    if (id >= literalValues.size()){
+        literalValues.resize(max<size_t>(id + 1, 2 * literalValues.size()), Literal{{0}, LIT_UNKNOWN});
+    }
+    Literal& lit = literalValues[id];
+    if (lit.state == LIT_UNKNOWN){
+        bool ok = t == ICONST ? DecodeInt(lexeme, lit.ival) : DecodeReal(lexeme, lit.rval);
+        lit.state = ok ? LIT_OK : LIT_RANGE;
+    }
+    return lit.state == LIT_OK;
+}
+
+int LexItem::GetIntValue() const {
+    return literalValues[id].ival;
+}
+
+double LexItem::GetRealValue() const {
+    return literalValues[id].rval;
+}
+
+void ClearInterned(){
+    identifiers.Clear();
+    lexemes.Clear();
+    literalValues.clear();
+}
+
+
+/*
+* Identifiers go into identifiers, so the parser can index its symbol tables by id. Keywords, constants and errors
+* go into lexemes. Either way repeats cost a hash lookup and no allocation
+*/
+LexItem::LexItem(Token token, string_view lexeme, int line){
+    this->token = token;
+    this->lnum = line;
+    if (token == IDENT){
+        id = identifiers.Intern(lexeme);
+    } else if (fixedLexeme.text[token] != nullptr){
+        id = UINT32_MAX;
+    } else {
+        id = lexemes.Intern(lexeme);
+    }
+    //This is where the istream lexer's constants get their values. One that is out of range is an error
+    if ((token == ICONST || token == RCONST) && !decodeLiteral(token, id, lexeme)){
+        this->token = ERR;
+    }
+}
+
+
+string_view LexItem::GetLexeme() const {
+    if (token == IDENT){
+        return identifiers.GetName(id);
+    }
+    if (fixedLexeme.text[token] != nullptr){
+        return fixedLexeme.text[token];
+    }
+    //A default constructed LexItem has no lexeme at all
+    if (id == UINT32_MAX){
+        return string_view();
+    }
+    return lexemes.GetName(id);
+}
+
 
 /*
 Break -> break out of the case statement/loop completely
@@ -318,27 +401,317 @@ LexItem getNextToken(istream& in, int& linenumber){
 
 
 
+//Scanning kernels for the buffer lexer, picked once for this CPU
+static const ScanKernels& scan = GetScanKernels();
+
+
 /*
-* The lexItem function takes in a reference to a string and a linenumber, and checks if given lexeme is in the keywordMap
-* @returns: a lexItem with either an IDENT token or the keyword token, if one was found
+* The buffer lexer is a table driven DFA. Every byte is first mapped to one of a handful of character classes, and
+* the next state is then a single lookup in the state x class transition table. This replaces the isdigit/isalpha/
+* isspace calls(which go through the locale) and the nested switch on the operator characters.
 */
-LexItem id_or_kw(const string& lexeme, int linenum) {
-    //If the word isn't a keyword, we'll have Ident as our default token
-    Token token = IDENT;
+enum CharClass : uint8_t {
+    CC_OTHER, CC_SPACE, CC_NL, CC_DIGIT, CC_ALPHA, CC_DOT, CC_QUOTE,
+    CC_LBRACE, CC_RBRACE, CC_COLON, CC_EQ, CC_OP,
+    NUM_CLASSES
+};
+
+//Byte -> character class. Letters and '_' can start identifiers, and CC_SPACE is isspace() in the C locale minus '\n'
+struct CharClassTable {
+    uint8_t cls[256];
+};
+static constexpr CharClassTable buildCharClasses(){
+    CharClassTable t = {};
+    for (int c = 'a'; c <= 'z'; c++){
+        t.cls[c] = CC_ALPHA;
+        t.cls[c - 'a' + 'A'] = CC_ALPHA;
+    }
+    for (int c = '0'; c <= '9'; c++){
+        t.cls[c] = CC_DIGIT;
+    }
+    t.cls[(int)'_'] = CC_ALPHA;
+    t.cls[(int)' '] = CC_SPACE;
+    t.cls[(int)'\t'] = CC_SPACE;
+    t.cls[(int)'\v'] = CC_SPACE;
+    t.cls[(int)'\f'] = CC_SPACE;
+    t.cls[(int)'\r'] = CC_SPACE;
+    t.cls[(int)'\n'] = CC_NL;
+    t.cls[(int)'.'] = CC_DOT;
+    t.cls[(int)'\''] = CC_QUOTE;
+    t.cls[(int)'{'] = CC_LBRACE;
+    t.cls[(int)'}'] = CC_RBRACE;
+    t.cls[(int)':'] = CC_COLON;
+    t.cls[(int)'='] = CC_EQ;
+    for (char c : {'<', '>', '+', '-', '*', '/', ';', '(', ')', ','}){
+        t.cls[(int)c] = CC_OP;
+    }
+    return t;
+}
+static constexpr CharClassTable charClass = buildCharClasses();
+
+//Token for a lexeme that is just one character. Anything that isn't an operator or delimiter is an error
+struct OpTokenTable {
+    Token tok[256];
+};
+static constexpr OpTokenTable buildOpTokens(){
+    OpTokenTable t = {};
+    for (int c = 0; c < 256; c++){
+        t.tok[c] = ERR;
+    }
+    t.tok[(int)'<'] = LTHAN;
+    t.tok[(int)'>'] = GTHAN;
+    t.tok[(int)'+'] = PLUS;
+    t.tok[(int)'-'] = MINUS;
+    t.tok[(int)'*'] = MULT;
+    t.tok[(int)'/'] = DIV;
+    t.tok[(int)'='] = EQ;
+    t.tok[(int)';'] = SEMICOL;
+    t.tok[(int)'.'] = DOT;
+    t.tok[(int)'('] = LPAREN;
+    t.tok[(int)')'] = RPAREN;
+    t.tok[(int)','] = COMMA;
+    return t;
+}
+static constexpr OpTokenTable opToken = buildOpTokens();
+
+/*
+* DFA states. The first group are the states we can be in between characters, the second group are accepting states
+* that end the token. "BACK" states ended on a character that belongs to the next token, so the cursor backs up one.
+*/
+enum DfaState : uint8_t {
+    S_START, S_ID, S_INT, S_REAL, S_STR, S_CMT, S_COLON,
+    NUM_STATES,
+
+    F_OP = NUM_STATES,  // one character token(or error), includes ch
+    F_ID_BACK,          // identifier or keyword
+    F_INT_BACK,         // ICONST
+    F_REAL_BACK,        // RCONST
+    F_REAL_ERR,         // second dot in a real, includes ch
+    F_SCONST,           // closing quote, lexeme is what is between the quotes
+    F_STR_ERR,          // newline in a string, lexeme stops before it
+    F_COLON_BACK,       // ':' not followed by '='
+    F_ASSOP,            // ":="
+    NUM_DFA_STATES
+};
+
+struct TransitionTable {
+    uint8_t next[NUM_STATES][NUM_CLASSES];
+};
+static constexpr TransitionTable buildTransitions(){
+    TransitionTable t = {};
+    for (int c = 0; c < NUM_CLASSES; c++){
+        t.next[S_START][c] = F_OP;
+        t.next[S_ID][c] = F_ID_BACK;
+        t.next[S_INT][c] = F_INT_BACK;
+        t.next[S_REAL][c] = F_REAL_BACK;
+        t.next[S_STR][c] = S_STR;
+        t.next[S_CMT][c] = S_CMT;
+        t.next[S_COLON][c] = F_COLON_BACK;
+    }
+
+    t.next[S_START][CC_SPACE] = S_START;
+    t.next[S_START][CC_NL] = S_START;
+    t.next[S_START][CC_DIGIT] = S_INT;
+    t.next[S_START][CC_ALPHA] = S_ID;
+    t.next[S_START][CC_QUOTE] = S_STR;
+    t.next[S_START][CC_LBRACE] = S_CMT;
+    t.next[S_START][CC_COLON] = S_COLON;
+
+    t.next[S_ID][CC_ALPHA] = S_ID;
+    t.next[S_ID][CC_DIGIT] = S_ID;
+
+    t.next[S_INT][CC_DIGIT] = S_INT;
+    t.next[S_INT][CC_DOT] = S_REAL;
+
+    t.next[S_REAL][CC_DIGIT] = S_REAL;
+    t.next[S_REAL][CC_DOT] = F_REAL_ERR;
+
+    t.next[S_STR][CC_QUOTE] = F_SCONST;
+    t.next[S_STR][CC_NL] = F_STR_ERR;
+
+    t.next[S_CMT][CC_RBRACE] = S_START;
+
+    t.next[S_COLON][CC_EQ] = F_ASSOP;
+    return t;
+}
+static constexpr TransitionTable transition = buildTransitions();
+
+
+/*
+* Dispatch on the state we just moved to. By default this is a switch inside the character loop. Building with
+* -DLEX_COMPUTED_GOTO=1 (GCC and Clang only) instead threads the states together: every state ends by fetching the
+* next byte and jumping straight to the handler for the state after it, so there is no shared dispatch branch
+*/
+#ifndef LEX_COMPUTED_GOTO
+#define LEX_COMPUTED_GOTO 0
+#endif
+
+#if LEX_COMPUTED_GOTO
+#define LEX_CASE(s) case s: L_##s
+#define LEX_NEXT() do { \
+        if (pos >= size) goto at_end; \
+        c = charClass.cls[(unsigned char)buf[pos++]]; \
+        start = state == S_START ? pos - 1 : start; \
+        state = transition.next[state][c]; \
+        goto *dispatch[state]; \
+    } while (0)
+#else
+#define LEX_CASE(s) case s
+#define LEX_NEXT() continue
+#endif
+
+
+/*
+* Constants from the buffer lexer, decoded as they are lexed. A value out of range comes back as ERR, and ErrMessage
+* explains why
+*/
+static inline LexView intConstant(const char* buf, uint64_t start, uint64_t length, int line){
+    int value;
+    if (!DecodeInt(string_view(buf + start, length), value)){
+        return LexView(ERR, buf, start, length, line);
+    }
+    return LexView(ICONST, buf, start, length, line, value);
+}
+
+static inline LexView realConstant(const char* buf, uint64_t start, uint64_t length, int line){
+    double value;
+    if (!DecodeReal(string_view(buf + start, length), value)){
+        return LexView(ERR, buf, start, length, line);
+    }
+    return LexView(RCONST, buf, start, length, line, value);
+}
 
-    string lexemeUpper = lexeme;
-    //Since everything in our map is uppercase, we'll need to make our lexeme uppercase
-    transform(lexemeUpper.begin(), lexemeUpper.end(), lexemeUpper.begin(), ::toupper);
 
-    //See if we can find this keyword as a key in the specially made keywordMap
-    auto i = keywordMap.find(lexemeUpper); 
+/*
+* Buffer version of getNextToken. It recognizes exactly the same tokens as the istream version, but walks a cursor
+* over memory we already have (usually a mapped file), so there is no per character stream overhead and no lexeme is
+* ever copied. The returned LexView points straight into src.buf. Backing up is just moving the cursor back one byte.
+* Whitespace runs, comment bodies and string bodies are skipped with the bulk kernels in scan.cpp.
+*
+* Unlike the istream version, a number or identifier that runs right up to the end of the buffer is still returned
+* instead of being dropped
+*/
+LexView getNextToken(LexCursor& src, int& linenumber){
+    const char* buf = src.buf;
+    const uint64_t size = src.size;
+    uint64_t pos = src.pos;
+    //Offset of the first character of the current lexeme
+    uint64_t start = pos;
+    uint8_t state = S_START;
+    uint8_t c = CC_OTHER;
+
+#if LEX_COMPUTED_GOTO
+    static void* const dispatch[NUM_DFA_STATES] = {
+        &&L_S_START, &&L_S_ID, &&L_S_INT, &&L_S_REAL, &&L_S_STR, &&L_S_CMT, &&L_S_COLON,
+        &&L_F_OP, &&L_F_ID_BACK, &&L_F_INT_BACK, &&L_F_REAL_BACK, &&L_F_REAL_ERR,
+        &&L_F_SCONST, &&L_F_STR_ERR, &&L_F_COLON_BACK, &&L_F_ASSOP
+    };
+    LEX_NEXT();
+#endif
+
+    while(pos < size){
+        c = charClass.cls[(unsigned char)buf[pos++]];
+        //Whatever we leave the start state on is the first character of the lexeme
+        start = state == S_START ? pos - 1 : start;
+        state = transition.next[state][c];
+
+        switch(state){
+            LEX_CASE(S_START):
+                //Whitespace, or the '}' closing a comment. Runs of whitespace are skipped in bulk
+                linenumber += (c == CC_NL);
+                if (pos < size && (charClass.cls[(unsigned char)buf[pos]] == CC_SPACE || buf[pos] == '\n')){
+                    pos = scan.skipSpace(buf, pos, size, linenumber);
+                }
+                LEX_NEXT();
+
+            LEX_CASE(S_CMT):
+                //Nothing in a comment matters but the closing brace, jump straight to it and count the lines on the way
+                linenumber += (c == CC_NL);
+                pos = scan.skipComment(buf, pos, size, linenumber);
+                LEX_NEXT();
+
+            LEX_CASE(S_STR):
+                //Same for strings, jump to the closing quote or the newline that makes it an error
+                pos = scan.skipString(buf, pos, size);
+                LEX_NEXT();
+
+            LEX_CASE(S_ID):
+            LEX_CASE(S_INT):
+            LEX_CASE(S_REAL):
+            LEX_CASE(S_COLON):
+                LEX_NEXT();
+
+            LEX_CASE(F_OP):
+                src.pos = pos;
+                return LexView(opToken.tok[(unsigned char)buf[start]], buf, start, pos - start, linenumber);
+
+            LEX_CASE(F_ID_BACK):
+                src.pos = pos - 1;
+                return LexView(Keywords::Lookup(buf + start, pos - 1 - start), buf, start, pos - 1 - start, linenumber);
+
+            LEX_CASE(F_INT_BACK):
+                src.pos = pos - 1;
+                return intConstant(buf, start, pos - 1 - start, linenumber);
+
+            LEX_CASE(F_REAL_BACK):
+                src.pos = pos - 1;
+                return realConstant(buf, start, pos - 1 - start, linenumber);
+
+            LEX_CASE(F_REAL_ERR):
+                src.pos = pos;
+                return LexView(ERR, buf, start, pos - start, linenumber);
+
+            LEX_CASE(F_SCONST):
+                src.pos = pos;
+                return LexView(SCONST, buf, start + 1, pos - 2 - start, linenumber);
+
+            LEX_CASE(F_STR_ERR):
+                src.pos = pos;
+                return LexView(ERR, buf, start, pos - 1 - start, linenumber);
+
+            LEX_CASE(F_COLON_BACK):
+                src.pos = pos - 1;
+                return LexView(COLON, buf, start, pos - 1 - start, linenumber);
+
+            LEX_CASE(F_ASSOP):
+                src.pos = pos;
+                return LexView(ASSOP, buf, start, pos - start, linenumber);
+        }
+    }
 
-    //if we found the lexeme as a key, we know the token should be the corresponding value("i->second")
-    if (i != keywordMap.end()){
-        token = i -> second;
+#if LEX_COMPUTED_GOTO
+at_end:
+#endif
+    //We ran out of buffer, finish off whatever lexeme we were in the middle of
+    src.pos = pos;
+    switch(state){
+        //An unterminated string is an error
+        case S_STR:
+            return LexView(ERR, buf, start, pos - start, linenumber);
+        case S_INT:
+            return intConstant(buf, start, pos - start, linenumber);
+        case S_REAL:
+            return realConstant(buf, start, pos - start, linenumber);
+        case S_ID:
+            return LexView(Keywords::Lookup(buf + start, pos - start), buf, start, pos - start, linenumber);
+        case S_COLON:
+            return LexView(COLON, buf, start, pos - start, linenumber);
+        default:
+            return LexView(DONE, buf, pos, 0, linenumber);
     }
+}
 
-    return LexItem(token, lexeme, linenum);
+#undef LEX_CASE
+#undef LEX_NEXT
+
+
+/*
+* The lexItem function takes in a reference to a string and a linenumber, and checks if given lexeme is a keyword
+* using the perfect hash in keywords.h. The check is case insensitive and doesn't allocate
+* @returns: a lexItem with either an IDENT token or the keyword token, if one was found
+*/
+LexItem id_or_kw(const string& lexeme, int linenum) {
+    return LexItem(Keywords::Lookup(lexeme.data(), lexeme.size()), lexeme, linenum);
 }
 
 
@@ -350,15 +723,15 @@ ostream& operator<<(ostream& out, const LexItem& tok){
     Token t = tok.GetToken();
     // If there's an error token, print the appropriate message
     if (t == ERR){
-        out << "Error in line " << tok.GetLinenum() + 1 << ": Unrecognized Lexeme {" << tok.GetLexeme() << "}";   
+        out << "Error in line " << tok.GetLinenum() + 1 << ": " << ErrMessage(tok.GetLexeme()) << " {" << tok.GetLexeme() << "}";   
         return out; 
     }
     // if t is one of these, we want to print the lexeme with it as well
     if (t == IDENT || t == BCONST || t == ICONST || t == RCONST || t == SCONST){ 
-        out << tokenMap[t] << ": \"" << tok.GetLexeme() << "\""; 
+        out << tokenNames[t] << ": \"" << tok.GetLexeme() << "\""; 
     // otherwise, just print out the string version of the token
     } else {
-        out << tokenMap[t];
+        out << tokenNames[t];
     }
 
     return out;
@@ -9,8 +9,11 @@
 #define LEX_H_
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <map>
+#include <cstdint>
+#include <type_traits>
 using namespace std;
 
 
@@ -39,36 +42,142 @@ enum Token {
 };
 
 
-//Class definition of LexItem
+//Printable name of every token, in the same order as the enum
+inline constexpr string_view tokenNames[DONE + 1] = {
+	"IF", "ELSE", "WRITELN", "WRITE", "INTEGER", "REAL",
+	"BOOLEAN", "STRING", "BEGIN", "END", "VAR", "THEN", "PROGRAM",
+	"IDENT", "TRUE", "FALSE",
+	"ICONST", "RCONST", "SCONST", "BCONST",
+	"PLUS", "MINUS", "MULT", "DIV", "IDIV", "MOD", "ASSOP", "EQ",
+	"GTHAN", "LTHAN", "AND", "OR", "NOT",
+	"COMMA", "SEMICOL", "LPAREN", "RPAREN", "DOT", "COLON",
+	"ERR",
+	"DONE",
+};
+static_assert(tokenNames[IDENT] == "IDENT" && tokenNames[COLON] == "COLON" && tokenNames[DONE] == "DONE", "tokenNames is out of step with Token");
+
+
+//Class definition of LexItem. A LexItem doesn't hold its lexeme, only an interned id for it, so it is
+//small, trivially copyable and never allocates. GetLexeme() looks the text up when somebody asks for it
 class LexItem {
 	Token	token;
-	string	lexeme;
 	int	lnum;
+	//For an IDENT, its id in identifiers. Operators, delimiters and DONE can only ever have one lexeme,
+	//so they don't need an id(UINT32_MAX). Anything else is interned into lexemes(see intern.h)
+	uint32_t	id;
 
 public:
 	LexItem() {
 		token = ERR;
 		lnum = -1;
+		id = UINT32_MAX;
 	}
-	LexItem(Token token, string lexeme, int line) {
+	//Interns the lexeme, so it only has to live until the constructor returns
+	LexItem(Token token, string_view lexeme, int line);
+	//A token whose lexeme has already been interned
+	LexItem(Token token, int line, uint32_t id) {
 		this->token = token;
-		this->lexeme = lexeme;
 		this->lnum = line;
+		this->id = id;
 	}
 
 	bool operator==(const Token token) const { return this->token == token; }
 	bool operator!=(const Token token) const { return this->token != token; }
 
 	Token	GetToken() const { return token; }
-	string	GetLexeme() const { return lexeme; }
+	//Good until the next lexeme is interned
+	string_view	GetLexeme() const;
 	int	GetLinenum() const { return lnum; }
+	//Interned id of an identifier, UINT32_MAX for any other token
+	uint32_t	GetId() const { return token == IDENT ? id : UINT32_MAX; }
+	//Interned id of the lexeme, in identifiers for an IDENT and in lexemes for anything else
+	uint32_t	GetLexemeId() const { return id; }
+	//Decoded value of an ICONST or RCONST
+	int	GetIntValue() const;
+	double	GetRealValue() const;
+};
+
+static_assert(sizeof(LexItem) <= 16 && is_trivially_copyable<LexItem>::value, "LexItem must stay small and trivially copyable");
+
+
+
+//Class definition of LexView, a token whose lexeme is a view into the buffer it was lexed from
+//instead of a copy. Offsets are 64-bit so buffers larger than 2GB work
+class LexView {
+	Token	token;
+	const char*	base;
+	uint64_t	offset;
+	uint64_t	length;
+	int	lnum;
+	//Decoded value of an ICONST or RCONST
+	union {
+		int	ival;
+		double	rval;
+	};
+
+public:
+	LexView() {
+		token = ERR;
+		base = nullptr;
+		offset = 0;
+		length = 0;
+		lnum = -1;
+		rval = 0;
+	}
+	LexView(Token token, const char* base, uint64_t offset, uint64_t length, int line) {
+		this->token = token;
+		this->base = base;
+		this->offset = offset;
+		this->length = length;
+		this->lnum = line;
+		rval = 0;
+	}
+	LexView(Token token, const char* base, uint64_t offset, uint64_t length, int line, int value)
+		: LexView(token, base, offset, length, line) { ival = value; }
+	LexView(Token token, const char* base, uint64_t offset, uint64_t length, int line, double value)
+		: LexView(token, base, offset, length, line) { rval = value; }
+
+	bool operator==(const Token token) const { return this->token == token; }
+	bool operator!=(const Token token) const { return this->token != token; }
+
+	Token	GetToken() const { return token; }
+	string_view	GetLexeme() const { return string_view(base + offset, length); }
+	uint64_t	GetOffset() const { return offset; }
+	uint64_t	GetLength() const { return length; }
+	int	GetLinenum() const { return lnum; }
+	int	GetIntValue() const { return ival; }
+	double	GetRealValue() const { return rval; }
+};
+
+
+//A read position inside an in-memory source buffer, used by the buffer version of getNextToken
+struct LexCursor {
+	const char*	buf;
+	uint64_t	size;
+	uint64_t	pos;
+
+	LexCursor(const char* buf, uint64_t size) {
+		this->buf = buf;
+		this->size = size;
+		this->pos = 0;
+	}
 };
 
 
 
 extern ostream& operator<<(ostream& out, const LexItem& tok);
 extern LexItem id_or_kw(const string& lexeme, int linenum);
+//Decode the text of an integer or real constant. Returns false if the value is out of range
+extern bool DecodeInt(string_view text, int& value);
+extern bool DecodeReal(string_view text, double& value);
+//What is wrong with an ERR token
+extern string_view ErrMessage(string_view lexeme);
 extern LexItem getNextToken(istream& in, int& linenum);
+extern LexView getNextToken(LexCursor& src, int& linenum);
+//Forget every identifier and lexeme the calling thread has interned(intern.h), and the constants decoded from them,
+//so a thread that works through program after program doesn't keep every name it has ever seen. Only once nothing
+//holding one of their ids(a LexItem, a syntax tree, a symbol table, a token buffer) is going to be used again
+extern void ClearInterned();
 
 
 #endif /* LEX_H_ */
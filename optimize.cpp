@@ -0,0 +1,273 @@
+/**
+ * The optimizer passes over SSA form(ssa.h). Blocks are in an order where every block comes after the blocks that jump
+ * to it, so one walk in that order sees every value after everything it depends on, and nothing has to be revisited
+*/
+
+#include "ssa.h"
+
+
+//Integer arithmetic wraps, the same as in the VM
+static inline int32_t wrap(uint32_t v){
+	return (int32_t)v;
+}
+
+
+/**
+ * Work out op on constants a and b the way the VM would, into result. Returns false for what the VM would stop on
+ * (dividing by zero), which has to be left for run time
+*/
+static bool Fold(SsaProgram& p, uint8_t op, const Slot& a, const Slot& b, Slot& result){
+	result = Slot{0};
+	switch (op){
+		case OP_I2R: result.r = a.i; break;
+		case OP_ADD_I: result.i = wrap((uint32_t)a.i + (uint32_t)b.i); break;
+		case OP_ADD_R: result.r = a.r + b.r; break;
+		case OP_SUB_I: result.i = wrap((uint32_t)a.i - (uint32_t)b.i); break;
+		case OP_SUB_R: result.r = a.r - b.r; break;
+		case OP_MUL_I: result.i = wrap((uint32_t)a.i * (uint32_t)b.i); break;
+		case OP_MUL_R: result.r = a.r * b.r; break;
+		case OP_DIV_R:
+			if (b.r == 0){
+				return false;
+			}
+			result.r = a.r / b.r;
+			break;
+		case OP_IDIV:
+			if (b.i == 0){
+				return false;
+			}
+			result.i = b.i == -1 ? wrap(0 - (uint32_t)a.i) : a.i / b.i;
+			break;
+		case OP_MOD:
+			if (b.i == 0){
+				return false;
+			}
+			result.i = b.i == -1 ? 0 : a.i % b.i;
+			break;
+		case OP_CONCAT:
+			result.s = (uint32_t)p.strings.size();
+			p.strings.push_back(p.strings[a.s] + p.strings[b.s]);
+			break;
+		case OP_NEG_I: result.i = wrap(0 - (uint32_t)a.i); break;
+		case OP_NEG_R: result.r = -a.r; break;
+		case OP_NOT: result.b = !a.b; break;
+		case OP_AND: result.b = a.b && b.b; break;
+		case OP_OR: result.b = a.b || b.b; break;
+		case OP_EQ_I: result.b = a.i == b.i; break;
+		case OP_EQ_R: result.b = a.r == b.r; break;
+		case OP_EQ_S: result.b = p.strings[a.s] == p.strings[b.s]; break;
+		case OP_EQ_B: result.b = a.b == b.b; break;
+		case OP_LT_I: result.b = a.i < b.i; break;
+		case OP_LT_R: result.b = a.r < b.r; break;
+		case OP_LT_S: result.b = p.strings[a.s] < p.strings[b.s]; break;
+		case OP_GT_I: result.b = a.i > b.i; break;
+		case OP_GT_R: result.b = a.r > b.r; break;
+		case OP_GT_S: result.b = p.strings[a.s] > p.strings[b.s]; break;
+		default:
+			return false;
+	}
+	return true;
+}
+
+
+//Two constants of the same type with the same value
+static bool Same(const SsaInstr& x, const SsaInstr& y, const SsaProgram& p){
+	if (x.type != y.type){
+		return false;
+	}
+	switch (x.type){
+		case INTEGER: return x.value.i == y.value.i;
+		case REAL: return x.value.r == y.value.r && (x.value.r != 0 || (1 / x.value.r) == (1 / y.value.r));
+		case STRING: return p.strings[x.value.s] == p.strings[y.value.s];
+		default: return x.value.b == y.value.b;
+	}
+}
+
+
+/**
+ * Sparse conditional constant propagation. Only the entry block is known to run at first; a block runs if a block
+ * that runs goes to it, and a branch on a constant only goes one way. In each block that runs, an instruction whose
+ * operands are all constants becomes the constant it computes, and a phi becomes a copy of its one arm when only one
+ * of the blocks before it runs, or when its arms are the same. Copies are then taken out: every use of one is pointed
+ * at the value it copies. Blocks that never run are marked dead
+*/
+void Propagate(SsaProgram& p){
+	vector<uint32_t> copyOf(p.values.size());
+	for (uint32_t v = 0; v < p.values.size(); v++){
+		copyOf[v] = v;
+	}
+	auto resolve = [&](uint32_t v){
+		while (copyOf[v] != v){
+			v = copyOf[v] = copyOf[copyOf[v]];
+		}
+		return v;
+	};
+	auto isConst = [&](uint32_t v){ return p.values[v].op == SSA_CONST; };
+
+	vector<uint8_t> runs(p.blocks.size(), 0);
+	runs[0] = 1;
+	for (uint32_t b = 0; b < p.blocks.size(); b++){
+		SsaBlock& block = p.blocks[b];
+		if (!runs[b]){
+			block.dead = true;
+			for (uint32_t v : block.instrs){
+				p.values[v].dead = true;
+			}
+			continue;
+		}
+
+		for (uint32_t v : block.instrs){
+			SsaInstr& in = p.values[v];
+			if (in.op == OP_CHECK){
+				in.b = resolve(in.b);
+				continue;
+			}
+			uint32_t uses[2];
+			int n = SsaProgram::Uses(in, uses);
+			if (n > 0){
+				in.a = resolve(in.a);
+			}
+			if (n > 1){
+				in.b = resolve(in.b);
+			}
+
+			if (in.op == SSA_PHI){
+				//The arms whose block runs and still goes here
+				uint32_t arms[2];
+				int live = 0;
+				for (int k = 0; k < block.npreds; k++){
+					const SsaBlock& pred = p.blocks[block.preds[k]];
+					bool edge = runs[block.preds[k]] && (pred.succs[0] == b || (pred.nsuccs == 2 && pred.succs[1] == b));
+					if (edge){
+						arms[live++] = k == 0 ? in.a : in.b;
+					}
+				}
+				if (live == 1 || arms[0] == arms[1]){
+					copyOf[v] = arms[0];
+					in.dead = true;
+				} else if (isConst(arms[0]) && isConst(arms[1]) && Same(p.values[arms[0]], p.values[arms[1]], p)){
+					in.op = SSA_CONST;
+					in.value = p.values[arms[0]].value;
+				}
+				continue;
+			}
+
+			bool pure = in.op < OP_JMP && in.op != OP_MOV;
+			if (pure && isConst(in.a) && (n < 2 || isConst(in.b))){
+				Slot result;
+				if (Fold(p, in.op, p.values[in.a].value, n > 1 ? p.values[in.b].value : Slot{0}, result)){
+					in.op = SSA_CONST;
+					in.value = result;
+				}
+			}
+		}
+
+		if (block.nsuccs == 2){
+			block.cond = resolve(block.cond);
+			if (isConst(block.cond)){
+				block.succs[0] = p.values[block.cond].value.b ? block.succs[0] : block.succs[1];
+				block.nsuccs = 1;
+			} else {
+				runs[block.succs[1]] = 1;
+			}
+		}
+		if (block.nsuccs > 0){
+			runs[block.succs[0]] = 1;
+		}
+	}
+}
+
+
+/**
+ * Dead code and dead store elimination. A check for an unassigned variable is dropped when the value it checks can no
+ * longer be undef: undef itself can, and so can a phi with an arm that can. Recording that a variable was assigned
+ * is dropped when nothing checks it any more. Then what is left live is what writes output, what branches, what
+ * checks, and what could stop the program(a division by something not known to be nonzero), plus everything those
+ * use. Everything else is dead, which takes every assignment whose value is never read
+*/
+void Eliminate(SsaProgram& p){
+	vector<uint8_t> mayBeUndef(p.values.size(), 0);
+	vector<uint32_t> checks(p.vars, 0);
+	for (uint32_t v = 0; v < p.values.size(); v++){
+		mayBeUndef[v] = p.values[v].op == SSA_UNDEF;
+	}
+	for (const SsaBlock& block : p.blocks){
+		if (block.dead){
+			continue;
+		}
+		for (uint32_t v : block.instrs){
+			SsaInstr& in = p.values[v];
+			if (in.dead){
+				continue;
+			}
+			if (in.op == SSA_PHI){
+				mayBeUndef[v] = mayBeUndef[in.a] || mayBeUndef[in.b];
+			} else if (in.op == OP_CHECK){
+				in.dead = !mayBeUndef[in.b];
+				checks[in.a] += !in.dead;
+			}
+		}
+	}
+
+	vector<uint8_t> live(p.values.size(), 0);
+	vector<uint32_t> work;
+	for (const SsaBlock& block : p.blocks){
+		if (block.dead){
+			continue;
+		}
+		for (uint32_t v : block.instrs){
+			SsaInstr& in = p.values[v];
+			if (in.dead || in.op == SSA_CONST){
+				continue;
+			}
+			bool root;
+			switch (in.op){
+				case OP_WRITE_I: case OP_WRITE_R: case OP_WRITE_S: case OP_WRITE_B: case OP_WRITELN: case OP_CHECK:
+					root = true;
+					break;
+				case OP_MARK:
+					root = checks[in.a] > 0;
+					break;
+				case OP_DIV_R:
+					root = p.values[in.b].op != SSA_CONST || p.values[in.b].value.r == 0;
+					break;
+				case OP_IDIV: case OP_MOD:
+					root = p.values[in.b].op != SSA_CONST || p.values[in.b].value.i == 0;
+					break;
+				default:
+					root = false;
+					break;
+			}
+			if (root){
+				live[v] = 1;
+				work.push_back(v);
+			}
+		}
+		if (block.nsuccs == 2 && !live[block.cond]){
+			live[block.cond] = 1;
+			work.push_back(block.cond);
+		}
+	}
+
+	while (!work.empty()){
+		uint32_t v = work.back();
+		work.pop_back();
+		uint32_t uses[2];
+		int n = SsaProgram::Uses(p.values[v], uses);
+		for (int k = 0; k < n; k++){
+			if (!live[uses[k]]){
+				live[uses[k]] = 1;
+				work.push_back(uses[k]);
+			}
+		}
+	}
+
+	for (const SsaBlock& block : p.blocks){
+		for (uint32_t v : block.instrs){
+			SsaInstr& in = p.values[v];
+			if (in.op != SSA_CONST){
+				in.dead = !live[v];
+			}
+		}
+	}
+}
@@ -6,46 +6,296 @@
 */
 
 #include "parser.h"
+#include "tokens.h"
+#include "stream.h"
+#include "ast.h"
+#include "bytecode.h"
 #include <iostream>
-#include <set>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+ParserContext::ParserContext(ostream& errors) : out(errors) {
+	error_count = 0;
+	pushed_back = false;
+	source = nullptr;
+	stream = nullptr;
+	tokens = nullptr;
+	cursor = 0;
+	fetched = 0;
+	last = ERR;
+	backedUp = SIZE_MAX;
+	ast = nullptr;
+	stackBudget = 0;
+	errorLimit = 0;
+	firstError = 0;
+}
 
-// defVar keeps track of all variables that have been defined in the program thus far
-map<string, bool> defVar;
-// SymTable keeps track of the type for all of our variables
-map<string, Token> SymTable;
+ParserContext::~ParserContext() {
+}
 
-namespace Parser {
-	bool pushed_back = false;
-	LexItem	pushed_token;
 
-	static LexItem GetNextToken(istream& in, int& line) {
-		if( pushed_back ) {
-			pushed_back = false;
-			return pushed_token;
+LexItem ParserContext::GetNextToken(istream& in, int& line) {
+	if( tokens != nullptr ) {
+		//Past the end we just keep handing out the DONE token, like the lexer does
+		size_t i = min(cursor, tokens->Size() - 1);
+		if( cursor == fetched && cursor < tokens->Size() ) {
+			line += tokens->GetLinenum(i) - (i > 0 ? tokens->GetLinenum(i - 1) : tokens->GetFirstLine());
+			fetched++;
+		}
+		cursor++;
+		//Identifiers were interned when the buffer was filled
+		if( tokens->GetToken(i) == IDENT ) {
+			return LexItem(IDENT, tokens->GetLinenum(i), tokens->GetId(i));
 		}
-		return getNextToken(in, line);
+		return LexItem(tokens->GetToken(i), tokens->GetLexeme(i), tokens->GetLinenum(i));
+	}
+	if( pushed_back ) {
+		pushed_back = false;
+		last = pushed_token.GetToken();
+		return pushed_token;
+	}
+	//Lexemes are interned as they come off the lexer(see LexItem), everything past here works with ids
+	if( source != nullptr || stream != nullptr ) {
+		LexView v = source != nullptr ? getNextToken(*source, line) : stream->Next(line);
+		last = v.GetToken();
+		return LexItem(v.GetToken(), v.GetLexeme(), v.GetLinenum());
+	}
+	LexItem t = getNextToken(in, line);
+	last = t.GetToken();
+	return t;
+}
+
+//The last token handed out, or ERR if it has been pushed back, so error recovery can tell whether the token an
+//error was found at has already been read(see Resync)
+Token ParserContext::LastToken() const {
+	if( tokens != nullptr ) {
+		return cursor == 0 || cursor == backedUp ? ERR : tokens->GetToken(min(cursor - 1, tokens->Size() - 1));
 	}
+	return last;
+}
 
-	static void PushBackToken(LexItem & t) {
-		if( pushed_back ) {
-			abort();
-		}
-		pushed_back = true;
-		pushed_token = t;	
+//Replace the two newest pending nodes with op applied to them, and their types with the type of the result
+void ParserContext::Binary(Token op, int line) {
+	Token right = PopType();
+	Token& type = types.back();
+	Token left = type;
+	bool real;
+	if( left == ERR || right == ERR ) {
+		type = ERR;
+	} else if( BinaryOp(op, left, right, type, real) == OP_COUNT ) {
+		TypeError(line, "Illegal operand type for the operation.");
+		type = ERR;
+	}
+	if( ast != nullptr ) {
+		uint32_t rhs = ast->Take();
+		uint32_t lhs = ast->Take();
+		ast->Add(N_BINARY, op, line, lhs, rhs);
+		ast->SetType(type);
+	}
+}
+
+//Wrap the newest pending node in the sign Factor was given. A + sign changes nothing
+void ParserContext::Sign(int sign, int line) {
+	if( sign != 2 && sign != 3 ) {
+		return;
+	}
+	Token op = sign == 2 ? MINUS : NOT;
+	Token& type = types.back();
+	if( type != ERR && UnaryOp(op, type) == OP_COUNT ) {
+		TypeError(line, "Illegal operand type for the operation.");
+		type = ERR;
+	}
+	if( ast != nullptr ) {
+		ast->Add(N_UNARY, op, line, ast->Take(), 0);
+		ast->SetType(type);
+	}
+}
+
+//An operand of type type has just been parsed(and its node added, when there is a tree)
+void ParserContext::Typed(Token type) {
+	types.push_back(type);
+	if( ast != nullptr ) {
+		ast->SetType(type);
+	}
+}
+
+//Claim the type of the newest expression
+Token ParserContext::PopType() {
+	Token type = types.back();
+	types.pop_back();
+	return type;
+}
+
+//Check that a value can be stored in a variable: it has to be the same type, or an integer going into a real
+void ParserContext::Assign(Token var, Token value, int line) {
+	if( var != value && var != ERR && value != ERR && !(var == REAL && value == INTEGER) ) {
+		TypeError(line, "Illegal mixed-mode assignment operation.");
 	}
+}
+
+//Claim the newest expression as the condition of an if statement, which has to be a boolean
+void ParserContext::Condition(int line) {
+	Token type = PopType();
+	if( type != BOOLEAN && type != ERR ) {
+		TypeError(line, "Illegal Type for If statement condition.");
+	}
+}
+
+size_t ParserContext::Mark() const {
+	return ast != nullptr ? ast->Mark() : 0;
+}
 
+void ParserContext::PushBackToken(LexItem & t) {
+	//With a token buffer, backing up is just moving the cursor
+	if( tokens != nullptr ) {
+		backedUp = --cursor;
+		return;
+	}
+	last = ERR;
+	if( pushed_back ) {
+		abort();
+	}
+	pushed_back = true;
+	pushed_token = t;	
 }
 
 
-//Initialize error count to be 0
-static int error_count = 0;
+//The rules the explicit stack parser keeps frames for, the ones that can end up inside themselves
+enum ParserContext::Rule : uint8_t { R_EXPR, R_CLIMB, R_PAREN, R_COMPOUND, R_IF, R_ASSIGN, R_WRITE };
 
 
 //A simple error wrapper that incrememnts error count, and prints out the error
-void ParseError(int line, string msg)
+void ParserContext::ParseError(int line, string msg)
 {
 	++error_count;
-	cout << line << ": " << msg << endl;
+	out << line << ": " << msg << endl;
+	//A program with errors has no syntax tree, so when parsing is going to carry on past one, stop building it
+	if (errorLimit != 0){
+		ast = nullptr;
+	}
+}
+
+//Report a type error. Nothing stops the parse at one, so like syntax errors they stop being reported once the limit
+//has been reached in this program, or after the first when errors aren't recovered from
+void ParserContext::TypeError(int line, const char* msg)
+{
+	if (error_count - firstError < max(errorLimit, 1)){
+		ParseError(line, msg);
+	}
+}
+
+//Forget every declaration and error, so the next Prog starts like it is the first one
+void ParserContext::Reset(){
+	symbols.Clear();
+	types.clear();
+	error_count = 0;
+	pushed_back = false;
+}
+
+
+static inline uint64_t Bit(Token t){
+	return (uint64_t)1 << t;
+}
+
+
+/**
+ * Panic mode error recovery. After a syntax error, throw tokens away up to the first one in stops, where the rule
+ * recovering can carry on from. The token the error was found at counts, if it was read and not put back. A BEGIN ...
+ * END thrown away is skipped whole, unless BEGIN is one of the stops, so its END doesn't end the block the error was
+ * in. Returns the token it stopped at, which has been read, or DONE if the program ended first
+*/
+Token ParserContext::Resync(istream& in, int& line, uint64_t stops){
+	Token t = LastToken();
+	int depth = 0;
+
+	while (t != DONE){
+		if (t == BEGIN && !(stops & Bit(BEGIN))){
+			depth++;
+		} else if (depth > 0){
+			depth -= t == END;
+		} else if (stops & Bit(t)){
+			return t;
+		}
+		t = GetNextToken(in, line).GetToken();
+	}
+	return DONE;
+}
+
+
+//Recover from an error in a statement by throwing it away, up to the semicolon or END after it, which is left in l as
+//the separator after it. False if the program ends first
+bool ParserContext::ResyncStmt(istream& in, int& line, LexItem& l){
+	Token at = Resync(in, line, Bit(SEMICOL) | Bit(END));
+	l = LexItem(at, "", line);
+	return at != DONE;
+}
+
+
+/**
+ * What CompoundStmt does after each Stmt. status is whether it worked and errors how many errors had been reported
+ * before it. l is left with the token after it, which has to be a semicolon(go on to the next Stmt) or END. Returns
+ * 1 to go on to the next Stmt, 0 when the list is over, and -1 to fail straight away.
+ *
+ * A Stmt that fails without reporting anything just isn't there, which ends the list. When errors are being recovered
+ * from, a statement with an error is thrown away(ResyncStmt), a statement straight after the last with no semicolon
+ * between them is taken as the semicolon being all that is missing, and a list that doesn't end with END is thrown
+ * away up to the semicolon or END after it
+*/
+int ParserContext::NextStmt(istream& in, int& line, bool status, int errors, LexItem& l){
+	if (status){
+		l = GetNextToken(in, line);
+		if (l == SEMICOL || l == END){
+			return 1;
+		}
+		ParseError(line, "Missing Semicolon in Compound statement.");
+		if (!Recovering()){
+			return -1;
+		}
+		if (l == IDENT || l == BEGIN || l == IF || l == WRITE || l == WRITELN){
+			PushBackToken(l);
+			l = LexItem(SEMICOL, ";", line);
+			return 1;
+		}
+	} else if (error_count == errors){
+		if (l == END || !Recovering()){
+			return 0;
+		}
+		ParseError(line + 1, "Missing END in compound statement.");
+	} else if (!Recovering()){
+		return 0;
+	}
+	return ResyncStmt(in, line, l) ? 1 : -1;
+}
+
+
+//Recover from an error in PROGRAM IDENT ; by carrying on from the semicolon, or from VAR if there isn't one
+bool ParserContext::ResyncHeader(istream& in, int& line){
+	if (!Recovering()){
+		return false;
+	}
+	Token at = Resync(in, line, Bit(SEMICOL) | Bit(VAR));
+	if (at == VAR){
+		LexItem var(VAR, "var", line);
+		PushBackToken(var);
+	}
+	return at != DONE;
+}
+
+
+//Recover from an error in a DeclStmt by carrying on from the semicolon after it, or from BEGIN if the declarations end
+//first. lookAhead is left with the token after the semicolon, or with the BEGIN
+bool ParserContext::ResyncDecl(istream& in, int& line, LexItem& lookAhead){
+	if (!Recovering()){
+		return false;
+	}
+	Token at = Resync(in, line, Bit(SEMICOL) | Bit(BEGIN));
+	if (at == SEMICOL){
+		lookAhead = GetNextToken(in, line);
+	} else {
+		lookAhead = LexItem(at, "", line);
+	}
+	return at != DONE;
 }
 
 
@@ -54,69 +304,83 @@ void ParseError(int line, string msg)
  * It must then go into the Declaritive part followed by a compound statement
  * Prog ::= PROGRAM IDENT ; DeclPart CompoundStmt
 */
-bool Prog(istream& in, int& line){
+bool ParserContext::Program(istream& in, int& line){
 	bool status = false;
+	size_t mark = Mark();
 
 	//This should be the keyword "program"
-	LexItem l = Parser::GetNextToken(in, line);
+	LexItem l = GetNextToken(in, line);
 
 	//We're missing the required program keyword, throw an error and exit
 	if (l != PROGRAM){
 		ParseError(line, "Missing PROGRAM keyword.");
-		return false;
+		if (!ResyncHeader(in, line)){
+			return false;
+		}
 	} else {
 		//We have the program keyword, move on to more processing
-		l = Parser::GetNextToken(in, line);
+		l = GetNextToken(in, line);
 
 		//This token should be an IDENT if all is correct, if not we have an error
 		if (l != IDENT){
 			ParseError(line, "Missing Program name.");
-			return false;
-		}
-
-		//If we're at this point we have PROGRAM IDENT, need a semicol
-		l = Parser::GetNextToken(in, line);
-
-		//If there's no semicolon, syntax error
-		if (l != SEMICOL) {
-			ParseError(line, "Syntax Error.");
-			return false;
+			if (!ResyncHeader(in, line)){
+				return false;
+			}
+		} else {
+			//If we're at this point we have PROGRAM IDENT, need a semicol
+			l = GetNextToken(in, line);
+
+			//If there's no semicolon, syntax error
+			if (l != SEMICOL) {
+				ParseError(line, "Syntax Error.");
+				if (!ResyncHeader(in, line)){
+					return false;
+				}
+			}
 		}
+	}
 
-		//By this point, we have checked up to PROGRAM IDENT ;
-		//Check the DeclPart
-		status = DeclPart(in, line);
-		
-		//If the declaration was bad, no point in continuing
-		if (!status){
-			ParseError(line, "Incorrect Declaration Section.");
-			return false;
-		}
+	//By this point, we have checked up to PROGRAM IDENT ;
+	//Check the DeclPart
+	status = DeclPart(in, line);
+	
+	//If the declaration was bad, no point in continuing
+	if (!status){
+		ParseError(line, "Incorrect Declaration Section.");
+		return false;
+	}
 
-		//Up to here we have gotten PROGRAM IDENT ; DeclPart
-		//Check for the compound statement, make sure that there actually is a BEGIN
-		l = Parser::GetNextToken(in, line);
-		if (l != BEGIN){
-			ParseError(line, "Syntactic Error in Declaration Block.");
-			ParseError(line, "Incorrect Declaration Section");
-			return false;
-		}
+	//Up to here we have gotten PROGRAM IDENT ; DeclPart
+	//Check for the compound statement, make sure that there actually is a BEGIN
+	l = GetNextToken(in, line);
+	if (l != BEGIN){
+		ParseError(line, "Syntactic Error in Declaration Block.");
+		ParseError(line, "Incorrect Declaration Section");
+		return false;
+	}
 
-		//If we  have BEGIN, consume it and call CompoundStmt
-		status = CompoundStmt(in, line);
+	//If we  have BEGIN, consume it and call CompoundStmt
+	status = CompoundStmt(in, line);
 
-		//If the compound statement was bad, return false
-		if (!status){
-			ParseError(line, "Incorrect Program Body.");
-			return false;
-		}
+	//If the compound statement was bad, return false
+	if (!status){
+		ParseError(line, "Incorrect Program Body.");
+		return false;
+	}
 
+	//Everything pending is a declaration, except the body on top
+	if (ast != nullptr){
+		uint32_t decls = (uint32_t)(ast->Mark() - mark - 1);
+		uint32_t start = ast->TakeList(mark);
+		ast->Add(N_PROGRAM, PROGRAM, 1, start, decls);
+		ast->SetRoot(ast->Take());
 	}
 
 	//There could also be some unrecognizable token here
 	if (l == ERR) {
 		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")" << endl;
+		out << "(" << l.GetLexeme() << ")" << endl;
 		return false; 
 	}
 
@@ -125,14 +389,95 @@ bool Prog(istream& in, int& line){
 }
 
 
+/**
+ * Parse a whole program. When errors are recovered from, it only worked if there weren't any
+*/
+bool ParserContext::Prog(istream& in, int& line){
+	Ast* tree = ast;
+	int errors = firstError = error_count;
+	//A parse that failed can leave a token put back and types behind, which belong to the program before this one
+	pushed_back = false;
+	types.clear();
+
+	bool status = Program(in, line) && error_count == errors;
+
+	//An error stops the tree being built when errors are recovered from(see ParseError), so put it back for next time
+	ast = tree;
+	return status;
+}
+
+
+/**
+ * Build the syntax tree of every program parsed from now on into ast, or stop building it with nullptr
+*/
+void ParserContext::SetAst(Ast* ast){
+	this->ast = ast;
+}
+
+
+/**
+ * Parse a program that is already in memory(usually a mapped file). The grammar functions below all still take an
+ * istream, but nothing is ever read from it while a cursor is attached
+*/
+bool ParserContext::Prog(LexCursor& src, int& line){
+	static istringstream unused;
+
+	source = &src;
+	bool status = Prog(unused, line);
+	source = nullptr;
+
+	return status;
+}
+
+
+/**
+ * Parse a program as it streams in(stdin, a pipe). Only the StreamLexer's blocks are ever in memory
+*/
+bool ParserContext::Prog(StreamLexer& src, int& line){
+	static istringstream unused;
+
+	stream = &src;
+	bool status = Prog(unused, line);
+	stream = nullptr;
+
+	return status;
+}
+
+
+/**
+ * Parse a program that has already been lexed into a TokenBuffer. The grammar functions walk the buffer with a
+ * cursor index and never call the lexer
+*/
+bool ParserContext::Prog(TokenBuffer& buffer, int& line){
+	static istringstream unused;
+
+	tokens = &buffer;
+	cursor = 0;
+	fetched = 0;
+	backedUp = SIZE_MAX;
+
+	//Every identifier before the first BEGIN is at most one declaration, so the symbol table can be sized up front
+	size_t idents = 0;
+	for (size_t i = 0; i < buffer.Size() && buffer.GetToken(i) != BEGIN; i++){
+		idents += buffer.GetToken(i) == IDENT;
+	}
+	symbols.Reserve(symbols.Size() + idents);
+
+	bool status = Prog(unused, line);
+	tokens = nullptr;
+
+	return status;
+}
+
+
 /**
  * The declarative part must start with the var keyword, followed by one or more colon separated declStmt's
  * DeclPart ::= VAR DeclStmt; { DeclStmt ; }
 */
-bool DeclPart(istream& in, int& line){
+bool ParserContext::DeclPart(istream& in, int& line){
 	bool status = false;
 
-	LexItem l = Parser::GetNextToken(in, line);
+	LexItem l = GetNextToken(in, line);
 	//This first token should be VAR, if not throw an error
 	if (l != VAR){
 		ParseError(line, "Non-recognizable Declaration Part.");
@@ -143,36 +488,48 @@ bool DeclPart(istream& in, int& line){
 	//There can be as many as we like, so use iteration
 
 	//We will use this lexitem to look ahead
-	LexItem lookAhead = Parser::GetNextToken(in, line);
+	LexItem lookAhead = GetNextToken(in, line);
 	while(lookAhead == IDENT){
 		//Once we know its an ident, put it back for processing by DeclStmt
-		Parser::PushBackToken(lookAhead);
+		PushBackToken(lookAhead);
 		
 		//DeclStmt processing
 		status = DeclStmt(in, line);
 		
-		//If its a bad DeclStmt, throw error
+		//If its a bad DeclStmt, throw error. Recovering from it carries on after the semicolon that ends it
 		if (!status) {
 			ParseError(line, "Syntactic error in Declaration Block.");
-			return false;
+			if (!ResyncDecl(in, line, lookAhead)){
+				return false;
+			}
+			status = true;
+			continue;
 		}
 
 		//We had a good DeclStmt, it has to be followed by a semicol
-		l = Parser::GetNextToken(in, line);
+		l = GetNextToken(in, line);
 
 		//If no semicolon, throw syntax error
 		if (l != SEMICOL){
 			//error right here
 			ParseError(line, "Syntactic error in Declaration Block.");
-			return false;
+			//Another declaration straight after this one is taken as the semicolon being all that is missing
+			if (l == IDENT && Recovering()){
+				lookAhead = l;
+				continue;
+			}
+			if (!ResyncDecl(in, line, lookAhead)){
+				return false;
+			}
+			continue;
 		}
 
 		//Update lookahead, this will tell us if we have more declstmts
-		lookAhead = Parser::GetNextToken(in, line);
+		lookAhead = GetNextToken(in, line);
 	}
 
 	//If we get here, lookAhead must not have been an IDENT. We need to put it back for processing by the CompoundStmt block
-	Parser::PushBackToken(lookAhead);
+	PushBackToken(lookAhead);
 
 	//If we get here, our DeclPart will have been successful
 	return status;
@@ -183,9 +540,12 @@ bool DeclPart(istream& in, int& line){
  * A delcaration statement can have one or more comma separated identifiers, followed by a valid type and an optional assignment
  * DeclStmt ::= IDENT {, IDENT } : Type [:= Expr]
 */
-bool DeclStmt(istream& in, int& line){
-	//All of the variables in a declstmt are going to have the same type, store in a set for type assignment
-	set<string> tempSet;
+bool ParserContext::DeclStmt(istream& in, int& line){
+	//All of the variables in a declstmt are going to have the same type, keep their ids for type assignment
+	vector<uint32_t> declIds;
+	size_t mark = Mark();
+	int declLine = line;
+	Token type;
 
 	//Dummy lexItem to make the first iteration of the while loop run
 	LexItem lookAhead = LexItem(COMMA, ",", 0);
@@ -193,25 +553,22 @@ bool DeclStmt(istream& in, int& line){
 
 	//We should see an IDENT first
 	while (lookAhead == COMMA) {
-		l = Parser::GetNextToken(in, line);
+		l = GetNextToken(in, line);
 		//l must be an IDENT
 		if (l != IDENT) {
 			ParseError(line, "Non-indentifier declaration.");
 			return false;
 		}
 
-		//If this variable is already in defVars, we have a redeclaration, throw error
-		if (defVar.find(l.GetLexeme()) -> second){
+		//Declare it, unless it already is, which is a redeclaration
+		if (symbols.Declare(l.GetId(), line) == nullptr){
 			ParseError(line, "Variable Redefinition");
 			ParseError(line, "Incorrect identifiers list in Declaration Statement.");
 			return false;
 		}
+		declIds.push_back(l.GetId());
 
-		//If we get here, it wasn't in defVars, so we should add it
-		defVar.insert(pair<string, bool> (l.GetLexeme(), true));
-		tempSet.insert(l.GetLexeme());
-
-		lookAhead = Parser::GetNextToken(in, line);
+		lookAhead = GetNextToken(in, line);
 	}
 	
 	//If we're out of the loop, we know it wasn't a comma
@@ -232,11 +589,12 @@ bool DeclStmt(istream& in, int& line){
 
 	//following this, we need to have a type for our variables
 	//The next token should be a valid type
-	l = Parser::GetNextToken(in, line);
+	l = GetNextToken(in, line);
 	//allowed to be integer, boolean, real, string
 	if (l == STRING || l == INTEGER || l == REAL || l == BOOLEAN){
-		for(auto i : tempSet){
-			SymTable.insert(pair<string, Token> (i, l.GetToken()));
+		type = l.GetToken();
+		for(auto id : declIds){
+			symbols.Find(id)->type = type;
 		}
 	} else {
 		//Unrecognized type
@@ -247,7 +605,7 @@ bool DeclStmt(istream& in, int& line){
 	//Once we get here, we have found 
 	//DeclStmt ::= IDENT {, IDENT } : Type
 	//After type, there is an optional ASSOP, so get the next token to check
-	l = Parser::GetNextToken(in,line);
+	l = GetNextToken(in,line);
 
 	//If we find the optional ASSOP, process it
 	if (l == ASSOP){
@@ -256,16 +614,24 @@ bool DeclStmt(istream& in, int& line){
 			ParseError(line, "Invalid expression following assignment operator.");
 			return false;
 		}
+		Assign(type, PopType(), declLine);
 
 	//If its unrecognized throw and error
 	} else if (l == ERR){
 		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")";
+		out << "(" << l.GetLexeme() << ")";
 		return false;
 
 	//If we get here, l was not the optional ASSOP or ERR, push token back and return
 	} else {
-		Parser::PushBackToken(l);
+		PushBackToken(l);
+	}
+
+	//The initializer, if there was one, is pending
+	if (ast != nullptr){
+		bool init = ast->Mark() > mark;
+		uint32_t start = ast->TakeList(mark, declIds.data(), declIds.size());
+		ast->Add(init ? N_DECL_INIT : N_DECL, type, declLine, start, (uint32_t)declIds.size());
 	}
 
 	return true;
@@ -279,22 +645,22 @@ bool DeclStmt(istream& in, int& line){
 * SimpleStmt ::= AssignStmt | WriteLnStmt | WriteStmt
 * StructuredStmt ::= IfStmt | CompoundStmt
 */
-bool Stmt(istream& in, int& line) {
+bool ParserContext::Stmt(istream& in, int& line) {
 	bool status;
 	// Get the next lexItem from the instream and analyze it
-	LexItem l = Parser::GetNextToken(in, line);
+	LexItem l = GetNextToken(in, line);
 
 	// If l is uncrecognizable, no use in checking anything
 	if (l == ERR){
 		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")";
+		out << "(" << l.GetLexeme() << ")";
 		return false;
 	}
 
 	// Check if we have a structured statement
 	if (l == BEGIN || l == IF){
 		//Put token back to be reprocessed
-		Parser::PushBackToken(l);
+		PushBackToken(l);
 		return StructuredStmt(in, line);
 	}
 
@@ -302,7 +668,7 @@ bool Stmt(istream& in, int& line) {
 	// Assignments start with IDENT
 	if (l == IDENT || l == WRITE || l == WRITELN){
 		//Put token back to be reprocessed
-		Parser::PushBackToken(l);
+		PushBackToken(l);
 		status = SimpleStmt(in, line);
 
 		if(!status){
@@ -314,7 +680,7 @@ bool Stmt(istream& in, int& line) {
 	}
 
 	//We didn't find anything so push the token back
-	Parser::PushBackToken(l);
+	PushBackToken(l);
 	//Stmt was not successful if we got here
 	return false;
 }
@@ -324,9 +690,9 @@ bool Stmt(istream& in, int& line) {
 * stmt will call StructuredStmt if appropriate according to our grammar rules
 * StructuredStmt ::= IfStmt | CompoundStmt
 */
-bool StructuredStmt(istream& in, int& line){
+bool ParserContext::StructuredStmt(istream& in, int& line){
 	bool status;
-	LexItem strd = Parser::GetNextToken(in, line);
+	LexItem strd = GetNextToken(in, line);
 
 	switch (strd.GetToken()){
 		case IF:
@@ -351,29 +717,45 @@ bool StructuredStmt(istream& in, int& line){
  * Compound statements start with BEGIN and stop with END
  * CompoundStmt ::= BEGIN Stmt {; Stmt } END
 */
-bool CompoundStmt(istream& in, int& line){
+bool ParserContext::CompoundStmt(istream& in, int& line){
+	if (stackBudget != 0){
+		return RunStack(in, line, R_COMPOUND);
+	}
 	LexItem l;
 	LexItem lookAhead;
+	int blockLine = line;
+	//Every Stmt that works leaves its node pending. stmtMark is where the last one started
+	size_t mark = Mark();
+	size_t stmtMark = mark;
+	//How many errors had been reported before the last Stmt, to tell one that failed from one that wasn't there
+	int errors = error_count;
 	//If we got here we already have consumed a BEGIN
 	bool status = Stmt(in, line);
 
-
-
-	while(status) {
-		l = Parser::GetNextToken(in, line);
-		if (l != SEMICOL && l != END){
-			ParseError(line, "Missing Semicolon in Compound statement.");
+	while(true) {
+		int next = NextStmt(in, line, status, errors, l);
+		if (next < 0){
 			return false;
 		}
+		if (next == 0){
+			break;
+		}
 
+		stmtMark = Mark();
+		errors = error_count;
 		status = Stmt(in, line);
 	}
 
+	//The Stmt that ended the loop didn't work, so drop whatever it left
+	if (ast != nullptr){
+		ast->Reset(stmtMark);
+	}
+
 
 	if (l == ERR) {
 		ParseError(line, "Unrecognized Input Pattern");
 		//print out the unrecognized input
-		cout << "(" << l.GetLexeme() << ")" << endl;
+		out << "(" << l.GetLexeme() << ")" << endl;
 		return false;
 	}
 
@@ -384,6 +766,11 @@ bool CompoundStmt(istream& in, int& line){
 		return false;
 	}
 
+	if (ast != nullptr){
+		uint32_t count = (uint32_t)(ast->Mark() - mark);
+		ast->Add(N_BLOCK, BEGIN, blockLine, ast->TakeList(mark), count);
+	}
+
 	//If we make it to this point, we had valid expressions and saw END, so return true
 	return true;
 }
@@ -393,13 +780,13 @@ bool CompoundStmt(istream& in, int& line){
 * stmt will call SimpleStmt if appropriate according to our grammar rules
 * SimpleStmt ::= AssignStmt | WriteLnStmt | WriteStmt
 */
-bool SimpleStmt(istream& in, int& line){
-	LexItem smpl = Parser::GetNextToken(in, line);
+bool ParserContext::SimpleStmt(istream& in, int& line){
+	LexItem smpl = GetNextToken(in, line);
 
 	switch (smpl.GetToken()){
 		//Assignments start with identifiers
 		case IDENT:
-			Parser::PushBackToken(smpl);
+			PushBackToken(smpl);
 			return AssignStmt(in, line);
 
 		case WRITELN:
@@ -417,11 +804,13 @@ bool SimpleStmt(istream& in, int& line){
 
 //FIXME needs documentation
 //WriteLnStmt ::= writeln (ExprList) 
-bool WriteLnStmt(istream& in, int& line){
+bool ParserContext::WriteLnStmt(istream& in, int& line){
 	LexItem t;
+	size_t mark = Mark();
+	int stmtLine = line;
 	//cout << "in WriteStmt" << endl;
 	
-	t = Parser::GetNextToken(in, line);
+	t = GetNextToken(in, line);
 	if( t != LPAREN ) {
 		
 		ParseError(line, "Missing Left Parenthesis");
@@ -435,13 +824,17 @@ bool WriteLnStmt(istream& in, int& line){
 		return false;
 	}
 	
-	t = Parser::GetNextToken(in, line);
+	t = GetNextToken(in, line);
 	if(t != RPAREN ) {
 		
 		ParseError(line, "Missing Right Parenthesis");
 		return false;
 	}
 	//Evaluate: print out the list of expressions values
+	if (ast != nullptr){
+		uint32_t count = (uint32_t)(ast->Mark() - mark);
+		ast->Add(N_WRITELN, WRITELN, stmtLine, ast->TakeList(mark), count);
+	}
 
 	return ex;
 }//End of WriteLnStmt
@@ -452,9 +845,11 @@ bool WriteLnStmt(istream& in, int& line){
  * Write statements must have open and closing parenthesis with an ExprList inside
  * WriteStmt ::= write (ExprList)
 */
-bool WriteStmt(istream& in, int& line){
+bool ParserContext::WriteStmt(istream& in, int& line){
+	size_t mark = Mark();
+	int stmtLine = line;
 	//Get the token after the word "write" and check if its an lparen
-	LexItem t = Parser::GetNextToken(in, line);
+	LexItem t = GetNextToken(in, line);
 
 	//No left parenthesis is an error, create error and exit
 	if (t != LPAREN) {
@@ -472,13 +867,18 @@ bool WriteStmt(istream& in, int& line){
 	}
 
 	//Check for a right parenthesis
-	t = Parser::GetNextToken(in, line);
+	t = GetNextToken(in, line);
 	
 	if (t != RPAREN) {
 		ParseError(line, "Missing right Parenthesis");
 		return false;
 	}
 
+	if (ast != nullptr){
+		uint32_t count = (uint32_t)(ast->Mark() - mark);
+		ast->Add(N_WRITE, WRITE, stmtLine, ast->TakeList(mark), count);
+	}
+
 	return expr;
 
 }
@@ -486,8 +886,13 @@ bool WriteStmt(istream& in, int& line){
 
 // Processing all IF statements, 
 // IfStmt ::= IF Expr THEN Stmt [ ELSE Stmt ]
-bool IfStmt(istream& in, int& line){
+// Recovering from an error in the condition carries on from the THEN, or the ELSE, and from an error in the THEN part
+// carries on from the ELSE, if they come before the statement ends
+bool ParserContext::IfStmt(istream& in, int& line){
 	LexItem l;
+	size_t mark = Mark();
+	int ifLine = line;
+	Token at;
 
 	//Once this function is called, the IF token has been consumed already
 	//We should see a valid expression at this point
@@ -496,43 +901,53 @@ bool IfStmt(istream& in, int& line){
 	//if expression is not valid, throw an error
 	if(!status){
 		ParseError(line, "Invalid expression in IF statement.");
-		return false;
+		goto bad_condition;
 	}
 
-	//if we get here, then we had a valid expression. Next token must be THEN
-	l = Parser::GetNextToken(in, line);
+	//if we get here, then we had a valid expression, which has to be a boolean. Next token must be THEN
+	Condition(ifLine);
+	l = GetNextToken(in, line);
 
 	//If its unknown, throw error
 	if (l == ERR ){
 		ParseError(line, "Unrecognized Input Pattern");
-		cout << "(" << l.GetToken() << ")" << endl;
-		return false;
+		out << "(" << l.GetToken() << ")" << endl;
+		goto bad_condition;
 	}
 
 	//If its not a THEN, we have an error
 	if (l != THEN) {
 		ParseError(line, "Missing THEN in IF statement.");
-		return false;
+		goto bad_condition;
 	}
 
+then_part:
 	//If we get here, we so far have IF expr THEN, check for a valid stmt
 	status = Stmt(in, line);
 
 	//If stmt is bad, throw error
 	if(!status){
 		ParseError(line, "Invalid statement in IF statement.");
+		if (Recovering() && Resync(in, line, Bit(ELSE) | Bit(SEMICOL) | Bit(END)) == ELSE){
+			goto else_part;
+		}
 		return false;
 	}
 
 	//at this point, we can see ELSE optionally, so check for it
-	l = Parser::GetNextToken(in, line);
+	l = GetNextToken(in, line);
 
 	//If we don't see ELSE then we're done, push token back and return
 	if (l != ELSE) {
-		Parser::PushBackToken(l);
+		PushBackToken(l);
+		if (ast != nullptr){
+			uint32_t then = ast->Take();
+			ast->Add(N_IF, IF, ifLine, ast->Take(), then);
+		}
 		return status;
 	}
 
+else_part:
 	//If we get here, l was consumed and we should see a valid stmt
 	status = Stmt(in, line);
 
@@ -542,7 +957,23 @@ bool IfStmt(istream& in, int& line){
 		return false;
 	}
 
+	//Condition, then the two arms
+	if (ast != nullptr){
+		uint32_t arms = ast->TakeList(mark + 1);
+		ast->Add(N_IF_ELSE, IF, ifLine, ast->Take(), arms);
+	}
+
 	return status;
+
+bad_condition:
+	at = Recovering() ? Resync(in, line, Bit(THEN) | Bit(ELSE) | Bit(SEMICOL) | Bit(END)) : DONE;
+	if (at == THEN){
+		goto then_part;
+	}
+	if (at == ELSE){
+		goto else_part;
+	}
+	return false;
 }
 
 
@@ -550,7 +981,7 @@ bool IfStmt(istream& in, int& line){
  * Assignment Statements take in a var, ASSOP and expression
  * AssignStmt ::= Var := Expr
 */
-bool AssignStmt(istream& in, int& line){
+bool ParserContext::AssignStmt(istream& in, int& line){
 	bool status = false;
 	bool varStatus = false;
 	LexItem l;
@@ -560,7 +991,7 @@ bool AssignStmt(istream& in, int& line){
 
 	if (varStatus) {
 		//Get the next token(should be assop)
-		l = Parser::GetNextToken(in, line);
+		l = GetNextToken(in, line);
 
 		if (l == ASSOP){
 			//Analyze the expression after the assignment operator
@@ -572,11 +1003,18 @@ bool AssignStmt(istream& in, int& line){
 				return false;
 			}
 
+			Token value = PopType();
+			Assign(PopType(), value, line);
+			if (ast != nullptr){
+				uint32_t expr = ast->Take();
+				ast->Add(N_ASSIGN, ASSOP, line, ast->Take(), expr);
+			}
+
 		//Unrecognized token
 		} else if (l == ERR){
 			ParseError(line, "Unrecognized Input Pattern");
 			//print out the unrecognized input
-			cout << "(" << l.GetLexeme() << ")" << endl;
+			out << "(" << l.GetLexeme() << ")" << endl;
 			return false;
 
 		//If we get here there was no assignment operator
@@ -596,17 +1034,27 @@ bool AssignStmt(istream& in, int& line){
 
 // Check to see if the variable is valid and has previously been declared
 // Var ::= IDENT
-bool Var(istream& in, int& line){
+bool ParserContext::Var(istream& in, int& line){
 	//get the token, check to see if var was declared
-	LexItem l = Parser::GetNextToken(in, line);
+	LexItem l = GetNextToken(in, line);
+	return VarToken(l, line);
+}
 
+
+//Var, with its token already read
+bool ParserContext::VarToken(LexItem& l, int& line){
 	//If we can find the variable, return true
-	if(defVar.find(l.GetLexeme())-> second){
+	const Symbol* symbol = l == IDENT ? symbols.Find(l.GetId()) : nullptr;
+	if(symbol != nullptr){
+		if (ast != nullptr){
+			ast->Add(N_VAR, IDENT, line, l.GetId(), 0);
+		}
+		Typed(symbol->type);
 		return true;
 	//If lexeme is unrecognized, then give this error
 	} else if (l == ERR) {
 		ParseError(line, "Unrecognized Input Pattern");
-		cout << "(" << l.GetToken() << ")" << endl;
+		out << "(" << l.GetToken() << ")" << endl;
 		return false;
 	//If we get here, we have a valid variable name that was just not declared. Show appropriate error
 	} else {
@@ -623,310 +1071,207 @@ bool Var(istream& in, int& line){
 * Any expression in our grammar could optionally be a list of expressions
 * Example: writeln(str, ' to cs 280 course')
 * ExprList:= Expr {,Expr}
+* One Expr, then one more for every comma. It loops rather than calling itself for every comma, so a list can be as
+* long as it likes
 */
-bool ExprList(istream& in, int& line){
-	bool status = false;
-	//Get the first Expr, as their is always a starting expression
-	status = Expr(in, line);
-
-	//If we don't find an expression, return an error
-	if(!status){
-		ParseError(line, "Missing Expression");
-		return false;
-	}
-	
-	//Let's check if we have a comma
-	LexItem tok = Parser::GetNextToken(in, line);
-	
-	//If we do, recursively call ExprList again
-	if (tok == COMMA) {
-		status = ExprList(in, line);
-	}
-
-	//If there's an error, we have an unrecognized input pattern
-	else if(tok.GetToken() == ERR){
-		ParseError(line, "Unrecognized Input Pattern");
-		//print out the unrecognized input
-		cout << "(" << tok.GetLexeme() << ")" << endl;
-		return false;
-	}
-
-	// If there's no comma, we've reached the end. Return the token and return true
-	else {
-		Parser::PushBackToken(tok);
-		return true;
-	}
-
-	//We should never get here, added to avoid warnings
-	return status;
-}
-
-
-//Expr ::= LogOrExpr ::= LogAndExpr { OR LogAndExpr }
-//So essentially: Expr ::= LogANDExpr { OR LogAndExpr}
-bool Expr(istream& in, int& line){
-	bool status = false;
-	LexItem l;
-	
-	//Once we get here, first thing to do is call LogAndExpr
-	status = LogANDExpr(in, line);
-
-	//If expression is bad, return error
-	if (!status){
-		//ParseError(line, "Incorrect Expression");
-		return false;
-	}
+bool ParserContext::ExprList(istream& in, int& line){
+	while (true){
+		//Get the next Expr, as there is always one after a comma
+		if (!Expr(in, line)){
+			ParseError(line, "Missing Expression");
+			return false;
+		}
+		//Anything can be written
+		PopType();
 
-	//Once we're here, we can either have nothing or one or more OR's followed by more LogAndExpr
-	//Get the next token
-	l = Parser::GetNextToken(in, line);
+		//Let's check if we have a comma
+		LexItem tok = GetNextToken(in, line);
 
-	//While we have an OR, keep processing LogAndExpr's
-	while (l == OR){
-		status = LogANDExpr(in, line);
+		//If we do, go around again for the next one
+		if (tok == COMMA) {
+			continue;
+		}
 
-		//If expression is bad, return error
-		if (!status){
-			//ParseError(line, "Incorrect Expression");
+		//If there's an error, we have an unrecognized input pattern
+		if (tok == ERR){
+			ParseError(line, "Unrecognized Input Pattern");
+			//print out the unrecognized input
+			out << "(" << tok.GetLexeme() << ")" << endl;
 			return false;
 		}
 
-		//refresh the value of l
-		l = Parser::GetNextToken(in, line);
-	}
-
-	// if we have an ERR token, throw error
-	if (l == ERR) {
-		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")";
-		return false;
+		// If there's no comma, we've reached the end. Return the token and return true
+		PushBackToken(tok);
+		return true;
 	}
-
-	//Once we get here, l was not an OR, so put it back and we're done
-	Parser::PushBackToken(l);
-
-	return status;
 }
 
 
-// LogAndExpr ::= RelExpr {AND RelExpr }
-bool LogANDExpr(istream& in, int& line){
-	bool status = false;
-	LexItem l;
-
-	//Once we get here, the first thing we should do is check for a relational expression
-	status = RelExpr(in, line);
-
-	//If we have a bad relational expression, return error
-	if (!status){
-		//ParseError(line, "Syntactic error in relational expression.");
-		return false;
+/**
+ * Expressions are parsed by precedence climbing rather than one function per precedence level. Each binary operator
+ * has a level, from OR(loosest) up to the multiplying operators(tightest), and Climb parses operands joined by
+ * operators of at least the level it is given. The token after each operand is read once and handed from level to
+ * level, instead of being pushed back and read again by every level on the way out.
+ *
+ * It accepts exactly the language of the grammar it replaces, with the same errors at the same tokens:
+ * Expr ::= LogANDExpr { OR LogANDExpr }
+ * LogANDExpr ::= RelExpr { AND RelExpr }
+ * RelExpr ::= SimpleExpr [ ( = | < | > ) SimpleExpr ]
+ * SimpleExpr ::= Term { ( + | - ) Term }
+ * Term ::= SFactor { ( * | / | DIV | MOD ) SFactor }
+ * so a relational operator right after a RelExpr that already has one ends the whole expression
+*/
+enum Level { NO_LEVEL, OR_LEVEL, AND_LEVEL, REL_LEVEL, ADD_LEVEL, MUL_LEVEL };
+
+static inline int LevelOf(Token op){
+	switch (op){
+		case OR: return OR_LEVEL;
+		case AND: return AND_LEVEL;
+		case EQ: case LTHAN: case GTHAN: return REL_LEVEL;
+		case PLUS: case MINUS: return ADD_LEVEL;
+		case MULT: case DIV: case IDIV: case MOD: return MUL_LEVEL;
+		default: return NO_LEVEL;
 	}
+}
 
-	//Good first expression, check to see if we have an AND token
-	l = Parser::GetNextToken(in, line);
-
-	//So long as we keep seeing AND, keep processing tokens
-	while (l == AND){
-		//Check the next relational expression
-		status = RelExpr(in, line);
-		
-		//If its a bad expression, throw an error and stop
-		if (!status){
-			//ParseError(line, "Incorrect relational expression.");
-			return false;
-		}
 
-		//Refresh the value of l
-		l = Parser::GetNextToken(in, line);
+//SFactor, with its first token already read
+bool ParserContext::SignedFactor(istream& in, int& line, LexItem& l){
+	//Plus is a "1" in factor, negative a "2" and NOT a "3"
+	if (l == PLUS){
+		return Factor(in, line, 1);
 	}
-
-	//If we got here, we know l wasn't AND, check if it is ERR
-	if (l == ERR) {
-		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")";
-		return false;
+	if (l == MINUS) {
+		return Factor(in, line, 2);
 	}
-	
-	//If we get here, l wasn't AND or an ERR, so push it back to the stream
-	Parser::PushBackToken(l);
-
-	return status;
-}
-
-
-// RelExpr ::= SimpleExpr [ ( = | < | > ) SimpleExpr ]
-bool RelExpr(istream& in, int& line){
-	bool status;
-	LexItem l;
-
-	//We should first see a valid SimpleExpr
-	status = SimpleExpr(in, line);
-
-	if (!status) {
-		ParseError(line, "Invalid Relational Expression");
-		return false;
+	if (l == NOT) {
+		return Factor(in, line, 3);
 	}
+	//0 means we found no plus, minus or NOT
+	return FactorToken(in, line, l, 0);
+}
 
-	//If we get here we can optionally see =, < or > once
-	l = Parser::GetNextToken(in, line);
-
-	//If it is these, check for the validity of the simpleExpr
-	if (l == EQ || l == GTHAN || l == LTHAN) {
-		status = SimpleExpr(in, line);
-		if(!status) {
-			ParseError(line, "Invalid Relational Expression.");
-			return false;
-		}
-
-		//If it is valid, we're done. Simply return status.
-		return status;
-	}
 
-	//If lexeme is unknown, throw error
-	if (l == ERR) {
+//The token after an operand. Term is the level that used to read it, so an ERR here gets Term's error
+bool ParserContext::AfterOperand(istream& in, int& line, LexItem& next){
+	next = GetNextToken(in, line);
+	if (next == ERR) {
 		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")";
+		out << "(" << next.GetLexeme() << ")" << endl;
 		return false;
 	}
-
-	//If we didn't have =, < or > or ERR, push token back and return status
-	Parser::PushBackToken(l);
-	return status;
+	return true;
 }
 
 
-//SimpleExpr :: Term { ( + | - ) Term }
-bool SimpleExpr(istream& in, int& line){
-	bool status;
-	LexItem l;
-
-	//We should see a valid term first
-	status = Term(in, line);
+/**
+ * Parse operands joined by operators of at least level, leaving the token that ended them in next. invalid is
+ * RelExpr's error for when the SimpleExpr this starts with fails, which says which side of the relational operator
+ * it is on, or null when it isn't a RelExpr's to report. ended is set when the whole expression has ended
+*/
+bool ParserContext::Climb(istream& in, int& line, int level, const char* invalid, LexItem& next, bool& ended){
+	//Whether this RelExpr already has its relational operator
+	bool relational = false;
 
-	//Throw error if invalid
-	if(!status){
-		//ParseError(line, "Invalid term in expression");
-		return false;
+	LexItem l = GetNextToken(in, line);
+	if (!SignedFactor(in, line, l) || !AfterOperand(in, line, next)){
+		goto fail;
 	}
 
-	//once we're here, we can see 0 or many + and -
-	l = Parser::GetNextToken(in, line);
+	while (true){
+		int op = LevelOf(next.GetToken());
+		if (op < level){
+			return true;
+		}
+		if (op == REL_LEVEL && relational){
+			ended = true;
+			return true;
+		}
+		Token t = next.GetToken();
 
-	//So long as we have plus or minus, we keep processing
-	while (l == PLUS || l == MINUS) {
-		status = Term(in, line);
+		if (op == MUL_LEVEL){
+			l = GetNextToken(in, line);
+			if (!SignedFactor(in, line, l)) {
+				ParseError(line, "Missing operand after operator.");
+				goto fail;
+			}
+			Binary(t, line);
+			if (!AfterOperand(in, line, next)){
+				goto fail;
+			}
+			continue;
+		}
 
-		//If we have a bad term, throw error
-		if(!status) {
-			//ParseError(line, "Invalid term in expression.");
+		//The right side of + and - is part of this SimpleExpr, so this level reports it failing. The right sides of the
+		//other operators start SimpleExprs of their own, which report themselves
+		if (op == ADD_LEVEL){
+			if (!Climb(in, line, MUL_LEVEL, nullptr, next, ended)){
+				goto fail;
+			}
+		} else if (!Climb(in, line, op + 1, op == REL_LEVEL ? "Invalid Relational Expression." : "Invalid Relational Expression", next, ended)){
 			return false;
 		}
-
-		//Refresh l
-		l = Parser::GetNextToken(in, line);
+		Binary(t, line);
+		if (ended){
+			return true;
+		}
+		relational = relational || op == REL_LEVEL;
 	}
 
-	//If lexeme is unknown, throw error
-	if (l == ERR) {
-		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")";
-		return false;
+fail:
+	if (invalid != nullptr){
+		ParseError(line, invalid);
 	}
-
-	//Once we're here, we know l wasn't + or -, so we're done
-	//Push l back and return status
-	Parser::PushBackToken(l);
-	return status;
+	return false;
 }
 
 
-//Term ::= SFactor { ( * | / | DIV | MOD ) SFactor }
-bool Term(istream& in, int& line){
-	bool status;
-	LexItem l;
-
-	//We must first see a valid Sfactor
-	status = SFactor(in, line);
-
-	//If SFactor is bad, no point in continuing
-	if (!status) {
-		//ParseError(line, "Bad SFactor in term.");
-		return false;
-	}
-
-	//We can now see one or more *, /, DIV, or MODs followed by sfactors
-	l = Parser::GetNextToken(in, line);
-
-	//If we have any of these, process the next sfactor
-	while (l == MULT || l == DIV || l == IDIV || l == MOD) {
-		status = SFactor(in, line);
-
-		//If SFactor is bad, no point in continuing
-		if (!status) {
-			ParseError(line, "Missing operand after operator.");
-			return false;
-		}
-
-		//Refresh l
-		l = Parser::GetNextToken(in, line);
+//Expr ::= LogOrExpr ::= LogAndExpr { OR LogAndExpr }
+//So essentially: Expr ::= LogANDExpr { OR LogAndExpr}
+bool ParserContext::Expr(istream& in, int& line){
+	if (stackBudget != 0){
+		return RunStack(in, line, R_EXPR);
 	}
+	LexItem next;
+	bool ended = false;
 
-	//If we get here, we've had valid sfactors and l is no longer *. /, MOD or DIV
-	//make sure l isn't an ERR
-	if (l == ERR) {
-		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")" << endl;
+	if (!Climb(in, line, OR_LEVEL, "Invalid Relational Expression", next, ended)){
 		return false;
 	}
 
-	//If no error, push token back and return status
-	Parser::PushBackToken(l);
-	return status;
+	//Whatever ended the expression belongs to the caller
+	PushBackToken(next);
+	return true;
 }
 
 
 // SFactor can have an optional sign in front of it
 // SFactor ::= [( - | + | NOT )] Factor
-bool SFactor(istream& in, int& line){
-	
+bool ParserContext::SFactor(istream& in, int& line){
 	//Get the token for processing
-	LexItem l = Parser::GetNextToken(in, line); 
-
-	//Plus is a "1" in factor
-	if (l == PLUS){
-		return Factor(in, line, 1);
-	}
-
-	//Negative is a "2" in factor
-	if (l == MINUS) {
-		return Factor(in, line, 2);
-	}
-
-	//NOT is a "3" in factor
-	if (l == NOT) {
-		return Factor(in, line, 3);
-	}
-
-	//If l is not +, - or NOT, push token back and let factor handle it
-	Parser::PushBackToken(l);
-	//0 means we found no plus, minus or NOT
-	return Factor(in, line, 0);
+	LexItem l = GetNextToken(in, line); 
+	return SignedFactor(in, line, l);
 }
 
 
 //Factor must be a predeclared identifier or a constant, or an optional expr in parenthesis
 //Sign is 0 if no sign, 1 if positive(+), 2 if negative(-), 3 if NOT
 //Factor ::= IDENT | ICONST | RCONST | SCONST | BCONST | (Expr)
-bool Factor(istream& in, int& line, int sign){
-	bool status;
+bool ParserContext::Factor(istream& in, int& line, int sign){
 	//get and check our first token
-	LexItem l = Parser::GetNextToken(in, line);
+	LexItem l = GetNextToken(in, line);
+	return FactorToken(in, line, l, sign);
+}
+
+
+//Factor, with its first token already read
+bool ParserContext::FactorToken(istream& in, int& line, LexItem& l, int sign){
+	bool status = false;
 
 	//If the token is an error, no bother in further processing
 	if (l == ERR){
 		ParseError(line, "Unrecognized input pattern.");
-		cout << "(" << l.GetLexeme() << ")";
+		out << "(" << l.GetLexeme() << ")";
 		return false;
 	}
 
@@ -938,9 +1283,8 @@ bool Factor(istream& in, int& line, int sign){
 			return false;
 		}
 		
-		//If we get here, ident was fine, push back and let Var handle it
-		Parser::PushBackToken(l);
-		return Var(in, line);
+		//If we get here, ident was fine, let Var handle it
+		return VarToken(l, line);
 	}
 
 	//Check SCONST
@@ -950,6 +1294,10 @@ bool Factor(istream& in, int& line, int sign){
 			ParseError(line, "Illegal use of a sign before a string constant.");
 			return false;
 		}
+		if (ast != nullptr){
+			ast->Add(N_SCONST, SCONST, line, l.GetLexemeId(), 0);
+		}
+		Typed(STRING);
 		//if we pass this condition then its true
 		return true;
 	}
@@ -962,6 +1310,15 @@ bool Factor(istream& in, int& line, int sign){
 			return false;
 		}
 
+		if (ast != nullptr){
+			if (l == ICONST){
+				ast->Add(N_ICONST, ICONST, line, (uint32_t)l.GetIntValue(), 0);
+			} else {
+				ast->AddReal(l.GetRealValue(), line);
+			}
+		}
+		Typed(l == ICONST ? INTEGER : REAL);
+		Sign(sign, line);
 		return true;
 	}
 
@@ -973,6 +1330,11 @@ bool Factor(istream& in, int& line, int sign){
 			return false;
 		}
 
+		if (ast != nullptr){
+			ast->Add(N_BCONST, BCONST, line, (l.GetLexeme()[0] | 0x20) == 't' ? 1 : 0, 0);
+		}
+		Typed(BOOLEAN);
+		Sign(sign, line);
 		return true;
 	}
 
@@ -987,18 +1349,472 @@ bool Factor(istream& in, int& line, int sign){
 		}
 
 		//Ensure that there is a closing rparen
-		l = Parser::GetNextToken(in, line);
+		l = GetNextToken(in, line);
 		if (l != RPAREN){
 			ParseError(line, "Missing Right Parenthesis");
 			return false;
 		}
+		Sign(sign, line);
 	}
 
 	return status;
 }
 
 
+/**
+ * Explicit stack mode. The rules that can nest inside themselves(statements through BEGIN and IF, expressions
+ * through parentheses) get a frame each on a stack on the heap instead of a call, so how deep a program can nest is
+ * up to the memory budget and not the size of the C stack. Each rule is the function of the same name cut into the
+ * pieces between the points where it calls another rule: pc says which piece to run next, and the rule called leaves
+ * whether it worked in result when its frame is popped. The errors are the same ones, at the same tokens, in the same
+ * order. Rules that never nest(Var, Factor on anything but a parenthesis) are called as they are
+*/
+struct ParserContext::Frame {
+	Rule	rule;
+	uint8_t	pc;
+	//Climb: its level, whether its RelExpr has its operator yet, and the operator waiting for its right side
+	uint8_t	level;
+	bool	relational;
+	Token	op;
+	const char*	invalid;
+	//The line the rule started on(Paren: its sign instead)
+	int	n;
+	//Compound: how many errors had been reported before its last statement
+	int	errors;
+	//Pending syntax tree nodes when the rule started, and CompoundStmt's when its last statement started
+	size_t	mark;
+	size_t	stmtMark;
+	//Assign: its identifier. Compound: the token after its last statement. Write: whether it is a writeln
+	LexItem	l;
+	bool	writeln;
+};
+
+//A new frame for rule, or false if it wouldn't fit in the budget
+bool ParserContext::Push(Rule rule, int line){
+	if ((frames.size() + 1) * sizeof(Frame) > stackBudget){
+		return false;
+	}
+	Frame f = {};
+	f.rule = rule;
+	f.n = line;
+	f.mark = Mark();
+	frames.push_back(f);
+	return true;
+}
+
+
+/**
+ * Run rule to the end on the explicit stack. Rules call each other by setting where they carry on from in their pc and
+ * pushing a frame, or, for a rule that never nests, by setting result straight away; either way the loop then goes
+ * back to whichever frame is on top
+*/
+bool ParserContext::RunStack(istream& in, int& line, Rule rule){
+	bool result = false;
+	//Climb's token after the last operand and whether the expression has ended, shared the way Climb shares them
+	LexItem next;
+	bool ended = false;
+	LexItem l;
+
+	//Start an SFactor whose first token is l. Only a parenthesis needs a frame
+	auto operand = [&](LexItem l){
+		int sign = l == PLUS ? 1 : l == MINUS ? 2 : l == NOT ? 3 : 0;
+		if (sign != 0){
+			l = GetNextToken(in, line);
+		}
+		if (l != LPAREN){
+			result = FactorToken(in, line, l, sign);
+			return true;
+		}
+		if (!Push(R_PAREN, line)){
+			return false;
+		}
+		frames.back().n = sign;
+		return true;
+	};
+
+	//Start a Stmt. Only the statements that can hold others need a frame
+	auto statement = [&](){
+		LexItem l = GetNextToken(in, line);
+		switch (l.GetToken()){
+			case ERR:
+				ParseError(line, "Unrecognized input pattern.");
+				out << "(" << l.GetLexeme() << ")";
+				result = false;
+				return true;
+			case BEGIN:
+				return Push(R_COMPOUND, line);
+			case IF:
+				return Push(R_IF, line);
+			case IDENT:
+				if (!Push(R_ASSIGN, line)){
+					return false;
+				}
+				frames.back().l = l;
+				return true;
+			case WRITE:
+			case WRITELN:
+				if (!Push(R_WRITE, line)){
+					return false;
+				}
+				frames.back().writeln = l == WRITELN;
+				return true;
+			default:
+				PushBackToken(l);
+				result = false;
+				return true;
+		}
+	};
+
+	//Pop the top frame, handing value back to the frame under it
+	#define RETURN(value) { result = (value); frames.pop_back(); continue; }
+	//Have the top frame carry on at resume once call has run
+	#define CALL(resume, call) { frames.back().pc = (resume); if (!(call)) goto overflow; continue; }
+
+	frames.clear();
+	if (!Push(rule, line)){
+		goto overflow;
+	}
+	while (!frames.empty()){
+		Frame& f = frames.back();
+		switch (f.rule){
+			case R_EXPR:
+				if (f.pc == 0){
+					ended = false;
+					CALL(1, Push(R_CLIMB, line) && (frames.back().level = OR_LEVEL, frames.back().invalid = "Invalid Relational Expression", true));
+				}
+				ended = false;
+				if (!result){
+					RETURN(false);
+				}
+				//Whatever ended the expression belongs to the caller
+				PushBackToken(next);
+				RETURN(true);
+
+			case R_CLIMB:
+				switch (f.pc){
+					case 0:
+						l = GetNextToken(in, line);
+						CALL(1, operand(l));
+					case 1:
+						if (!result || !AfterOperand(in, line, next)){
+							goto climb_fail;
+						}
+						break;
+					case 2:
+						if (!result){
+							ParseError(line, "Missing operand after operator.");
+							goto climb_fail;
+						}
+						Binary(f.op, line);
+						if (!AfterOperand(in, line, next)){
+							goto climb_fail;
+						}
+						break;
+					case 3:
+						if (!result){
+							goto climb_fail;
+						}
+						Binary(f.op, line);
+						if (ended){
+							RETURN(true);
+						}
+						break;
+					case 4:
+						if (!result){
+							RETURN(false);
+						}
+						Binary(f.op, line);
+						if (ended){
+							RETURN(true);
+						}
+						f.relational = f.relational || LevelOf(f.op) == REL_LEVEL;
+						break;
+				}
+				{
+					int op = LevelOf(next.GetToken());
+					if (op < f.level){
+						RETURN(true);
+					}
+					if (op == REL_LEVEL && f.relational){
+						ended = true;
+						RETURN(true);
+					}
+					f.op = next.GetToken();
+					if (op == MUL_LEVEL){
+						l = GetNextToken(in, line);
+						CALL(2, operand(l));
+					}
+					const char* invalid = op == ADD_LEVEL ? nullptr : op == REL_LEVEL ? "Invalid Relational Expression."
+						: "Invalid Relational Expression";
+					CALL(op == ADD_LEVEL ? 3 : 4, Push(R_CLIMB, line)
+						&& (frames.back().level = op + 1, frames.back().invalid = invalid, true));
+				}
+			climb_fail:
+				if (f.invalid != nullptr){
+					ParseError(line, f.invalid);
+				}
+				RETURN(false);
+
+			case R_PAREN:
+				if (f.pc == 0){
+					CALL(1, Push(R_EXPR, line));
+				}
+				if (!result){
+					ParseError(line, "Invalid Expression.");
+					RETURN(false);
+				}
+				l = GetNextToken(in, line);
+				if (l != RPAREN){
+					ParseError(line, "Missing Right Parenthesis");
+					RETURN(false);
+				}
+				Sign(f.n, line);
+				RETURN(true);
+
+			case R_COMPOUND:
+				if (f.pc == 0){
+					f.stmtMark = f.mark;
+					f.errors = error_count;
+					CALL(1, statement());
+				}
+				{
+					int more = NextStmt(in, line, result, f.errors, f.l);
+					if (more < 0){
+						RETURN(false);
+					}
+					if (more > 0){
+						f.stmtMark = Mark();
+						f.errors = error_count;
+						CALL(1, statement());
+					}
+				}
+				//The Stmt that ended the loop didn't work, so drop whatever it left
+				if (ast != nullptr){
+					ast->Reset(f.stmtMark);
+				}
+				if (f.l == ERR) {
+					ParseError(line, "Unrecognized Input Pattern");
+					out << "(" << f.l.GetLexeme() << ")" << endl;
+					RETURN(false);
+				}
+				if (f.l != END) {
+					line++;
+					ParseError(line, "Missing END in compound statement.");
+					RETURN(false);
+				}
+				if (ast != nullptr){
+					uint32_t count = (uint32_t)(ast->Mark() - f.mark);
+					ast->Add(N_BLOCK, BEGIN, f.n, ast->TakeList(f.mark), count);
+				}
+				RETURN(true);
+
+			case R_IF:
+				switch (f.pc){
+					case 0:
+						CALL(1, Push(R_EXPR, line));
+					case 1:
+						if (!result){
+							ParseError(line, "Invalid expression in IF statement.");
+							goto if_condition;
+						}
+						Condition(f.n);
+						l = GetNextToken(in, line);
+						if (l == ERR ){
+							ParseError(line, "Unrecognized Input Pattern");
+							out << "(" << l.GetToken() << ")" << endl;
+							goto if_condition;
+						}
+						if (l != THEN) {
+							ParseError(line, "Missing THEN in IF statement.");
+							goto if_condition;
+						}
+						CALL(2, statement());
+					case 2:
+						if (!result){
+							ParseError(line, "Invalid statement in IF statement.");
+							if (Recovering() && Resync(in, line, Bit(ELSE) | Bit(SEMICOL) | Bit(END)) == ELSE){
+								CALL(3, statement());
+							}
+							goto if_fail;
+						}
+						l = GetNextToken(in, line);
+						if (l != ELSE) {
+							PushBackToken(l);
+							if (ast != nullptr){
+								uint32_t then = ast->Take();
+								ast->Add(N_IF, IF, f.n, ast->Take(), then);
+							}
+							RETURN(true);
+						}
+						CALL(3, statement());
+					default:
+						if (!result){
+							ParseError(line, "Invalid statement after ELSE in IF statement");
+							goto if_fail;
+						}
+						if (ast != nullptr){
+							uint32_t arms = ast->TakeList(f.mark + 1);
+							ast->Add(N_IF_ELSE, IF, f.n, ast->Take(), arms);
+						}
+						RETURN(true);
+				}
+			if_condition:
+				//IfStmt's recovery from an error in the condition
+				{
+					Token at = Recovering() ? Resync(in, line, Bit(THEN) | Bit(ELSE) | Bit(SEMICOL) | Bit(END)) : DONE;
+					if (at == THEN){
+						CALL(2, statement());
+					}
+					if (at == ELSE){
+						CALL(3, statement());
+					}
+				}
+			if_fail:
+				//What StructuredStmt adds when an IfStmt fails
+				ParseError(line, "Bad structured statement.");
+				RETURN(false);
+
+			case R_ASSIGN:
+				if (f.pc == 0){
+					if (!VarToken(f.l, line)){
+						ParseError(line, "Missing Left-Hand Side Variable in Assignment statement");
+						goto simple_fail;
+					}
+					l = GetNextToken(in, line);
+					if (l == ASSOP){
+						CALL(1, Push(R_EXPR, line));
+					}
+					if (l == ERR){
+						ParseError(line, "Unrecognized Input Pattern");
+						out << "(" << l.GetLexeme() << ")" << endl;
+					} else {
+						ParseError(line, "Missing Assignment Operator in AssignStmt");
+					}
+					goto simple_fail;
+				}
+				if (!result){
+					ParseError(line, "Bad Expression in Assignment Statement");
+					goto simple_fail;
+				}
+				{
+					Token value = PopType();
+					Assign(PopType(), value, line);
+				}
+				if (ast != nullptr){
+					uint32_t expr = ast->Take();
+					ast->Add(N_ASSIGN, ASSOP, line, ast->Take(), expr);
+				}
+				RETURN(true);
+
+			case R_WRITE:
+				if (f.pc == 0){
+					l = GetNextToken(in, line);
+					if (l != LPAREN) {
+						ParseError(line, "Missing Left Parenthesis");
+						goto simple_fail;
+					}
+					CALL(1, Push(R_EXPR, line));
+				}
+				//ExprList, one Expr at a time
+				if (!result){
+					ParseError(line, "Missing Expression");
+					goto write_fail;
+				}
+				PopType();
+				l = GetNextToken(in, line);
+				if (l == COMMA){
+					CALL(1, Push(R_EXPR, line));
+				}
+				if (l == ERR){
+					ParseError(line, "Unrecognized Input Pattern");
+					out << "(" << l.GetLexeme() << ")" << endl;
+					goto write_fail;
+				}
+				//The end of the list, which has to be the end of the statement
+				if (l != RPAREN) {
+					ParseError(line, f.writeln ? "Missing Right Parenthesis" : "Missing right Parenthesis");
+					goto simple_fail;
+				}
+				if (ast != nullptr){
+					uint32_t count = (uint32_t)(ast->Mark() - f.mark);
+					ast->Add(f.writeln ? N_WRITELN : N_WRITE, f.writeln ? WRITELN : WRITE, f.n,
+						ast->TakeList(f.mark), count);
+				}
+				RETURN(true);
+			write_fail:
+				ParseError(line, f.writeln ? "Missing expression list for WriteLn statement"
+					: "Missing expression list for Write statement");
+			simple_fail:
+				//What Stmt adds when a SimpleStmt fails
+				ParseError(line, "Incorrect Simple Statement.");
+				RETURN(false);
+		}
+	}
+	#undef RETURN
+	#undef CALL
+	return result;
+
+overflow:
+	ParseError(line, "Program nested too deeply for the parser's stack budget.");
+	frames.clear();
+	return false;
+}
+
+
+/**
+ * Parse statements and expressions on an explicit stack of at most budget bytes from now on, or by recursion again
+ * with 0
+*/
+void ParserContext::SetStackBudget(size_t budget){
+	stackBudget = budget;
+	if (budget == 0){
+		vector<Frame>().swap(frames);
+	}
+}
+
+
+/**
+ * Recover from syntax errors and carry on parsing until limit errors have been reported, so one pass reports every
+ * error in a program rather than just the first. 0 stops at the first error
+*/
+void ParserContext::SetErrorLimit(int limit){
+	errorLimit = limit;
+}
+
+
+/**
+ * The free functions, on the calling thread's default context
+*/
+ParserContext& DefaultParser(){
+	static thread_local ParserContext context;
+	return context;
+}
+
+bool Prog(istream& in, int& line){ return DefaultParser().Prog(in, line); }
+bool Prog(LexCursor& src, int& line){ return DefaultParser().Prog(src, line); }
+bool Prog(TokenBuffer& tokens, int& line){ return DefaultParser().Prog(tokens, line); }
+bool Prog(StreamLexer& src, int& line){ return DefaultParser().Prog(src, line); }
+void SetAst(Ast* ast){ DefaultParser().SetAst(ast); }
+void ResetParser(){ DefaultParser().Reset(); }
+void SetStackBudget(size_t budget){ DefaultParser().SetStackBudget(budget); }
+void SetErrorLimit(int limit){ DefaultParser().SetErrorLimit(limit); }
+bool DeclPart(istream& in, int& line){ return DefaultParser().DeclPart(in, line); }
+bool DeclStmt(istream& in, int& line){ return DefaultParser().DeclStmt(in, line); }
+bool Stmt(istream& in, int& line){ return DefaultParser().Stmt(in, line); }
+bool StructuredStmt(istream& in, int& line){ return DefaultParser().StructuredStmt(in, line); }
+bool CompoundStmt(istream& in, int& line){ return DefaultParser().CompoundStmt(in, line); }
+bool SimpleStmt(istream& in, int& line){ return DefaultParser().SimpleStmt(in, line); }
+bool WriteLnStmt(istream& in, int& line){ return DefaultParser().WriteLnStmt(in, line); }
+bool WriteStmt(istream& in, int& line){ return DefaultParser().WriteStmt(in, line); }
+bool IfStmt(istream& in, int& line){ return DefaultParser().IfStmt(in, line); }
+bool AssignStmt(istream& in, int& line){ return DefaultParser().AssignStmt(in, line); }
+bool Var(istream& in, int& line){ return DefaultParser().Var(in, line); }
+bool ExprList(istream& in, int& line){ return DefaultParser().ExprList(in, line); }
+bool Expr(istream& in, int& line){ return DefaultParser().Expr(in, line); }
+bool SFactor(istream& in, int& line){ return DefaultParser().SFactor(in, line); }
+bool Factor(istream& in, int& line, int sign){ return DefaultParser().Factor(in, line, sign); }
+
 // A simple wrapper that allows access to the number of syntax errors
 int ErrCount(){
-    return error_count;
+    return DefaultParser().ErrCount();
 }
@@ -1,4 +1,4 @@
-/* 
+/*
  * parser.h
  * Programming Assignment 2
  * Fall 2023
@@ -8,14 +8,155 @@
 #define PARSER_H_
 
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
 #include "lex.h"
+#include "symtab.h"
 
+class TokenBuffer;
+class StreamLexer;
+class Ast;
+
+
+/**
+ * Class definition of ParserContext. Everything one parser works with: where its tokens come from and the token it
+ * has put back, the symbol tables, its errors and where they are written, and its settings. Contexts share nothing,
+ * so any number of programs can be parsed at once on different threads, one context each. Identifier ids come from
+ * the thread's own interner(intern.h), so a context's symbol tables go with the thread that parsed with it.
+ *
+ * Types are checked as the program is parsed, with the rules the compiler picks its instructions by(BinaryOp in
+ * bytecode.h). Every expression gets its type as soon as it is parsed, an integer is promoted where a real is wanted,
+ * and a type error is reported and counted like a syntax error but doesn't stop the parse. An expression that has
+ * an error in it has the type ERR, which takes no part in any further errors, so one mistake is reported once.
+ *
+ * The free functions below are the same thing on a default context, one per thread
+*/
+class ParserContext {
+public:
+	//Errors are written to errors as they are found
+	ParserContext(ostream& errors = cout);
+	~ParserContext();
+
+	bool	Prog(istream& in, int& line);
+	bool	Prog(LexCursor& src, int& line);
+	bool	Prog(TokenBuffer& tokens, int& line);
+	bool	Prog(StreamLexer& src, int& line);
+
+	void	SetAst(Ast* ast);
+	void	Reset();
+	void	SetStackBudget(size_t budget);
+	void	SetErrorLimit(int limit);
+	int	GetErrorLimit() const { return errorLimit; }
+	size_t	GetStackBudget() const { return stackBudget; }
+	int	ErrCount() const { return error_count; }
+	//Report an error and count it. Syntax and type errors both come through here
+	void	ParseError(int line, string msg);
+
+	//Has this identifier id been declared, and with what type(ERR if it hasn't)
+	bool	IsDeclared(uint32_t id) const { return symbols.Find(id) != nullptr; }
+	Token	TypeOf(uint32_t id) const { const Symbol* s = symbols.Find(id); return s ? s->type : ERR; }
+	//Every variable declared so far
+	const SymbolTable&	Symbols() const { return symbols; }
+
+	bool	DeclPart(istream& in, int& line);
+	bool	DeclStmt(istream& in, int& line);
+	bool	Stmt(istream& in, int& line);
+	bool	StructuredStmt(istream& in, int& line);
+	bool	CompoundStmt(istream& in, int& line);
+	bool	SimpleStmt(istream& in, int& line);
+	bool	WriteLnStmt(istream& in, int& line);
+	bool	WriteStmt(istream& in, int& line);
+	bool	IfStmt(istream& in, int& line);
+	bool	AssignStmt(istream& in, int& line);
+	bool	Var(istream& in, int& line);
+	bool	ExprList(istream& in, int& line);
+	bool	Expr(istream& in, int& line);
+	bool	SFactor(istream& in, int& line);
+	bool	Factor(istream& in, int& line, int sign);
+
+private:
+	//The rules the explicit stack parser keeps frames for, and a frame
+	enum Rule : uint8_t;
+	struct Frame;
+
+	ostream&	out;
+
+	//Every variable that has been declared in the program thus far, with its type
+	SymbolTable	symbols;
+	//The type of every expression parsed but not yet used, newest last. Every expression rule that succeeds
+	//leaves one, like the syntax tree's pending nodes
+	vector<Token>	types;
+	int	error_count;
+
+	bool	pushed_back;
+	LexItem	pushed_token;
+	//When set, tokens come from this in-memory buffer instead of the istream
+	LexCursor*	source;
+	//When set, tokens come from this stream a block at a time
+	StreamLexer*	stream;
+	//When set, tokens come from this pre-lexed buffer. cursor is the index of the next token, and fetched is how
+	//many tokens have been handed out so far, so line only moves forward the first time a token is seen
+	TokenBuffer*	tokens;
+	size_t	cursor;
+	size_t	fetched;
+	//The last token the lexer handed out, or ERR once it has been pushed back. With a token buffer it is worked out
+	//from the cursor instead(see LastToken), and backedUp is where the cursor was last backed up to
+	Token	last;
+	size_t	backedUp;
+
+	//When set, the grammar functions build the syntax tree into it as they go. Every rule that succeeds leaves
+	//exactly one node pending for the rule above it to claim. When it isn't set nothing is built
+	Ast*	ast;
+	//When not 0, statements and expressions are parsed on an explicit stack of at most this many bytes instead of by
+	//recursion(see RunStack)
+	size_t	stackBudget;
+	vector<Frame>	frames;
+	//When not 0, syntax errors are recovered from and parsing carries on, until this many have been reported
+	int	errorLimit;
+	//error_count when the program being parsed began
+	int	firstError;
+
+	LexItem	GetNextToken(istream& in, int& line);
+	void	PushBackToken(LexItem& t);
+	Token	LastToken() const;
+	void	Binary(Token op, int line);
+	void	Sign(int sign, int line);
+	void	Typed(Token type);
+	Token	PopType();
+	void	Assign(Token var, Token value, int line);
+	void	Condition(int line);
+	void	TypeError(int line, const char* msg);
+	size_t	Mark() const;
+
+	bool	Program(istream& in, int& line);
+	bool	VarToken(LexItem& l, int& line);
+	bool	FactorToken(istream& in, int& line, LexItem& l, int sign);
+	bool	SignedFactor(istream& in, int& line, LexItem& l);
+	bool	AfterOperand(istream& in, int& line, LexItem& next);
+	bool	Climb(istream& in, int& line, int level, const char* invalid, LexItem& next, bool& ended);
+
+	bool	Recovering() const { return errorLimit != 0 && error_count < errorLimit; }
+	Token	Resync(istream& in, int& line, uint64_t stops);
+	bool	ResyncStmt(istream& in, int& line, LexItem& l);
+	bool	ResyncHeader(istream& in, int& line);
+	bool	ResyncDecl(istream& in, int& line, LexItem& lookAhead);
+	int	NextStmt(istream& in, int& line, bool status, int errors, LexItem& l);
+
+	bool	Push(Rule rule, int line);
+	bool	RunStack(istream& in, int& line, Rule rule);
+};
 
 
 extern bool Prog(istream& in, int& line);
+extern bool Prog(LexCursor& src, int& line);
+extern bool Prog(TokenBuffer& tokens, int& line);
+extern bool Prog(StreamLexer& src, int& line);
+extern void SetAst(Ast* ast);
+extern void ResetParser();
+extern void SetStackBudget(size_t budget);
+extern void SetErrorLimit(int limit);
 extern bool DeclPart(istream& in, int& line);
 extern bool DeclStmt(istream& in, int& line);
 extern bool Stmt(istream& in, int& line);
@@ -29,12 +170,11 @@ extern bool AssignStmt(istream& in, int& line);
 extern bool Var(istream& in, int& line);
 extern bool ExprList(istream& in, int& line);
 extern bool Expr(istream& in, int& line);
-extern bool LogANDExpr(istream& in, int& line);
-extern bool RelExpr(istream& in, int& line);
-extern bool SimpleExpr(istream& in, int& line);
-extern bool Term(istream& in, int& line);
 extern bool SFactor(istream& in, int& line);
 extern bool Factor(istream& in, int& line, int sign);
 extern int ErrCount();
 
+//The calling thread's default context, the one the functions above use
+extern ParserContext& DefaultParser();
+
 #endif /* PARSE_H_ */
@@ -9,6 +9,24 @@
 
 //#include "lex.h"
 #include "parser.h"
+#include "source.h"
+#include "tokens.h"
+#include "stream.h"
+#include "tokdump.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "ssa.h"
+#include "cgen.h"
+#include "vm.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include <sstream>
+#include <thread>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
 //#include "parser.cpp"
 
 
@@ -17,48 +35,429 @@ using namespace std;
 //extern int error_count;
 
 
+//Read everything left on fd
+static string ReadAll(int fd)
+{
+	string text;
+	char block[1 << 16];
+	ssize_t got;
+	while( (got = read(fd, block, sizeof(block))) != 0 )
+	{
+		if( got < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if( got < 0 )
+		{
+			break;
+		}
+		text.append(block, got);
+	}
+	return text;
+}
+
+
 int main(int argc, char *argv[])
 {
 	int lineNumber = 1;
 
-	istream *in = NULL;
-	ifstream file;
+	string filename;
+	bool named = false;
+	//Regular files are mapped and lexed in place, everything else(pipes, "-" for stdin) is streamed in blocks
+	SourceBuffer source;
+	bool mapped = false;
+	int fd = -1;
+	//--pretokenize lexes the whole file into a TokenBuffer(on every core) before parsing starts
+	bool pretokenize = false;
+	//--tokens dumps the tokens to stdout as text instead of parsing, --tokens=binary as binary records(tokdump.h)
+	bool dump = false;
+	bool binary = false;
+	//--ast prints the syntax tree of a program that parses, and how big it is to stderr
+	bool tree = false;
+	//--run compiles a program that parses and runs it, --bytecode prints what it compiles to instead
+	bool run = false;
+	bool listing = false;
+	//--optimize runs what it compiles through the SSA optimizer(ssa.h) first
+	bool optimize = false;
+	//--c prints the program translated to C(cgen.h), --native[=exe] builds that into an executable(a.out by default)
+	bool translate = false;
+	bool native = false;
+	string exe = "a.out";
+	//--explicit-stack[=MB] parses on a heap stack of at most that many MB(256 by default) instead of by recursion, so
+	//programs can nest as deep as memory allows
+	size_t stackBudget = 0;
+	//--recover[=N] carries on past syntax errors to report every one, up to N of them(100 by default)
+	int errorLimit = 0;
+	//--batch parses every file named(and every file listed in --manifest=FILE, one per line) on --jobs=N threads(one
+	//per core by default), and prints their results in the order given followed by a summary
+	bool batch = false;
+	vector<string> files;
+	unsigned jobs = thread::hardware_concurrency();
+	//--serve=SOCKET answers parse and run requests on a Unix domain socket(server.h) until it is stopped.
+	//--load=SOCKET sends --requests=N of the files named(as --run requests with --run) to one over --jobs=N
+	//connections, and reports the latencies
+	string serve;
+	string load;
+	size_t requests = 1000;
+	//--cache=DIR keeps what parsing each program came to in DIR(cache.h), at most --cache-size=MB of it, so a program
+	//that hasn't changed isn't parsed again
+	string cacheDir;
+	uint64_t cacheBytes = ParseCache::DEFAULT_BYTES;
 		
 	for( int i=1; i<argc; i++ )
     {
 		string arg = argv[i];
 		
-		if( in != NULL ) 
+		if( arg == "--pretokenize" )
+		{
+			pretokenize = true;
+		}
+		else if( arg == "--tokens" || arg == "--tokens=text" || arg == "--tokens=binary" )
+		{
+			dump = true;
+			binary = arg == "--tokens=binary";
+		}
+		else if( arg == "--ast" )
+		{
+			tree = true;
+		}
+		else if( arg == "--run" )
+		{
+			run = true;
+		}
+		else if( arg == "--bytecode" )
+		{
+			listing = true;
+		}
+		else if( arg == "--optimize" )
+		{
+			optimize = true;
+		}
+		else if( arg == "--explicit-stack" || arg.compare(0, 17, "--explicit-stack=") == 0 )
+		{
+			stackBudget = (arg.size() > 17 ? strtoull(arg.c_str() + 17, nullptr, 10) : 256) << 20;
+			if( stackBudget == 0 )
+			{
+				cerr << "BAD STACK BUDGET " << arg << endl;
+				return 0;
+			}
+		}
+		else if( arg == "--recover" || arg.compare(0, 10, "--recover=") == 0 )
+		{
+			errorLimit = arg.size() > 10 ? atoi(arg.c_str() + 10) : 100;
+			if( errorLimit <= 0 )
+			{
+				cerr << "BAD ERROR LIMIT " << arg << endl;
+				return 0;
+			}
+		}
+		else if( arg == "--c" )
+		{
+			translate = true;
+		}
+		else if( arg == "--native" || arg.compare(0, 9, "--native=") == 0 )
+		{
+			native = true;
+			if( arg.size() > 9 )
+			{
+				exe = arg.substr(9);
+			}
+		}
+		else if( arg == "--batch" )
+		{
+			batch = true;
+		}
+		else if( arg.compare(0, 11, "--manifest=") == 0 )
+		{
+			batch = true;
+			if( !ReadManifest(arg.substr(11), files) )
+			{
+				cerr << "CANNOT OPEN " << arg.substr(11) << endl;
+				return 0;
+			}
+		}
+		else if( arg.compare(0, 7, "--jobs=") == 0 )
+		{
+			int n = atoi(arg.c_str() + 7);
+			if( n <= 0 )
+			{
+				cerr << "BAD JOB COUNT " << arg << endl;
+				return 0;
+			}
+			jobs = n;
+		}
+		else if( arg.compare(0, 8, "--serve=") == 0 )
+		{
+			serve = arg.substr(8);
+		}
+		else if( arg.compare(0, 7, "--load=") == 0 )
+		{
+			load = arg.substr(7);
+		}
+		else if( arg.compare(0, 8, "--cache=") == 0 )
+		{
+			cacheDir = arg.substr(8);
+		}
+		else if( arg.compare(0, 13, "--cache-size=") == 0 )
+		{
+			cacheBytes = strtoull(arg.c_str() + 13, nullptr, 10) << 20;
+			if( cacheBytes == 0 )
+			{
+				cerr << "BAD CACHE SIZE " << arg << endl;
+				return 0;
+			}
+		}
+		else if( arg.compare(0, 11, "--requests=") == 0 )
+		{
+			requests = strtoull(arg.c_str() + 11, nullptr, 10);
+			if( requests == 0 )
+			{
+				cerr << "BAD REQUEST COUNT " << arg << endl;
+				return 0;
+			}
+		}
+		else if( batch || !load.empty() )
+		{
+			files.push_back(arg);
+		}
+		else if( named ) 
         {
 			cerr << "ONLY ONE FILE NAME ALLOWED" << endl;
 			return 0;
 		}
 		else 
         {
-			file.open(arg.c_str());
-			if( file.is_open() == false ) 
-            {
-				cerr << "CANNOT OPEN " << arg << endl;
+			filename = arg;
+			named = true;
+		}
+	}
+	ParseCache parseCache(cacheDir, cacheBytes);
+	ParseCache* cache = nullptr;
+	if( !cacheDir.empty() )
+	{
+		string error;
+		if( !parseCache.Open(error) )
+		{
+			cerr << error << endl;
+			return 0;
+		}
+		cache = &parseCache;
+	}
+	if( !serve.empty() )
+	{
+		string error;
+		if( !Serve(serve, ServeOptions{errorLimit, stackBudget, optimize, cache}, error) )
+		{
+			cerr << error << endl;
+		}
+		return 0;
+	}
+	if( !load.empty() )
+	{
+		vector<string> programs;
+		for( const string& name : files )
+		{
+			SourceBuffer file;
+			if( !IsRegularFile(name) || !file.Map(name) )
+			{
+				cerr << "CANNOT OPEN " << name << endl;
 				return 0;
 			}
-
-			in = &file;
+			programs.emplace_back(file.GetData(), file.GetSize());
 		}
+		if( programs.empty() )
+		{
+			cerr << "Missing File Name." << endl;
+			return 0;
+		}
+		string error;
+		if( !LoadTest(load, programs, run, jobs, requests, cout, error) )
+		{
+			cerr << error << endl;
+		}
+		return 0;
 	}
-	if(argc == 1)
+	if( batch )
+	{
+		if( pretokenize || dump || tree || run || listing || optimize || translate || native )
+		{
+			cerr << "BATCH MODE ONLY PARSES" << endl;
+			return 0;
+		}
+		if( named )
+		{
+			files.insert(files.begin(), filename);
+		}
+		if( files.empty() )
+		{
+			cerr << "Missing File Name." << endl;
+			return 0;
+		}
+		ParseBatch(files, BatchOptions{jobs, errorLimit, stackBudget, cache}, cout);
+		return 0;
+	}
+	if( !named )
 	{
 		cerr << "Missing File Name." << endl;
 		return 0;
 	}
+
+	if( filename != "-" && IsRegularFile(filename) && source.Map(filename) )
+	{
+		mapped = true;
+	}
+	else
+	{
+		fd = filename == "-" ? 0 : open(filename.c_str(), O_RDONLY);
+		if( fd < 0 ) 
+		{
+			cerr << "CANNOT OPEN " << filename << endl;
+			return 0;
+		}
+	}
+	if( dump )
+	{
+		TokenWriter out(1, binary);
+		LexCursor cursor = source.Cursor();
+		StreamLexer* stream = mapped ? nullptr : new StreamLexer(fd);
+		LexView tok;
+		do
+		{
+			tok = mapped ? getNextToken(cursor, lineNumber) : stream->Next(lineNumber);
+			out.Write(tok);
+		} while( tok != DONE );
+		delete stream;
+		if( !out.Flush() )
+		{
+			cerr << "CANNOT WRITE TOKENS" << endl;
+		}
+		return 0;
+	}
     //cout << "before entering parser" << endl;
-    bool status = Prog(*in, lineNumber);
+    bool status;
+	int errors;
+	Ast ast;
+	//With a cache the parser's messages are held back, to be saved along with the result, and written out after
+	ostringstream messages;
+	ParserContext parser(cache ? messages : cout);
+	auto flushMessages = [&]()
+	{
+		cout << messages.str();
+		messages.str("");
+	};
+	parser.SetStackBudget(stackBudget);
+	parser.SetErrorLimit(errorLimit);
+	bool compile = run || listing || translate || native;
+	if( tree || compile )
+	{
+		parser.SetAst(&ast);
+	}
+	//Anything we couldn't map has to be read into memory first to be pretokenized or hashed
+	string text;
+	if( !mapped && (pretokenize || cache) )
+	{
+		text = ReadAll(fd);
+		source.Assign(text.data(), text.size());
+	}
+	if( cache )
+	{
+		status = CachedProg(*cache, parser, messages, source.GetData(), source.GetSize(), tree || compile, errors);
+		flushMessages();
+	}
+	else
+	{
+		if( pretokenize )
+		{
+			TokenBuffer tokens;
+			tokens.TokenizeParallel(source.GetData(), source.GetSize(), thread::hardware_concurrency(), lineNumber);
+			status = parser.Prog(tokens, lineNumber);
+		}
+		else if( mapped )
+		{
+			LexCursor cursor = source.Cursor();
+			status = parser.Prog(cursor, lineNumber);
+		}
+		else
+		{
+			StreamLexer stream(fd);
+			status = parser.Prog(stream, lineNumber);
+		}
+		errors = parser.ErrCount();
+	}
     //cout << "returned from parser" << endl;
     if( !status )
     {
-        cout << "Unsuccessful Parsing" << endl << "Number of Syntax Errors " << ErrCount() << endl;
+        cout << "Unsuccessful Parsing" << endl << "Number of Syntax Errors " << errors << endl;
+	}
+	else if( compile )
+	{
+		Bytecode program;
+		VM vm;
+		bool compiled = Compile(ast, program);
+		if( !compiled )
+		{
+			cout << endl << "Unsuccessful Interpretation " << endl << "Number of Errors " << parser.ErrCount() << endl;
+			return 0;
+		}
+		if( translate || native )
+		{
+			ostringstream source;
+			string error;
+			if( !TranslateC(ast, source) )
+			{
+				cerr << "CANNOT TRANSLATE " << filename << endl;
+			}
+			else if( translate )
+			{
+				cout << source.str();
+			}
+			else if( !BuildNative(source.str(), exe, error) )
+			{
+				cerr << error << endl;
+			}
+			return 0;
+		}
+		if( optimize )
+		{
+			Optimize(ast, program);
+		}
+		if( listing )
+		{
+			program.Disassemble(cout);
+		}
+		else if( !vm.Run(program, cout) )
+		{
+			cout << endl << vm.GetErrorLine() << ": Run-Time Error-" << vm.GetError() << endl;
+			cout << endl << "Unsuccessful Interpretation " << endl << "Number of Errors " << parser.ErrCount() + 1 << endl;
+		}
+		else
+		{
+			cout << endl << "(DONE)" << endl;
+		}
 	}
 	else
     {
+		if( tree )
+		{
+			ast.Dump(cout);
+			//Lex the source again just to count its tokens, unless it was streamed and is gone
+			size_t tokens = 0;
+			if( source.GetData() != nullptr )
+			{
+				LexCursor cursor = source.Cursor();
+				int line = 1;
+				while( getNextToken(cursor, line) != DONE )
+				{
+					tokens++;
+				}
+			}
+			cerr << "AST: " << ast.Size() << " nodes, " << ast.Bytes() << " bytes";
+			if( tokens > 0 )
+			{
+				cerr << ", " << tokens << " tokens, " << (double)ast.Bytes() / tokens << " bytes per token";
+			}
+			cerr << endl;
+		}
         cout << "DONE" << endl;
 		cout << "Successful Parsing" << endl;
 	}
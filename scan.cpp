@@ -0,0 +1,252 @@
+/**
+ * Scanning kernels for the buffer lexer. The vector versions load a block of bytes, build a bitmask of the
+ * bytes we care about with compares, and use the lowest set bit to find where to stop. Newlines are counted
+ * with a popcount of the newline mask below that point. Any tail shorter than one block is finished off by
+ * the scalar loop, so no kernel ever reads past the end of the buffer(which could fault on a mapped file)
+*/
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+
+//isspace() in the C locale: space, and \t \n \v \f \r which are 0x09 through 0x0D
+static inline bool isSpaceByte(unsigned char c){
+	return c == ' ' || (unsigned char)(c - '\t') <= 4;
+}
+
+
+/*
+ * Scalar versions. These are the fallback for CPUs without SSE2, and finish the tails for the others
+*/
+static uint64_t scalarSkipSpace(const char* buf, uint64_t pos, uint64_t size, int& newlines){
+	while (pos < size && isSpaceByte(buf[pos])){
+		if (buf[pos] == '\n'){
+			newlines++;
+		}
+		pos++;
+	}
+	return pos;
+}
+
+
+static uint64_t scalarSkipComment(const char* buf, uint64_t pos, uint64_t size, int& newlines){
+	while (pos < size && buf[pos] != '}'){
+		if (buf[pos] == '\n'){
+			newlines++;
+		}
+		pos++;
+	}
+	return pos;
+}
+
+
+static uint64_t scalarSkipString(const char* buf, uint64_t pos, uint64_t size){
+	while (pos < size && buf[pos] != '\'' && buf[pos] != '\n'){
+		pos++;
+	}
+	return pos;
+}
+
+
+const ScanKernels scalarKernels = {"scalar", scalarSkipSpace, scalarSkipComment, scalarSkipString};
+
+
+#ifdef SCAN_X86
+
+/*
+ * SSE2 versions, 16 bytes per step. SSE2 is part of x86-64, so these are always available there
+*/
+static inline unsigned sse2SpaceMask(__m128i v){
+	//(c - 9) <= 4 unsigned is the same as min(c - 9, 4) == c - 9
+	__m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+	__m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+	__m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+	return (unsigned)_mm_movemask_epi8(_mm_or_si128(ctrl, sp));
+}
+
+
+static uint64_t sse2SkipSpace(const char* buf, uint64_t pos, uint64_t size, int& newlines){
+	const __m128i nl = _mm_set1_epi8('\n');
+
+	while (pos + 16 <= size){
+		__m128i v = _mm_loadu_si128((const __m128i*)(buf + pos));
+		unsigned stop = ~sse2SpaceMask(v) & 0xFFFF;
+		unsigned lines = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+
+		if (stop != 0){
+			unsigned idx = __builtin_ctz(stop);
+			newlines += __builtin_popcount(lines & ((1u << idx) - 1));
+			return pos + idx;
+		}
+
+		newlines += __builtin_popcount(lines);
+		pos += 16;
+	}
+
+	return scalarSkipSpace(buf, pos, size, newlines);
+}
+
+
+static uint64_t sse2SkipComment(const char* buf, uint64_t pos, uint64_t size, int& newlines){
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i close = _mm_set1_epi8('}');
+
+	while (pos + 16 <= size){
+		__m128i v = _mm_loadu_si128((const __m128i*)(buf + pos));
+		unsigned stop = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, close));
+		unsigned lines = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+
+		if (stop != 0){
+			unsigned idx = __builtin_ctz(stop);
+			newlines += __builtin_popcount(lines & ((1u << idx) - 1));
+			return pos + idx;
+		}
+
+		newlines += __builtin_popcount(lines);
+		pos += 16;
+	}
+
+	return scalarSkipComment(buf, pos, size, newlines);
+}
+
+
+static uint64_t sse2SkipString(const char* buf, uint64_t pos, uint64_t size){
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i quote = _mm_set1_epi8('\'');
+
+	while (pos + 16 <= size){
+		__m128i v = _mm_loadu_si128((const __m128i*)(buf + pos));
+		unsigned stop = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, nl)));
+
+		if (stop != 0){
+			return pos + __builtin_ctz(stop);
+		}
+		pos += 16;
+	}
+
+	return scalarSkipString(buf, pos, size);
+}
+
+
+/*
+ * AVX2 versions, 32 bytes per step. These are compiled for AVX2 no matter what the rest of the program is
+ * built for, and are only ever called if the CPU says it has it
+*/
+#define AVX2_TARGET __attribute__((target("avx2,popcnt,bmi")))
+
+AVX2_TARGET static inline uint32_t avx2SpaceMask(__m256i v){
+	__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+	__m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+	__m256i sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+	return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(ctrl, sp));
+}
+
+
+AVX2_TARGET static uint64_t avx2SkipSpace(const char* buf, uint64_t pos, uint64_t size, int& newlines){
+	const __m256i nl = _mm256_set1_epi8('\n');
+
+	while (pos + 32 <= size){
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buf + pos));
+		uint32_t stop = ~avx2SpaceMask(v);
+		uint32_t lines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+
+		if (stop != 0){
+			unsigned idx = __builtin_ctz(stop);
+			newlines += __builtin_popcount(lines & (uint32_t)((1ull << idx) - 1));
+			return pos + idx;
+		}
+
+		newlines += __builtin_popcount(lines);
+		pos += 32;
+	}
+
+	//Less than a full vector left, let SSE2 and then scalar finish it
+	return sse2SkipSpace(buf, pos, size, newlines);
+}
+
+
+AVX2_TARGET static uint64_t avx2SkipComment(const char* buf, uint64_t pos, uint64_t size, int& newlines){
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i close = _mm256_set1_epi8('}');
+
+	while (pos + 32 <= size){
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buf + pos));
+		uint32_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, close));
+		uint32_t lines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+
+		if (stop != 0){
+			unsigned idx = __builtin_ctz(stop);
+			newlines += __builtin_popcount(lines & (uint32_t)((1ull << idx) - 1));
+			return pos + idx;
+		}
+
+		newlines += __builtin_popcount(lines);
+		pos += 32;
+	}
+
+	return sse2SkipComment(buf, pos, size, newlines);
+}
+
+
+AVX2_TARGET static uint64_t avx2SkipString(const char* buf, uint64_t pos, uint64_t size){
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i quote = _mm256_set1_epi8('\'');
+
+	while (pos + 32 <= size){
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buf + pos));
+		uint32_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, nl)));
+
+		if (stop != 0){
+			return pos + __builtin_ctz(stop);
+		}
+		pos += 32;
+	}
+
+	return sse2SkipString(buf, pos, size);
+}
+
+
+const ScanKernels sse2Kernels = {"sse2", sse2SkipSpace, sse2SkipComment, sse2SkipString};
+const ScanKernels avx2Kernels = {"avx2", avx2SkipSpace, avx2SkipComment, avx2SkipString};
+
+#else
+
+//No vector kernels on this architecture, both names fall back to scalar and report as unsupported
+const ScanKernels sse2Kernels = {"sse2", scalarSkipSpace, scalarSkipComment, scalarSkipString};
+const ScanKernels avx2Kernels = {"avx2", scalarSkipSpace, scalarSkipComment, scalarSkipString};
+
+#endif
+
+
+//Check if the CPU we're running on can actually execute a set of kernels
+bool ScanKernelsSupported(const ScanKernels& kernels){
+	if (&kernels == &scalarKernels){
+		return true;
+	}
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (&kernels == &sse2Kernels){
+		return __builtin_cpu_supports("sse2");
+	}
+	if (&kernels == &avx2Kernels){
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("bmi");
+	}
+#endif
+	return false;
+}
+
+
+/**
+ * The best kernels for this CPU. The check only happens the first time through, after that it's just
+ * returning the saved reference
+*/
+const ScanKernels& GetScanKernels(){
+	static const ScanKernels& best = ScanKernelsSupported(avx2Kernels) ? avx2Kernels
+		: ScanKernelsSupported(sse2Kernels) ? sse2Kernels
+		: scalarKernels;
+	return best;
+}
@@ -0,0 +1,40 @@
+/*
+ * scan.h
+ *
+ * Bulk scanning kernels for the buffer lexer. When the lexer is skipping whitespace, inside a
+ * { } comment, or inside a ' string, it only cares about where the next interesting byte is, so
+ * these jump straight to it 16 or 32 bytes at a time and count the newlines they skipped over.
+ * Every kernel has a scalar, SSE2 and AVX2 version, and the best one the CPU supports is picked
+ * once at runtime.
+*/
+
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <cstdint>
+
+using namespace std;
+
+
+//One complete set of kernels. All of them start at buf[pos], never read at or past buf[size],
+//and return the offset of the first byte they stopped on (or size)
+struct ScanKernels {
+	const char* name;
+	//Skip isspace() bytes, adding every '\n' skipped to newlines
+	uint64_t (*skipSpace)(const char* buf, uint64_t pos, uint64_t size, int& newlines);
+	//Stop on the '}' that ends a comment, adding every '\n' skipped to newlines
+	uint64_t (*skipComment)(const char* buf, uint64_t pos, uint64_t size, int& newlines);
+	//Stop on the ' that ends a string, or the '\n' that makes it an error
+	uint64_t (*skipString)(const char* buf, uint64_t pos, uint64_t size);
+};
+
+
+extern const ScanKernels scalarKernels;
+extern const ScanKernels sse2Kernels;
+extern const ScanKernels avx2Kernels;
+
+extern bool ScanKernelsSupported(const ScanKernels& kernels);
+extern const ScanKernels& GetScanKernels();
+
+
+#endif /* SCAN_H_ */
@@ -0,0 +1,548 @@
+/**
+ * The parse server and its load generator. The server's main thread only accepts connections; each connection is
+ * served start to finish by one of a bounded set of worker threads(see SessionPool). SIGINT and SIGTERM are turned
+ * into a byte on a pipe(the handler can't do anything more than that safely), which wakes the accept loop up to shut
+ * down, whichever thread the signal landed on. Shutting down ends every connection and waits for its worker, so
+ * nothing is left using the options or the cache once Serve returns
+*/
+
+#include "server.h"
+#include "parser.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "ssa.h"
+#include "vm.h"
+#include "cache.h"
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+
+namespace {
+	//The largest program a request can carry, and the most program text every session together can have buffered at
+	//once(see Budget)
+	const size_t MAX_REQUEST = 64 << 20;
+	const size_t MAX_BUFFERED = 1 << 30;
+	//The most connections served at once. Any more wait in the listen backlog until one closes
+	const size_t MAX_SESSIONS = 256;
+	//The most a read sets aside before the bytes are there
+	const size_t MAX_RESERVE = 1 << 20;
+
+	//Buffered reads and whole writes on a connected socket
+	class Connection {
+		int	fd;
+		char	buf[1 << 16];
+		size_t	start;
+		size_t	end;
+
+		//Read more into buf, returns false at the end of the stream
+		bool Fill(){
+			start = end = 0;
+			while (true){
+				ssize_t got = read(fd, buf, sizeof(buf));
+				if (got < 0 && errno == EINTR){
+					continue;
+				}
+				if (got <= 0){
+					return false;
+				}
+				end = got;
+				return true;
+			}
+		}
+
+	public:
+		Connection(int fd) : fd(fd) {
+			start = end = 0;
+		}
+		~Connection() { close(fd); }
+
+		Connection(const Connection&) = delete;
+		Connection& operator=(const Connection&) = delete;
+
+		//One line, without its '\n'. Returns false if the stream ends first
+		bool ReadLine(string& line){
+			line.clear();
+			while (true){
+				if (start == end && !Fill()){
+					return false;
+				}
+				const char* nl = (const char*)memchr(buf + start, '\n', end - start);
+				size_t n = nl ? nl - (buf + start) : end - start;
+				line.append(buf + start, n);
+				start += n;
+				if (nl){
+					start++;
+					return true;
+				}
+			}
+		}
+
+		//Exactly n bytes. Returns false if the stream ends first. n is whatever the other end said it would send, so
+		//only up to MAX_RESERVE is set aside up front and the rest grows as it actually arrives
+		bool Read(string& text, size_t n){
+			text.clear();
+			text.reserve(min(n, MAX_RESERVE));
+			while (text.size() < n){
+				if (start == end && !Fill()){
+					return false;
+				}
+				size_t take = min(n - text.size(), end - start);
+				text.append(buf + start, take);
+				start += take;
+			}
+			return true;
+		}
+
+		bool Write(const string& text){
+			size_t done = 0;
+			while (done < text.size()){
+				ssize_t put = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+				if (put < 0 && errno == EINTR){
+					continue;
+				}
+				if (put <= 0){
+					return false;
+				}
+				done += put;
+			}
+			return true;
+		}
+	};
+
+	//What one request came to
+	struct Reply {
+		string	status;
+		int	errors;
+		string	text;
+	};
+
+	/**
+	 * Parse a program on a context of its own, and compile and run it too if run is set. The text is what prog2 prints
+	 * for the same program and flags
+	*/
+	void handle(const char* data, size_t size, bool run, const ServeOptions& options, Reply& reply){
+		ostringstream text;
+		ParserContext parser(text);
+		parser.SetErrorLimit(options.errorLimit);
+		parser.SetStackBudget(options.stackBudget);
+		Ast ast;
+		if (run){
+			parser.SetAst(&ast);
+		}
+		bool ok;
+		int errors;
+		if (options.cache){
+			ok = CachedProg(*options.cache, parser, text, data, size, run, errors);
+		} else {
+			LexCursor cursor(data, size);
+			int line = 1;
+			ok = parser.Prog(cursor, line);
+			errors = parser.ErrCount();
+		}
+
+		if (!ok){
+			text << "Unsuccessful Parsing" << endl << "Number of Syntax Errors " << errors << endl;
+		} else if (!run){
+			text << "DONE" << endl << "Successful Parsing" << endl;
+		} else {
+			Bytecode program;
+			VM vm;
+			ok = Compile(ast, program);
+			errors = parser.ErrCount();
+			if (!ok){
+				text << endl << "Unsuccessful Interpretation " << endl << "Number of Errors " << errors << endl;
+			} else {
+				if (options.optimize){
+					Optimize(ast, program);
+				}
+				ok = vm.Run(program, text);
+				if (!ok){
+					errors++;
+					text << endl << vm.GetErrorLine() << ": Run-Time Error-" << vm.GetError() << endl;
+					text << endl << "Unsuccessful Interpretation " << endl << "Number of Errors " << errors << endl;
+				} else {
+					text << endl << "(DONE)" << endl;
+				}
+			}
+		}
+		reply.status = ok ? "PASS" : "FAIL";
+		reply.errors = errors;
+		reply.text = text.str();
+	}
+
+	//The program text the sessions have buffered between them. A session claims room for a program before reading it
+	//in, waiting until there is some, and gives it back once the request has been handled
+	class Budget {
+		mutex	lock;
+		condition_variable	room;
+		size_t	used;
+		bool	stopping;
+
+	public:
+		Budget(){
+			used = 0;
+			stopping = false;
+		}
+
+		Budget(const Budget&) = delete;
+		Budget& operator=(const Budget&) = delete;
+
+		//Claim n bytes. Returns false, without claiming them, if the server is shutting down
+		bool Claim(size_t n){
+			unique_lock<mutex> hold(lock);
+			room.wait(hold, [&](){ return stopping || used + n <= MAX_BUFFERED; });
+			if (stopping){
+				return false;
+			}
+			used += n;
+			return true;
+		}
+
+		void Release(size_t n){
+			{
+				lock_guard<mutex> hold(lock);
+				used -= n;
+			}
+			room.notify_all();
+		}
+
+		//Wake every session waiting for room, and turn them away
+		void Stop(){
+			{
+				lock_guard<mutex> hold(lock);
+				stopping = true;
+			}
+			room.notify_all();
+		}
+	};
+
+	//Serve one connection's requests until it closes
+	void session(Connection& conn, const ServeOptions& options, Budget& budget){
+		string header;
+		string program;
+		while (conn.ReadLine(header)){
+			Reply reply{"BAD", 0, ""};
+			size_t space = header.find(' ');
+			string command = header.substr(0, space);
+			string arg = space == string::npos ? "" : header.substr(space + 1);
+
+			if (command == "PARSE" || command == "RUN"){
+				char* end;
+				unsigned long long n = strtoull(arg.c_str(), &end, 10);
+				if (arg.empty() || *end != '\0' || n > MAX_REQUEST){
+					reply.text = "BAD LENGTH " + arg + "\n";
+					conn.Write("BAD 0 " + to_string(reply.text.size()) + "\n" + reply.text);
+					return;
+				}
+				if (!budget.Claim(n)){
+					return;
+				}
+				bool read = conn.Read(program, n);
+				if (read){
+					handle(program.data(), program.size(), command == "RUN", options, reply);
+					//Nothing refers to the program's names once it has been handled, so the worker's interners start
+					//over for the next request instead of keeping every name every client has ever sent
+					ClearInterned();
+				}
+				//What was claimed is all that may stay buffered, so a big program's buffer doesn't outlive it
+				if (program.capacity() > MAX_RESERVE){
+					string().swap(program);
+				}
+				budget.Release(n);
+				if (!read){
+					return;
+				}
+			} else {
+				reply.text = "BAD REQUEST " + command + "\n";
+			}
+
+			if (!conn.Write(reply.status + " " + to_string(reply.errors) + " " + to_string(reply.text.size()) + "\n")
+				|| !conn.Write(reply.text)){
+				return;
+			}
+		}
+	}
+
+	/**
+	 * The threads connections are served on. A worker serves one connection start to finish, then takes the next one
+	 * waiting. Workers are only started when every one there is is busy, up to MAX_SESSIONS, and the accept loop stops
+	 * accepting while that many connections are already waiting or being served
+	*/
+	class SessionPool {
+		const ServeOptions&	options;
+		Budget	budget;
+		mutex	lock;
+		condition_variable	ready;
+		//Accepted connections no worker has taken yet, and the ones being served, so Stop can end them
+		deque<int>	waiting;
+		vector<int>	serving;
+		size_t	idle;
+		bool	stopping;
+		vector<thread>	workers;
+
+		void Work(){
+			unique_lock<mutex> hold(lock);
+			while (true){
+				idle++;
+				ready.wait(hold, [this](){ return stopping || !waiting.empty(); });
+				idle--;
+				if (stopping){
+					return;
+				}
+				int fd = waiting.front();
+				waiting.pop_front();
+				serving.push_back(fd);
+				hold.unlock();
+
+				//The connection is only closed once it is off the serving list, so Stop never shuts down an fd
+				//that has been closed and handed out again
+				Connection conn(fd);
+				session(conn, options, budget);
+				hold.lock();
+				serving.erase(find(serving.begin(), serving.end(), fd));
+			}
+		}
+
+	public:
+		SessionPool(const ServeOptions& options) : options(options) {
+			idle = 0;
+			stopping = false;
+		}
+
+		SessionPool(const SessionPool&) = delete;
+		SessionPool& operator=(const SessionPool&) = delete;
+
+		bool Full(){
+			lock_guard<mutex> hold(lock);
+			return waiting.size() + serving.size() >= MAX_SESSIONS;
+		}
+
+		//Hand a connection to a worker, starting another one if none is free
+		void Add(int fd){
+			lock_guard<mutex> hold(lock);
+			waiting.push_back(fd);
+			if (idle < waiting.size() && workers.size() < MAX_SESSIONS){
+				workers.emplace_back(&SessionPool::Work, this);
+			}
+			ready.notify_one();
+		}
+
+		//End every connection and wait for the workers. A request already being handled is finished first, its
+		//reply just can't be sent
+		void Stop(){
+			{
+				lock_guard<mutex> hold(lock);
+				stopping = true;
+				for (int fd : waiting){
+					close(fd);
+				}
+				waiting.clear();
+				for (int fd : serving){
+					shutdown(fd, SHUT_RDWR);
+				}
+			}
+			budget.Stop();
+			ready.notify_all();
+			for (thread& t : workers){
+				t.join();
+			}
+			workers.clear();
+		}
+	};
+
+	//Written to by the signal handler to wake the accept loop
+	int wakeFd = -1;
+
+	void stopServing(int){
+		char c = 0;
+		ssize_t ignored = write(wakeFd, &c, 1);
+		(void)ignored;
+	}
+
+	//A socket connected to the server at path, or -1
+	int connectTo(const string& path){
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0){
+			return -1;
+		}
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+		if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0){
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+}
+
+
+bool Serve(const string& path, const ServeOptions& options, string& error){
+	sockaddr_un addr = {};
+	if (path.size() >= sizeof(addr.sun_path)){
+		error = "SOCKET PATH TOO LONG " + path;
+		return false;
+	}
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	//A socket left behind by a server that didn't get to clean up is replaced, anything else at path is left alone
+	struct stat st;
+	if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)){
+		unlink(path.c_str());
+	}
+	//Only the user the server runs as gets to connect, so the socket is made with no permissions for anyone else. The
+	//umask is the whole process's, but no other thread has been started yet
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	mode_t mask = umask(0177);
+	bool bound = listener >= 0 && bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0;
+	umask(mask);
+	if (!bound || listen(listener, 128) != 0){
+		error = "CANNOT LISTEN ON " + path + ": " + strerror(errno);
+		if (listener >= 0){
+			close(listener);
+		}
+		return false;
+	}
+
+	int wake[2];
+	if (pipe(wake) != 0){
+		error = string("CANNOT LISTEN: ") + strerror(errno);
+		close(listener);
+		unlink(path.c_str());
+		return false;
+	}
+	wakeFd = wake[1];
+	signal(SIGINT, stopServing);
+	signal(SIGTERM, stopServing);
+	signal(SIGPIPE, SIG_IGN);
+
+	//While the pool is full the listener is left out of the poll(a negative fd is skipped), and the loop looks again
+	//every so often for a connection to have closed
+	SessionPool pool(options);
+	pollfd fds[2] = {{listener, POLLIN, 0}, {wake[0], POLLIN, 0}};
+	while (true){
+		bool full = pool.Full();
+		fds[0].fd = full ? -1 : listener;
+		fds[0].revents = 0;
+		if (poll(fds, 2, full ? 10 : -1) < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			break;
+		}
+		if (fds[1].revents != 0){
+			break;
+		}
+		if (fds[0].revents == 0){
+			continue;
+		}
+		int fd = accept(listener, nullptr, nullptr);
+		if (fd >= 0){
+			pool.Add(fd);
+		}
+	}
+	pool.Stop();
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	close(listener);
+	unlink(path.c_str());
+	close(wake[0]);
+	close(wake[1]);
+	wakeFd = -1;
+	return true;
+}
+
+
+bool LoadTest(const string& path, const vector<string>& programs, bool run, unsigned connections,
+	size_t requests, ostream& out, string& error){
+	if (programs.empty()){
+		error = "NOTHING TO SEND";
+		return false;
+	}
+	connections = max(1u, connections);
+	vector<int> fds;
+	for (unsigned c = 0; c < connections; c++){
+		int fd = connectTo(path);
+		if (fd < 0){
+			error = "CANNOT CONNECT TO " + path + ": " + strerror(errno);
+			for (int open : fds){
+				close(open);
+			}
+			return false;
+		}
+		fds.push_back(fd);
+	}
+
+	//Every connection takes the next request until there are none left, and times each one from the first byte sent
+	//to the last byte of the reply
+	atomic<size_t> next{0};
+	atomic<size_t> statuses[3] = {{0}, {0}, {0}};
+	atomic<bool> broken{false};
+	vector<vector<double>> latencies(connections);
+	const string verb = run ? "RUN " : "PARSE ";
+	auto t0 = chrono::steady_clock::now();
+	vector<thread> clients;
+	for (unsigned c = 0; c < connections; c++){
+		clients.emplace_back([&, c](){
+			Connection conn(fds[c]);
+			string header;
+			string text;
+			for (size_t r = next++; r < requests && !broken; r = next++){
+				const string& program = programs[r % programs.size()];
+				auto start = chrono::steady_clock::now();
+				if (!conn.Write(verb + to_string(program.size()) + "\n") || !conn.Write(program)
+					|| !conn.ReadLine(header)){
+					broken = true;
+					break;
+				}
+				size_t last = header.rfind(' ');
+				if (last == string::npos || !conn.Read(text, strtoull(header.c_str() + last + 1, nullptr, 10))){
+					broken = true;
+					break;
+				}
+				auto end = chrono::steady_clock::now();
+				latencies[c].push_back(chrono::duration<double, milli>(end - start).count());
+				statuses[header.compare(0, 5, "PASS ") == 0 ? 0 : header.compare(0, 5, "FAIL ") == 0 ? 1 : 2]++;
+			}
+		});
+	}
+	for (thread& t : clients){
+		t.join();
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	if (broken){
+		error = "CONNECTION TO " + path + " LOST";
+		return false;
+	}
+
+	vector<double> all;
+	for (const vector<double>& l : latencies){
+		all.insert(all.end(), l.begin(), l.end());
+	}
+	sort(all.begin(), all.end());
+	//Nearest rank: the smallest latency at least p of the requests took no longer than
+	auto percentile = [&](double p){ return all.empty() ? 0 : all[max<size_t>((size_t)ceil(p * all.size()), 1) - 1]; };
+	out << "Requests " << all.size() << " on " << connections << " connections in " << seconds << " s, "
+		<< all.size() / max(seconds, 1e-9) << " requests/s" << endl;
+	out << "Latency p50 " << percentile(0.50) << " ms, p99 " << percentile(0.99) << " ms, max "
+		<< (all.empty() ? 0 : all.back()) << " ms" << endl;
+	out << "Replies " << statuses[0] << " PASS, " << statuses[1] << " FAIL, " << statuses[2] << " BAD" << endl;
+	return true;
+}
@@ -0,0 +1,56 @@
+/*
+ * server.h
+ *
+ * A long running parse server on a Unix domain socket, for callers that would otherwise start a
+ * process per file. Every connection is served by a thread of its own, from a pool of a bounded size,
+ * and can send any number of requests, one after another. Each request is parsed on a ParserContext of
+ * its own, so connections being served never wait on each other. The socket can only be
+ * connected to by the user the server runs as.
+ *
+ * A request is one header line, then the program's text:
+ *	PARSE <bytes>\n<program>	parse it
+ *	RUN <bytes>\n<program>		parse, compile and run it
+ * and every request gets back one reply:
+ *	<status> <errors> <bytes>\n<text>
+ * where status is PASS, FAIL, or BAD for a request that makes no sense, errors is the number of errors
+ * reported, and text is everything prog2 would have printed for the same program.
+ *
+ * A program can be at most 64 MB, and the programs being read in or handled on every connection together
+ * at most 1 GB. A request that would go over that waits until others are done.
+*/
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+class ParseCache;
+
+
+//How requests are handled. errorLimit and stackBudget are the same as for one file, optimize is --optimize for RUN.
+//With a cache(cache.h), programs that are in it aren't lexed or parsed again
+struct ServeOptions {
+	int	errorLimit;
+	size_t	stackBudget;
+	bool	optimize;
+	ParseCache*	cache;
+};
+
+
+//Serve requests on the socket at path until SIGINT or SIGTERM. Returns false, with error saying why, if it can't
+extern bool Serve(const string& path, const ServeOptions& options, string& error);
+
+/**
+ * Load generator. Sends requests programs in turn(as RUN requests if run is set, PARSE otherwise) over connections
+ * connections at once, and writes what the latencies came to to out. Returns false, with error saying why, if it can't
+ * talk to the server
+*/
+extern bool LoadTest(const string& path, const vector<string>& programs, bool run, unsigned connections,
+	size_t requests, ostream& out, string& error);
+
+
+#endif /* SERVER_H_ */
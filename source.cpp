@@ -0,0 +1,79 @@
+/**
+ * Source buffers for the zero-copy lexer. Regular files are mapped read-only with mmap so the lexer
+ * can walk the bytes in place, no matter how large the file is. Anything that can't be mapped(pipes,
+ * terminals) is read a block at a time by a StreamLexer instead(stream.h)
+*/
+
+#include "source.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/**
+ * Map the whole file into memory, read only. Returns false if the file can't be opened or mapped,
+ * in which case the buffer is left empty
+*/
+bool SourceBuffer::Map(const string& filename){
+	Close();
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0){
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+		close(fd);
+		return false;
+	}
+
+	//mmap refuses zero length mappings, but an empty file is still a perfectly good (empty) program
+	if (st.st_size == 0){
+		close(fd);
+		return true;
+	}
+
+	void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	//The mapping holds its own reference to the file, so we can close it right away
+	close(fd);
+
+	if (addr == MAP_FAILED){
+		return false;
+	}
+
+	//We only ever walk the file front to back, so let the kernel read ahead aggressively
+	madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+	data = static_cast<const char*>(addr);
+	size = static_cast<uint64_t>(st.st_size);
+	mapped = true;
+	return true;
+}
+
+
+//Wrap a buffer the caller already has. Nothing is copied, the caller keeps ownership
+void SourceBuffer::Assign(const char* buf, uint64_t len){
+	Close();
+	data = buf;
+	size = len;
+}
+
+
+//Release the mapping, if we own one
+void SourceBuffer::Close(){
+	if (mapped){
+		munmap(const_cast<char*>(data), size);
+	}
+	data = nullptr;
+	size = 0;
+	mapped = false;
+}
+
+
+//Only regular files can be mapped, everything else(pipes, /dev/stdin, sockets) has to be streamed
+bool IsRegularFile(const string& filename){
+	struct stat st;
+	return stat(filename.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
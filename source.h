@@ -0,0 +1,53 @@
+/*
+ * source.h
+ *
+ * Read-only source buffers for the zero-copy lexer entry point. A SourceBuffer either maps a
+ * regular file into memory or wraps a buffer that the caller already owns, and hands out
+ * LexCursors over it. Every LexView lexed from a cursor points back into this buffer, so the
+ * buffer must outlive them.
+*/
+
+#ifndef SOURCE_H_
+#define SOURCE_H_
+
+#include <string>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+
+//Class definition of SourceBuffer
+class SourceBuffer {
+	const char*	data;
+	uint64_t	size;
+	//true if data came from mmap and must be unmapped
+	bool	mapped;
+
+public:
+	SourceBuffer() {
+		data = nullptr;
+		size = 0;
+		mapped = false;
+	}
+	~SourceBuffer() { Close(); }
+
+	//A mapping can only have one owner
+	SourceBuffer(const SourceBuffer&) = delete;
+	SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+	bool	Map(const string& filename);
+	void	Assign(const char* buf, uint64_t len);
+	void	Close();
+
+	const char*	GetData() const { return data; }
+	uint64_t	GetSize() const { return size; }
+	LexCursor	Cursor() const { return LexCursor(data, size); }
+};
+
+
+extern bool IsRegularFile(const string& filename);
+
+
+#endif /* SOURCE_H_ */
@@ -0,0 +1,706 @@
+/**
+ * SSA implementation: building the SSA form from the syntax tree, and lowering it back to bytecode. The passes in
+ * between are in optimize.cpp
+*/
+
+#include "ssa.h"
+#include "ast.h"
+#include "intern.h"
+#include "symtab.h"
+#include <unordered_map>
+#include <cstring>
+
+
+uint32_t SsaProgram::NewBlock(){
+	SsaBlock block;
+	block.preds[0] = block.preds[1] = NONE;
+	block.npreds = 0;
+	block.succs[0] = block.succs[1] = NONE;
+	block.nsuccs = 0;
+	block.cond = NONE;
+	block.dead = false;
+	blocks.push_back(block);
+	return (uint32_t)(blocks.size() - 1);
+}
+
+
+//A new value, at the end of block(constants and undef belong to no block)
+uint32_t SsaProgram::Add(uint32_t block, uint8_t op, Token type, uint32_t a, uint32_t b, int line){
+	SsaInstr in;
+	in.op = op;
+	in.dead = false;
+	in.type = type;
+	in.a = a;
+	in.b = b;
+	in.line = line;
+	in.value = Slot{0};
+	values.push_back(in);
+	uint32_t v = (uint32_t)(values.size() - 1);
+	if (block != NONE){
+		blocks[block].instrs.push_back(v);
+	}
+	return v;
+}
+
+
+uint32_t SsaProgram::AddConstant(Token type, Slot value){
+	uint32_t v = Add(NONE, SSA_CONST, type, 0, 0, 0);
+	values[v].value = value;
+	return v;
+}
+
+
+void SsaProgram::Link(uint32_t from, uint32_t to){
+	blocks[from].succs[blocks[from].nsuccs++] = to;
+	blocks[to].preds[blocks[to].npreds++] = from;
+}
+
+
+/**
+ * The values an instruction reads when it runs, into uses. A CHECK's value is only there for the optimizer to see
+ * whether the check can fail, so it isn't one
+*/
+int SsaProgram::Uses(const SsaInstr& in, uint32_t uses[2]){
+	switch (in.op){
+		case OP_I2R: case OP_NEG_I: case OP_NEG_R: case OP_NOT:
+		case OP_WRITE_I: case OP_WRITE_R: case OP_WRITE_S: case OP_WRITE_B:
+			uses[0] = in.a;
+			return 1;
+		case OP_CHECK: case OP_MARK: case OP_WRITELN: case SSA_CONST: case SSA_UNDEF:
+			return 0;
+		default:
+			uses[0] = in.a;
+			uses[1] = in.b;
+			return 2;
+	}
+}
+
+
+size_t SsaProgram::Instructions() const {
+	size_t count = 0;
+	for (const SsaBlock& block : blocks){
+		if (block.dead){
+			continue;
+		}
+		for (uint32_t v : block.instrs){
+			uint8_t op = values[v].op;
+			count += !values[v].dead && op != SSA_CONST && op != SSA_PHI && op != SSA_UNDEF;
+		}
+	}
+	return count;
+}
+
+
+void SsaProgram::Dump(ostream& out) const {
+	for (uint32_t b = 0; b < blocks.size(); b++){
+		const SsaBlock& block = blocks[b];
+		if (block.dead){
+			continue;
+		}
+		out << "b" << b << ":";
+		for (int k = 0; k < block.npreds; k++){
+			out << (k == 0 ? " from b" : ", b") << block.preds[k];
+		}
+		out << endl;
+
+		for (uint32_t v : block.instrs){
+			const SsaInstr& in = values[v];
+			if (in.dead || in.op == SSA_CONST){
+				continue;
+			}
+			out << "\t";
+			if (in.op == OP_CHECK || in.op == OP_MARK){
+				out << opNames[in.op] << " x" << in.a << endl;
+				continue;
+			}
+			if (in.op < OP_WRITE_I){
+				out << "v" << v << " = ";
+			}
+			out << (in.op == SSA_PHI ? "PHI" : opNames[in.op]);
+			uint32_t uses[2];
+			int n = Uses(in, uses);
+			for (int k = 0; k < n; k++){
+				const SsaInstr& use = values[uses[k]];
+				out << " ";
+				if (use.op != SSA_CONST){
+					out << "v" << uses[k];
+				} else if (use.type == INTEGER){
+					out << use.value.i;
+				} else if (use.type == REAL){
+					out << use.value.r;
+				} else if (use.type == STRING){
+					out << "'" << strings[use.value.s] << "'";
+				} else {
+					out << (use.value.b ? "true" : "false");
+				}
+			}
+			out << endl;
+		}
+
+		if (block.nsuccs == 2){
+			out << "\tif v" << block.cond << " b" << block.succs[0] << " else b" << block.succs[1] << endl;
+		} else if (block.nsuccs == 1){
+			out << "\tgoto b" << block.succs[0] << endl;
+		} else {
+			out << "\thalt" << endl;
+		}
+	}
+}
+
+
+namespace {
+
+//Class definition of SsaBuilder
+class SsaBuilder {
+	const Ast&	ast;
+	SsaProgram&	out;
+	bool	ok;
+	//The block instructions are added to. It is always the newest block
+	uint32_t	block;
+	uint32_t	undef;
+
+	//Every declared variable, numbered by its index, then the type and the value each variable has right now, by number
+	SymbolTable	vars;
+	vector<Token>	varTypes;
+	vector<uint32_t>	current;
+	//Every change to current as (variable, value before), so an if can take back what its arms did
+	vector<pair<uint32_t, uint32_t>>	defs;
+	//Scratch for merging the arms of an if, by variable
+	vector<uint32_t>	seen;
+	vector<uint32_t>	armValues;
+	uint32_t	stamp;
+
+	//Which variables are sure to have a value, as the compiler works it out, to put CHECK and MARK in the same places
+	vector<uint8_t>	assigned;
+	vector<uint32_t>	trail;
+
+	unordered_map<uint64_t, uint32_t>	constants[4];
+
+	uint32_t	Constant(Token type, Slot value, uint64_t key);
+	void	Set(uint32_t var, uint32_t value);
+	vector<pair<uint32_t, uint32_t>>	TakeDefs(size_t mark);
+	void	Assigned(uint32_t var);
+	void	Store(uint32_t var, uint32_t value, Token type, int line);
+	uint32_t	Expr(uint32_t n, Token& type);
+	void	If(uint32_t n);
+	void	Stmt(uint32_t n);
+
+public:
+	SsaBuilder(const Ast& ast, SsaProgram& out) : ast(ast), out(out) {
+		ok = true;
+		block = 0;
+		undef = 0;
+		stamp = 0;
+	}
+
+	bool	Program();
+};
+
+
+uint32_t SsaBuilder::Constant(Token type, Slot value, uint64_t key){
+	int kind = type == INTEGER ? 0 : type == REAL ? 1 : type == STRING ? 2 : 3;
+	auto found = constants[kind].find(key);
+	if (found != constants[kind].end()){
+		return found->second;
+	}
+	if (type == STRING){
+		value.s = (uint32_t)out.strings.size();
+		out.strings.emplace_back(lexemes.GetName((uint32_t)key));
+	}
+	return constants[kind][key] = out.AddConstant(type, value);
+}
+
+
+void SsaBuilder::Set(uint32_t var, uint32_t value){
+	defs.emplace_back(var, current[var]);
+	current[var] = value;
+}
+
+
+//The variables changed since mark with the values they were given, putting each one back the way it was
+vector<pair<uint32_t, uint32_t>> SsaBuilder::TakeDefs(size_t mark){
+	vector<pair<uint32_t, uint32_t>> changed;
+	stamp++;
+	for (size_t i = mark; i < defs.size(); i++){
+		uint32_t var = defs[i].first;
+		if (seen[var] != stamp){
+			seen[var] = stamp;
+			changed.emplace_back(var, current[var]);
+		}
+	}
+	for (size_t i = defs.size(); i > mark; i--){
+		current[defs[i - 1].first] = defs[i - 1].second;
+	}
+	defs.resize(mark);
+	return changed;
+}
+
+
+void SsaBuilder::Assigned(uint32_t var){
+	if (!assigned[var]){
+		assigned[var] = 1;
+		trail.push_back(var);
+	}
+}
+
+
+void SsaBuilder::Store(uint32_t var, uint32_t value, Token type, int line){
+	if (type == INTEGER && varTypes[var] == REAL){
+		value = out.Add(block, OP_I2R, REAL, value, 0, line);
+	} else if (type != varTypes[var]){
+		ok = false;
+		return;
+	}
+	Set(var, value);
+	if (!assigned[var]){
+		out.Add(block, OP_MARK, ERR, var, 0, line);
+		Assigned(var);
+	}
+}
+
+
+uint32_t SsaBuilder::Expr(uint32_t n, Token& type){
+	int line = ast.GetLine(n);
+	Slot value = {0};
+
+	switch (ast.GetKind(n)){
+		case N_VAR: {
+			uint32_t var = vars.Find(ast.GetA(n))->index;
+			type = varTypes[var];
+			if (!assigned[var]){
+				out.Add(block, OP_CHECK, ERR, var, current[var], line);
+				Assigned(var);
+			}
+			return current[var];
+		}
+		case N_ICONST:
+			type = INTEGER;
+			value.i = ast.GetInt(n);
+			return Constant(type, value, (uint32_t)value.i);
+		case N_RCONST: {
+			type = REAL;
+			value.r = ast.GetReal(n);
+			uint64_t bits;
+			memcpy(&bits, &value.r, sizeof(bits));
+			return Constant(type, value, bits);
+		}
+		case N_SCONST:
+			type = STRING;
+			return Constant(type, value, ast.GetA(n));
+		case N_BCONST:
+			type = BOOLEAN;
+			value.b = ast.GetA(n) != 0;
+			return Constant(type, value, value.b);
+		case N_UNARY: {
+			uint32_t operand = Expr(ast.GetA(n), type);
+			Op op = UnaryOp(ast.GetOp(n), type);
+			if (op == OP_COUNT){
+				ok = false;
+				return operand;
+			}
+			return out.Add(block, op, type, operand, 0, line);
+		}
+		case N_BINARY: {
+			Token lt, rt;
+			uint32_t left = Expr(ast.GetA(n), lt);
+			uint32_t right = Expr(ast.GetB(n), rt);
+			bool real;
+			Op op = BinaryOp(ast.GetOp(n), lt, rt, type, real);
+			if (op == OP_COUNT){
+				ok = false;
+				return left;
+			}
+			if (real && lt == INTEGER){
+				left = out.Add(block, OP_I2R, REAL, left, 0, line);
+			}
+			if (real && rt == INTEGER){
+				right = out.Add(block, OP_I2R, REAL, right, 0, line);
+			}
+			return out.Add(block, op, type, left, right, line);
+		}
+		default:
+			type = ERR;
+			ok = false;
+			return undef;
+	}
+}
+
+
+/**
+ * An if splits the block it is in into a then arm and an else arm(empty for an if without one), which meet again in
+ * a new block. That block starts with a phi for every variable the arms left with different values
+*/
+void SsaBuilder::If(uint32_t n){
+	bool both = ast.GetKind(n) == N_IF_ELSE;
+	int line = ast.GetLine(n);
+	Token type;
+	uint32_t cond = Expr(ast.GetA(n), type);
+	ok = ok && type == BOOLEAN;
+
+	uint32_t from = block;
+	out.blocks[from].cond = cond;
+	size_t mark = defs.size();
+	size_t assignedMark = trail.size();
+
+	block = out.NewBlock();
+	out.Link(from, block);
+	Stmt(both ? ast.GetListItem(ast.GetB(n)) : ast.GetB(n));
+	uint32_t thenEnd = block;
+	vector<pair<uint32_t, uint32_t>> thenDefs = TakeDefs(mark);
+	vector<uint32_t> thenAssigned(trail.begin() + assignedMark, trail.end());
+	for (size_t i = assignedMark; i < trail.size(); i++){
+		assigned[trail[i]] = 0;
+	}
+	trail.resize(assignedMark);
+
+	block = out.NewBlock();
+	out.Link(from, block);
+	if (both){
+		Stmt(ast.GetListItem(ast.GetB(n) + 1));
+	}
+	uint32_t elseEnd = block;
+	vector<pair<uint32_t, uint32_t>> elseDefs = TakeDefs(mark);
+
+	block = out.NewBlock();
+	out.Link(thenEnd, block);
+	out.Link(elseEnd, block);
+
+	//Values from the then arm, then a phi wherever the two arms differ. A variable only one arm changed keeps its
+	//value from before the if on the other side
+	stamp++;
+	for (auto& def : thenDefs){
+		seen[def.first] = stamp;
+		armValues[def.first] = def.second;
+	}
+	stamp++;
+	for (auto& def : elseDefs){
+		uint32_t var = def.first;
+		uint32_t then = seen[var] == stamp - 1 ? armValues[var] : current[var];
+		seen[var] = stamp;
+		Set(var, then == def.second ? then : out.Add(block, SSA_PHI, varTypes[var], then, def.second, line));
+	}
+	for (auto& def : thenDefs){
+		uint32_t var = def.first;
+		if (seen[var] != stamp && def.second != current[var]){
+			Set(var, out.Add(block, SSA_PHI, varTypes[var], def.second, current[var], line));
+		}
+	}
+
+	//Only what both arms assign is sure to be assigned after the if
+	stamp++;
+	for (uint32_t var : thenAssigned){
+		seen[var] = stamp;
+	}
+	size_t kept = assignedMark;
+	for (size_t i = assignedMark; i < trail.size(); i++){
+		if (seen[trail[i]] == stamp){
+			trail[kept++] = trail[i];
+		} else {
+			assigned[trail[i]] = 0;
+		}
+	}
+	trail.resize(kept);
+}
+
+
+void SsaBuilder::Stmt(uint32_t n){
+	int line = ast.GetLine(n);
+
+	switch (ast.GetKind(n)){
+		case N_BLOCK:
+			for (uint32_t i = 0; i < ast.GetB(n); i++){
+				Stmt(ast.GetListItem(ast.GetA(n) + i));
+			}
+			break;
+		case N_ASSIGN: {
+			Token type;
+			uint32_t value = Expr(ast.GetB(n), type);
+			Store(vars.Find(ast.GetA(ast.GetA(n)))->index, value, type, line);
+			break;
+		}
+		case N_WRITE:
+		case N_WRITELN:
+			for (uint32_t i = 0; i < ast.GetB(n); i++){
+				Token type;
+				uint32_t value = Expr(ast.GetListItem(ast.GetA(n) + i), type);
+				Op op = type == INTEGER ? OP_WRITE_I : type == REAL ? OP_WRITE_R : type == STRING ? OP_WRITE_S : OP_WRITE_B;
+				out.Add(block, op, ERR, value, 0, line);
+			}
+			if (ast.GetKind(n) == N_WRITELN){
+				out.Add(block, OP_WRITELN, ERR, 0, 0, line);
+			}
+			break;
+		case N_IF:
+		case N_IF_ELSE:
+			If(n);
+			break;
+		default:
+			break;
+	}
+}
+
+
+bool SsaBuilder::Program(){
+	uint32_t root = ast.Root();
+	uint32_t start = ast.GetA(root);
+	uint32_t decls = ast.GetB(root);
+
+	block = out.NewBlock();
+	undef = out.Add(SsaProgram::NONE, SSA_UNDEF, ERR, 0, 0, 0);
+	for (uint32_t d = 0; d < decls; d++){
+		uint32_t decl = ast.GetListItem(start + d);
+		for (uint32_t i = 0; i < ast.GetB(decl); i++){
+			vars.Declare(ast.GetListItem(ast.GetA(decl) + i), ast.GetLine(decl));
+			varTypes.push_back(ast.GetOp(decl));
+		}
+	}
+	out.vars = (uint32_t)varTypes.size();
+	current.assign(out.vars, undef);
+	assigned.assign(out.vars, 0);
+	seen.assign(out.vars, 0);
+	armValues.assign(out.vars, 0);
+
+	//Every variable in a declaration with an initializer starts with the initializer's value
+	for (uint32_t d = 0; d < decls; d++){
+		uint32_t decl = ast.GetListItem(start + d);
+		if (ast.GetKind(decl) != N_DECL_INIT){
+			continue;
+		}
+		Token type;
+		uint32_t value = Expr(ast.GetListItem(ast.GetA(decl) + ast.GetB(decl)), type);
+		for (uint32_t i = 0; i < ast.GetB(decl); i++){
+			uint32_t var = vars.Find(ast.GetListItem(ast.GetA(decl) + i))->index;
+			Store(var, value, type, ast.GetLine(decl));
+		}
+	}
+
+	Stmt(ast.GetListItem(start + decls));
+	return ok;
+}
+
+}
+
+
+bool BuildSsa(const Ast& ast, SsaProgram& out){
+	out = SsaProgram();
+	if (ast.Root() == Ast::NONE){
+		return false;
+	}
+	SsaBuilder builder(ast, out);
+	return builder.Program();
+}
+
+
+namespace {
+
+//One step of the lowered program, before it has registers: an instruction, a move into a phi at the end of a block
+//that leads to it, or a block's jump
+enum ItemKind : uint8_t { ITEM_INSTR, ITEM_MOVE, ITEM_BRANCH, ITEM_JUMP, ITEM_HALT };
+
+struct Item {
+	ItemKind	kind;
+	uint32_t	value;
+	uint32_t	arg;
+	int	line;
+};
+
+}
+
+
+/**
+ * Lowering. The live blocks are laid out in order and each becomes its instructions, then a move into every phi of
+ * the block it goes to, then its jump. A jump to the block laid out right after is left out.
+ *
+ * Registers are given by linear scan over that layout. Every jump goes forward, so anything that runs between where a
+ * value is defined and where it is last used is laid out between them too, and two values whose spans don't overlap
+ * can share a register. A value may even take the register of an operand whose last use is the instruction defining
+ * it, since the VM reads operands before it writes the result. A phi's span starts at its first move
+*/
+void Lower(const SsaProgram& p, Bytecode& out){
+	const uint32_t NONE = SsaProgram::NONE;
+	out.Clear();
+	out.SetVars(p.vars);
+	for (const string& text : p.strings){
+		out.AddString(text);
+	}
+
+	vector<Item> items;
+	vector<uint32_t> firstItem(p.blocks.size() + 1, 0);
+	vector<uint32_t> jumps;
+	for (uint32_t b = 0; b < p.blocks.size(); b++){
+		firstItem[b] = (uint32_t)items.size();
+		const SsaBlock& block = p.blocks[b];
+		if (block.dead){
+			continue;
+		}
+		int line = 0;
+		for (uint32_t v : block.instrs){
+			const SsaInstr& in = p.values[v];
+			line = in.line;
+			if (!in.dead && in.op != SSA_CONST && in.op != SSA_PHI && in.op != SSA_UNDEF){
+				items.push_back(Item{ITEM_INSTR, v, 0, line});
+			}
+		}
+
+		uint32_t next = b + 1;
+		while (next < p.blocks.size() && p.blocks[next].dead){
+			next++;
+		}
+		if (block.nsuccs == 0){
+			items.push_back(Item{ITEM_HALT, 0, 0, line});
+			continue;
+		}
+		if (block.nsuccs == 2){
+			items.push_back(Item{ITEM_BRANCH, b, 0, line});
+		} else {
+			const SsaBlock& to = p.blocks[block.succs[0]];
+			int k = to.preds[0] == b ? 0 : 1;
+			for (uint32_t v : to.instrs){
+				const SsaInstr& phi = p.values[v];
+				if (phi.op != SSA_PHI){
+					break;
+				}
+				if (!phi.dead){
+					items.push_back(Item{ITEM_MOVE, v, k == 0 ? phi.a : phi.b, phi.line});
+				}
+			}
+		}
+		if (block.succs[0] != next){
+			items.push_back(Item{ITEM_JUMP, b, 0, line});
+		}
+	}
+	firstItem[p.blocks.size()] = (uint32_t)items.size();
+
+	//Constants(and undef, a zero) get registers of their own the first time they are used
+	vector<uint32_t> regs(p.values.size(), NONE);
+	unordered_map<uint64_t, uint32_t> constants[5];
+	auto reg = [&](uint32_t v){
+		const SsaInstr& in = p.values[v];
+		if (regs[v] == NONE && (in.op == SSA_CONST || in.op == SSA_UNDEF)){
+			int kind = in.type == INTEGER ? 0 : in.type == REAL ? 1 : in.type == STRING ? 2 : in.type == BOOLEAN ? 3 : 4;
+			uint64_t key = 0;
+			memcpy(&key, &in.value, sizeof(key));
+			if (in.type == INTEGER || in.type == STRING){
+				key = (uint32_t)in.value.i;
+			} else if (in.type == BOOLEAN){
+				key = in.value.b;
+			}
+			auto found = constants[kind].find(key);
+			regs[v] = found != constants[kind].end() ? found->second : constants[kind][key] = out.AddConstant(in.type, in.value);
+		}
+		return regs[v];
+	};
+
+	//Where every value is defined and last used
+	vector<uint32_t> defAt(p.values.size(), NONE);
+	vector<uint32_t> endAt(p.values.size(), 0);
+	auto use = [&](uint32_t v, uint32_t at){
+		if (p.values[v].op != SSA_CONST && p.values[v].op != SSA_UNDEF){
+			endAt[v] = max(endAt[v], at);
+		}
+	};
+	for (uint32_t i = 0; i < items.size(); i++){
+		const Item& item = items[i];
+		if (item.kind == ITEM_INSTR){
+			uint32_t uses[2];
+			int n = SsaProgram::Uses(p.values[item.value], uses);
+			for (int k = 0; k < n; k++){
+				use(uses[k], i);
+			}
+			defAt[item.value] = i;
+			endAt[item.value] = max(endAt[item.value], i);
+		} else if (item.kind == ITEM_MOVE){
+			use(item.arg, i);
+			defAt[item.value] = min(defAt[item.value], i);
+			endAt[item.value] = max(endAt[item.value], i);
+		} else if (item.kind == ITEM_BRANCH){
+			use(p.blocks[item.value].cond, i);
+		}
+	}
+
+	//Linear scan. Values are freed at their last use, before the value defined at the same place takes a register
+	vector<vector<uint32_t>> endsAt(items.size());
+	for (uint32_t v = 0; v < p.values.size(); v++){
+		if (defAt[v] != NONE){
+			endsAt[endAt[v]].push_back(v);
+		}
+	}
+	vector<uint32_t> free;
+	for (uint32_t i = 0; i < items.size(); i++){
+		uint32_t defined = items[i].kind == ITEM_INSTR || items[i].kind == ITEM_MOVE ? items[i].value : NONE;
+		for (uint32_t v : endsAt[i]){
+			if (v != defined){
+				free.push_back(regs[v]);
+			}
+		}
+		if (defined != NONE && defAt[defined] == i){
+			if (free.empty()){
+				regs[defined] = out.AddRegister(ERR, Slot{0});
+			} else {
+				regs[defined] = free.back();
+				free.pop_back();
+			}
+			if (endAt[defined] == i){
+				free.push_back(regs[defined]);
+			}
+		}
+	}
+
+	//Emit, then point the jumps at the blocks
+	vector<uint32_t> blockAt(p.blocks.size(), 0);
+	vector<pair<uint32_t, uint32_t>> patches;
+	for (uint32_t b = 0; b < p.blocks.size(); b++){
+		blockAt[b] = (uint32_t)out.Size();
+		for (uint32_t i = firstItem[b]; i < firstItem[b + 1]; i++){
+			const Item& item = items[i];
+			const SsaBlock& block = p.blocks[b];
+			switch (item.kind){
+				case ITEM_INSTR: {
+					const SsaInstr& in = p.values[item.value];
+					Op op = (Op)in.op;
+					if (op == OP_CHECK || op == OP_MARK){
+						out.Emit(op, item.line, in.a);
+					} else if (op >= OP_WRITE_I && op <= OP_WRITE_B){
+						out.Emit(op, item.line, reg(in.a));
+					} else if (op == OP_WRITELN){
+						out.Emit(op, item.line);
+					} else {
+						uint32_t uses[2];
+						int n = SsaProgram::Uses(in, uses);
+						out.Emit(op, item.line, regs[item.value], reg(uses[0]), n > 1 ? reg(uses[1]) : 0);
+					}
+					break;
+				}
+				case ITEM_MOVE:
+					if (regs[item.value] != reg(item.arg)){
+						out.Emit(OP_MOV, item.line, regs[item.value], reg(item.arg));
+					}
+					break;
+				case ITEM_BRANCH:
+					patches.emplace_back(out.Emit(OP_JMPF, item.line, reg(block.cond)), block.succs[1]);
+					break;
+				case ITEM_JUMP:
+					patches.emplace_back(out.Emit(OP_JMP, item.line), block.succs[0]);
+					break;
+				case ITEM_HALT:
+					out.Emit(OP_HALT, item.line);
+					break;
+			}
+		}
+	}
+	for (auto& patch : patches){
+		out.SetJump(patch.first, blockAt[patch.second]);
+	}
+}
+
+
+bool Optimize(const Ast& ast, Bytecode& out){
+	SsaProgram program;
+	if (!BuildSsa(ast, program)){
+		return false;
+	}
+	Propagate(program);
+	Eliminate(program);
+	Lower(program, out);
+	return true;
+}
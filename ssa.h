@@ -0,0 +1,104 @@
+/*
+ * ssa.h
+ *
+ * The optimizer. A parsed program is lowered from its syntax tree to SSA form: every value is
+ * defined exactly once, by one instruction, and a variable is only a name for whichever value
+ * was last assigned to it. An assignment like x := y makes no instruction at all, and where the
+ * two arms of an if give a variable different values, the block after the if starts with a phi
+ * that picks the one from the arm that ran. The language has no loops, so blocks form a DAG and
+ * are kept in an order where every block comes after the blocks that jump to it. Every pass is
+ * one walk over them in that order.
+ *
+ * The passes:
+ *	Propagate	constant propagation and folding, dead branch pruning and copy propagation, together
+ *		(sparse conditional constant propagation): an if on a constant only keeps the arm that runs,
+ *		and a phi that is left with one arm, or whose arms agree, becomes that value
+ *	Eliminate	dead store and dead code elimination: a value nothing live uses is dropped, and so are
+ *		the checks for unassigned variables that can no longer fail
+ * Lower turns the result back into bytecode(bytecode.h), giving values registers by linear scan.
+*/
+
+#ifndef SSA_H_
+#define SSA_H_
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdint>
+
+#include "bytecode.h"
+
+using namespace std;
+
+class Ast;
+
+
+//Ops beyond the bytecode ones. A constant, a phi, and the value of a variable before anything is assigned to it
+enum SsaOp : uint8_t {
+	SSA_CONST = OP_COUNT, SSA_PHI, SSA_UNDEF,
+};
+
+
+//One SSA instruction, which is also the value it defines. For a phi, a is the value coming from the block's first
+//predecessor and b from its second. CHECK and MARK name the variable in a, and CHECK has the variable's value in b
+struct SsaInstr {
+	uint8_t	op;
+	bool	dead;
+	Token	type;
+	uint32_t	a;
+	uint32_t	b;
+	int	line;
+	Slot	value;
+};
+
+
+//One basic block. It ends by going to succs[0], or, with two successors, by branching on cond: succs[0] when it is
+//true and succs[1] when it is false. No successors means the program ends there
+struct SsaBlock {
+	vector<uint32_t>	instrs;
+	uint32_t	preds[2];
+	uint8_t	npreds;
+	uint32_t	succs[2];
+	uint8_t	nsuccs;
+	uint32_t	cond;
+	bool	dead;
+};
+
+
+//Class definition of SsaProgram. The passes work on the arrays directly
+class SsaProgram {
+public:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	vector<SsaInstr>	values;
+	vector<SsaBlock>	blocks;
+	vector<string>	strings;
+	//Number of variables, for CHECK and MARK
+	uint32_t	vars;
+
+	SsaProgram() { vars = 0; }
+
+	uint32_t	NewBlock();
+	uint32_t	Add(uint32_t block, uint8_t op, Token type, uint32_t a, uint32_t b, int line);
+	uint32_t	AddConstant(Token type, Slot value);
+	void	Link(uint32_t from, uint32_t to);
+
+	static int	Uses(const SsaInstr& in, uint32_t uses[2]);
+
+	//Instructions that will turn into bytecode: not dead, and not a constant, phi or undef
+	size_t	Instructions() const;
+	void	Dump(ostream& out) const;
+};
+
+
+//Lower a program that compiles(the parser has already checked its types). Returns false if it doesn't type check after all
+extern bool BuildSsa(const Ast& ast, SsaProgram& out);
+extern void Propagate(SsaProgram& program);
+extern void Eliminate(SsaProgram& program);
+extern void Lower(const SsaProgram& program, Bytecode& out);
+
+//All of the above, from the tree to bytecode
+extern bool Optimize(const Ast& ast, Bytecode& out);
+
+
+#endif /* SSA_H_ */
@@ -0,0 +1,200 @@
+/**
+ * StreamLexer implementation. The lexer always starts a token in its START state, and only ever decides where a token
+ * ends by looking at the byte after it, so a token that stops right at the end of a block might really keep going.
+ * When that happens we throw the token away, copy its bytes to just in front of the next block and lex it again
+ * from there. Only a whitespace run, a comment or a single lexeme longer than a whole block doesn't fit in front of
+ * the next block. Whitespace and comments are skipped without being carried, and a lexeme that long comes back as ERR
+*/
+
+#include "stream.h"
+#include "scan.h"
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+
+static const ScanKernels& scan = GetScanKernels();
+
+
+/**
+ * Start reading fd on the reader thread, and wait for the first block. blockSize is the most read() is asked for at
+ * once, and also the longest lexeme that can cross from one block into the next
+*/
+StreamLexer::StreamLexer(int fd, uint64_t blockSize) : cursor(nullptr, 0){
+	this->fd = fd;
+	block = blockSize > 0 ? blockSize : 1;
+	readError = 0;
+	stopping = false;
+	lastBlock = false;
+	inComment = false;
+
+	for (Slot& s : slots){
+		s.data.resize(2 * block);
+		s.filled = 0;
+		s.ready = false;
+		s.last = false;
+	}
+
+	reader = thread(&StreamLexer::ReadBlocks, this);
+
+	//Nothing to carry into the first block
+	current = 0;
+	{
+		unique_lock<mutex> guard(lock);
+		changed.wait(guard, [&]{ return slots[0].ready; });
+	}
+	cursor = LexCursor(slots[0].data.data() + block, slots[0].filled);
+	lastBlock = slots[0].last;
+}
+
+
+/**
+ * Stop the reader. If it is blocked in read() on a pipe that is still open, this waits for the read to come back
+*/
+StreamLexer::~StreamLexer(){
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	reader.join();
+}
+
+
+/**
+ * The reader thread. It fills the two slots in turn, each one as soon as the lexer hands it back, and stops after the
+ * block that hit the end of the input(or a read error)
+*/
+void StreamLexer::ReadBlocks(){
+	for (int k = 0; ; k ^= 1){
+		Slot& s = slots[k];
+		{
+			unique_lock<mutex> guard(lock);
+			changed.wait(guard, [&]{ return stopping || !s.ready; });
+			if (stopping){
+				return;
+			}
+		}
+
+		//A pipe hands back whatever it has, keep reading until the block is full
+		char* into = s.data.data() + block;
+		uint64_t filled = 0;
+		bool last = false;
+		int error = 0;
+		while (filled < block){
+			ssize_t got = read(fd, into + filled, block - filled);
+			if (got > 0){
+				filled += got;
+			} else if (got < 0 && errno == EINTR){
+				continue;
+			} else {
+				last = true;
+				error = got < 0 ? errno : 0;
+				break;
+			}
+		}
+
+		{
+			lock_guard<mutex> guard(lock);
+			s.filled = filled;
+			s.last = last;
+			s.ready = true;
+			readError = error;
+		}
+		changed.notify_all();
+
+		if (last){
+			return;
+		}
+	}
+}
+
+
+/**
+ * Move on to the other slot, once the reader has filled it. The bytes from carryFrom to the end of the current block
+ * are copied in right before the new block, and the current slot goes back to the reader
+*/
+void StreamLexer::NextBlock(uint64_t carryFrom){
+	uint64_t carry = cursor.size - carryFrom;
+	int next = current ^ 1;
+	{
+		unique_lock<mutex> guard(lock);
+		changed.wait(guard, [&]{ return slots[next].ready; });
+	}
+
+	Slot& to = slots[next];
+	char* start = to.data.data() + block - carry;
+	if (carry > 0){
+		memcpy(start, cursor.buf + carryFrom, carry);
+	}
+
+	{
+		lock_guard<mutex> guard(lock);
+		slots[current].ready = false;
+	}
+	changed.notify_all();
+
+	current = next;
+	cursor = LexCursor(start, carry + to.filled);
+	lastBlock = to.last;
+}
+
+
+/**
+ * Skip whitespace and whole comments from pos, counting lines. If a comment is still open at the end of the block,
+ * inComment is set and the end of the block is returned
+*/
+uint64_t StreamLexer::SkipBlank(uint64_t pos, int& line){
+	while (pos < cursor.size){
+		pos = scan.skipSpace(cursor.buf, pos, cursor.size, line);
+		if (pos == cursor.size || cursor.buf[pos] != '{'){
+			break;
+		}
+		pos = scan.skipComment(cursor.buf, pos + 1, cursor.size, line);
+		if (pos == cursor.size){
+			inComment = true;
+			break;
+		}
+		pos++;
+	}
+	return pos;
+}
+
+
+/**
+ * Get the next token. Tokens are exactly the ones the buffer lexer would give for the whole input at once, except that
+ * a lexeme longer than a block is returned as an ERR made of its first part
+*/
+LexView StreamLexer::Next(int& line){
+	while (true){
+		//Finish off a comment left open by the last block
+		if (inComment){
+			uint64_t close = scan.skipComment(cursor.buf, cursor.pos, cursor.size, line);
+			if (close == cursor.size && !lastBlock){
+				NextBlock(cursor.size);
+				continue;
+			}
+			inComment = false;
+			cursor.pos = close < cursor.size ? close + 1 : close;
+		}
+
+		uint64_t before = cursor.pos;
+		int beforeLine = line;
+		LexView tok = getNextToken(cursor, line);
+		if (lastBlock || cursor.pos < cursor.size){
+			return tok;
+		}
+
+		//Ran into the end of the block, so this token might not be finished. Lex it again once we have more
+		line = beforeLine;
+		if (cursor.size - before > block){
+			//Too much to carry, so get rid of any whitespace and comments in front of the token
+			before = SkipBlank(before, line);
+			if (!inComment && cursor.size - before > block){
+				cursor.pos = cursor.size;
+				return LexView(ERR, cursor.buf, before, cursor.size - before, line);
+			}
+		}
+		NextBlock(before);
+	}
+}
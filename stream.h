@@ -0,0 +1,75 @@
+/*
+ * stream.h
+ *
+ * Streaming input for the buffer lexer, for input we can't map: stdin, pipes, sockets. A StreamLexer
+ * reads a file descriptor in fixed-size blocks on a reader thread, into two buffers, so one block is
+ * being read while the lexer works through the other. A token that runs off the end of a block is
+ * carried over into the front of the next one, so memory use is four blocks no matter how long the
+ * input is.
+*/
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+
+//Class definition of StreamLexer
+class StreamLexer {
+	//One read buffer. The block is read into its second half, and the first half is room for the
+	//unfinished token carried over from the other buffer
+	struct Slot {
+		vector<char>	data;
+		uint64_t	filled;
+		//Filled and waiting for the lexer, the reader can't touch it until the lexer hands it back
+		bool	ready;
+		//This block is the last one
+		bool	last;
+	};
+
+	int	fd;
+	uint64_t	block;
+	Slot	slots[2];
+	int	readError;
+
+	thread	reader;
+	mutex	lock;
+	condition_variable	changed;
+	bool	stopping;
+
+	//Lexer side: the slot being lexed, and a cursor over the carried token plus its block
+	int	current;
+	LexCursor	cursor;
+	bool	lastBlock;
+	//The last block ended inside a { } comment
+	bool	inComment;
+
+	void	ReadBlocks();
+	void	NextBlock(uint64_t carryFrom);
+	uint64_t	SkipBlank(uint64_t pos, int& line);
+
+public:
+	static const uint64_t DEFAULT_BLOCK = 1 << 20;
+
+	StreamLexer(int fd, uint64_t blockSize = DEFAULT_BLOCK);
+	~StreamLexer();
+
+	StreamLexer(const StreamLexer&) = delete;
+	StreamLexer& operator=(const StreamLexer&) = delete;
+
+	//The next token. Its lexeme points into the current block, so it is only good until the next call
+	LexView	Next(int& line);
+	//errno of a failed read, or 0. A failed read ends the input
+	int	GetError() const { return readError; }
+};
+
+
+#endif /* STREAM_H_ */
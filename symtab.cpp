@@ -0,0 +1,88 @@
+/**
+ * SymbolTable implementation. Ids are dense and mostly declared in order, so they are spread over the table by
+ * Fibonacci hashing(multiply by 2^32 / golden ratio, keep the top bits), and collisions are probed linearly
+*/
+
+#include "symtab.h"
+
+
+SymbolTable::SymbolTable(){
+	count = 0;
+	shift = 32;
+	Rehash(16);
+}
+
+
+//Where id is, or the free slot it would go in
+size_t SymbolTable::SlotOf(uint32_t id) const{
+	size_t mask = slots.size() - 1;
+	for (size_t i = (uint32_t)(id * 2654435769u) >> shift; ; i = (i + 1) & mask){
+		if (slots[i].id == id || slots[i].id == EMPTY){
+			return i;
+		}
+	}
+}
+
+
+void SymbolTable::Rehash(size_t capacity){
+	vector<Symbol> old;
+	old.swap(slots);
+	slots.assign(capacity, Symbol{EMPTY, 0, ERR, 0});
+	shift = 32;
+	while (((size_t)1 << (32 - shift)) < capacity){
+		shift--;
+	}
+	for (const Symbol& s : old){
+		if (s.id != EMPTY){
+			slots[SlotOf(s.id)] = s;
+		}
+	}
+}
+
+
+void SymbolTable::Reserve(size_t n){
+	size_t capacity = slots.size();
+	while (capacity < n * 2){
+		capacity *= 2;
+	}
+	if (capacity != slots.size()){
+		Rehash(capacity);
+	}
+}
+
+
+void SymbolTable::Clear(){
+	if (count != 0){
+		slots.assign(slots.size(), Symbol{EMPTY, 0, ERR, 0});
+		count = 0;
+	}
+}
+
+
+Symbol* SymbolTable::Declare(uint32_t id, int line){
+	if ((count + 1) * 2 > slots.size()){
+		Rehash(slots.size() * 2);
+	}
+	Symbol& s = slots[SlotOf(id)];
+	if (s.id == id){
+		return nullptr;
+	}
+	s = Symbol{id, line, ERR, (uint32_t)count};
+	count++;
+	return &s;
+}
+
+
+//The entry for id, or nullptr if it hasn't been declared
+Symbol* SymbolTable::Find(uint32_t id){
+	return const_cast<Symbol*>(static_cast<const SymbolTable*>(this)->Find(id));
+}
+
+
+const Symbol* SymbolTable::Find(uint32_t id) const{
+	if (id == EMPTY){
+		return nullptr;
+	}
+	const Symbol& s = slots[SlotOf(id)];
+	return s.id == id ? &s : nullptr;
+}
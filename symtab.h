@@ -0,0 +1,64 @@
+/*
+ * symtab.h
+ *
+ * The parser's symbol table: one flat open addressing table of every declared variable, keyed by
+ * identifier id(intern.h), with everything known about it in a single entry. Ids come from the
+ * thread's interner, which outlives any one parse and can be far bigger than the program being
+ * parsed, so the table is sized by how many variables are declared rather than by the largest id.
+ * The compilers keep one per program for the same reason, built from the declarations in the tree.
+*/
+
+#ifndef SYMTAB_H_
+#define SYMTAB_H_
+
+#include <vector>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+
+//One declared variable
+struct Symbol {
+	uint32_t	id;
+	//Where it was declared
+	int	line;
+	//INTEGER, REAL, STRING or BOOLEAN, or ERR until the declaration gets as far as its type
+	Token	type;
+	//How many variables were declared before it, so a table's variables are numbered densely from 0
+	uint32_t	index;
+};
+
+
+//Class definition of SymbolTable
+class SymbolTable {
+	//Always a power of two in size, and at most half full. An entry whose id is EMPTY is free
+	vector<Symbol>	slots;
+	size_t	count;
+	int	shift;
+
+	size_t	SlotOf(uint32_t id) const;
+	void	Rehash(size_t capacity);
+
+public:
+	static const uint32_t EMPTY = UINT32_MAX;
+
+	SymbolTable();
+
+	//Make room for n variables in all without growing again
+	void	Reserve(size_t n);
+	//Forget every variable, keeping the room
+	void	Clear();
+
+	//Declare id, returning its entry, or nullptr if it is already declared
+	Symbol*	Declare(uint32_t id, int line);
+	Symbol*	Find(uint32_t id);
+	const Symbol*	Find(uint32_t id) const;
+
+	size_t	Size() const { return count; }
+	size_t	Bytes() const { return slots.capacity() * sizeof(Symbol); }
+};
+
+
+#endif /* SYMTAB_H_ */
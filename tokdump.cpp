@@ -0,0 +1,173 @@
+/**
+ * TokenWriter implementation. Every token is formatted straight into the output buffer: names come from the constexpr
+ * tokenNames table and line numbers go through to_chars, so nothing allocates and nothing locks a stream
+*/
+
+#include "tokdump.h"
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <unistd.h>
+
+
+TokenWriter::TokenWriter(int fd, bool binary){
+	this->fd = fd;
+	this->binary = binary;
+	buf.resize(BUFFER_SIZE);
+	used = 0;
+	failed = false;
+}
+
+
+/**
+ * Write out everything in the buffer. write(2) can take less than we give it(pipes), so keep going until it is all out
+*/
+bool TokenWriter::Flush(){
+	size_t done = 0;
+	while (!failed && done < used){
+		ssize_t n = write(fd, buf.data() + done, used - done);
+		if (n > 0){
+			done += n;
+		} else if (n < 0 && errno == EINTR){
+			continue;
+		} else {
+			failed = true;
+		}
+	}
+	used = 0;
+	return !failed;
+}
+
+
+//Copy n bytes into the buffer, flushing first if they don't fit. A lexeme bigger than the whole buffer goes straight out
+void TokenWriter::Put(const char* text, size_t n){
+	if (used + n > buf.size()){
+		Flush();
+		if (n > buf.size()){
+			size_t done = 0;
+			while (!failed && done < n){
+				ssize_t w = write(fd, text + done, n - done);
+				if (w > 0){
+					done += w;
+				} else if (w < 0 && errno == EINTR){
+					continue;
+				} else {
+					failed = true;
+				}
+			}
+			return;
+		}
+	}
+	memcpy(buf.data() + used, text, n);
+	used += n;
+}
+
+
+//Little endian, whatever the machine is
+static inline void putLE32(char* out, uint32_t v){
+	out[0] = (char)v;
+	out[1] = (char)(v >> 8);
+	out[2] = (char)(v >> 16);
+	out[3] = (char)(v >> 24);
+}
+
+
+/**
+ * Add one token to the dump. Text is the same as operator<<(ostream&, const LexItem&). Everything but the lexeme is
+ * less than 96 bytes, so as long as that much room is left the record is built in place without any more checks
+*/
+void TokenWriter::Write(const LexView& tok){
+	Token t = tok.GetToken();
+	string_view lexeme = tok.GetLexeme();
+
+	if (used + lexeme.size() + 96 > buf.size()){
+		Flush();
+		//Only a huge lexeme(an unterminated string, say) doesn't fit in an empty buffer
+		if (lexeme.size() + 96 > buf.size()){
+			WriteSlow(tok);
+			return;
+		}
+	}
+	char* out = buf.data() + used;
+
+	if (binary){
+		*out++ = (char)t;
+		putLE32(out, (uint32_t)tok.GetLinenum());
+		putLE32(out + 4, (uint32_t)lexeme.size());
+		out += 8;
+		memcpy(out, lexeme.data(), lexeme.size());
+		out += lexeme.size();
+	}
+	//Error in line N: Unrecognized Lexeme {x}
+	else if (t == ERR){
+		string_view message = ErrMessage(lexeme);
+		memcpy(out, "Error in line ", 14);
+		out = to_chars(out + 14, out + 30, tok.GetLinenum() + 1).ptr;
+		*out++ = ':';
+		*out++ = ' ';
+		memcpy(out, message.data(), message.size());
+		out += message.size();
+		*out++ = ' ';
+		*out++ = '{';
+		memcpy(out, lexeme.data(), lexeme.size());
+		out += lexeme.size();
+		*out++ = '}';
+		*out++ = '\n';
+	}
+	else {
+		string_view name = tokenNames[t];
+		memcpy(out, name.data(), name.size());
+		out += name.size();
+		//NAME: "lexeme" for the tokens that carry a value
+		if (t == IDENT || t == BCONST || t == ICONST || t == RCONST || t == SCONST){
+			memcpy(out, ": \"", 3);
+			out += 3;
+			memcpy(out, lexeme.data(), lexeme.size());
+			out += lexeme.size();
+			*out++ = '"';
+		}
+		*out++ = '\n';
+	}
+
+	used = out - buf.data();
+}
+
+
+//The same, a piece at a time, for a token too big for the buffer
+void TokenWriter::WriteSlow(const LexView& tok){
+	Token t = tok.GetToken();
+	string_view lexeme = tok.GetLexeme();
+
+	if (binary){
+		char header[9];
+		header[0] = (char)t;
+		putLE32(header + 1, (uint32_t)tok.GetLinenum());
+		putLE32(header + 5, (uint32_t)lexeme.size());
+		Put(header, sizeof(header));
+		Put(lexeme.data(), lexeme.size());
+		return;
+	}
+
+	if (t == ERR){
+		char line[16];
+		char* end = to_chars(line, line + sizeof(line), tok.GetLinenum() + 1).ptr;
+		Put("Error in line ", 14);
+		Put(line, end - line);
+		string_view message = ErrMessage(lexeme);
+		Put(": ", 2);
+		Put(message.data(), message.size());
+		Put(" {", 2);
+		Put(lexeme.data(), lexeme.size());
+		Put("}\n", 2);
+		return;
+	}
+
+	string_view name = tokenNames[t];
+	Put(name.data(), name.size());
+	if (t == IDENT || t == BCONST || t == ICONST || t == RCONST || t == SCONST){
+		Put(": \"", 3);
+		Put(lexeme.data(), lexeme.size());
+		Put("\"", 1);
+	}
+	Put("\n", 1);
+}
@@ -0,0 +1,49 @@
+/*
+ * tokdump.h
+ *
+ * Token dumps for debugging and for downstream tools. A TokenWriter collects tokens into one large
+ * buffer and hands it to write(2) a few MB at a time, instead of going through iostreams per token.
+ * Text dumps look exactly like operator<< on a LexItem, one token per line. Binary dumps are one
+ * record per token, all integers little endian:
+ *	uint8 kind, uint32 line, uint32 length, then length bytes of lexeme
+*/
+
+#ifndef TOKDUMP_H_
+#define TOKDUMP_H_
+
+#include <vector>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+
+//Class definition of TokenWriter
+class TokenWriter {
+	int	fd;
+	bool	binary;
+	vector<char>	buf;
+	size_t	used;
+	//A write failed, everything after it is dropped
+	bool	failed;
+
+	void	Put(const char* text, size_t n);
+	void	WriteSlow(const LexView& tok);
+
+public:
+	static const size_t BUFFER_SIZE = 4 << 20;
+
+	TokenWriter(int fd, bool binary);
+	~TokenWriter() { Flush(); }
+
+	TokenWriter(const TokenWriter&) = delete;
+	TokenWriter& operator=(const TokenWriter&) = delete;
+
+	void	Write(const LexView& tok);
+	//Returns false if any write failed
+	bool	Flush();
+};
+
+
+#endif /* TOKDUMP_H_ */
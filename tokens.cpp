@@ -0,0 +1,259 @@
+/**
+ * Pre-tokenizing a whole buffer into a TokenBuffer. This is just the buffer lexer in a loop, with every LexView
+ * split up across the parallel arrays and every identifier interned along the way
+*/
+
+#include "tokens.h"
+#include "intern.h"
+#include <thread>
+
+
+/**
+ * Lex all of buf. The line stored for each token is the lexer's line number right after it returned that token,
+ * which is what the parser would have seen if it called the lexer itself. Lexing keeps going past ERR tokens,
+ * and the buffer always ends with exactly one DONE token
+*/
+void TokenBuffer::Tokenize(const char* buf, uint64_t size, int line){
+	source = buf;
+	firstLine = line;
+
+	kinds.clear();
+	offsets.clear();
+	lengths.clear();
+	lines.clear();
+	ids.clear();
+
+	//Real programs average a little over four bytes per token, so this is rarely off by much
+	size_t estimate = size / 4 + 1;
+	kinds.reserve(estimate);
+	offsets.reserve(estimate);
+	lengths.reserve(estimate);
+	lines.reserve(estimate);
+	ids.reserve(estimate);
+
+	LexCursor cursor(buf, size);
+	LexView tok;
+	do {
+		tok = getNextToken(cursor, line);
+		kinds.push_back((uint8_t)tok.GetToken());
+		offsets.push_back(tok.GetOffset());
+		lengths.push_back((uint32_t)tok.GetLength());
+		lines.push_back(line);
+		ids.push_back(tok == IDENT ? identifiers.Intern(tok.GetLexeme()) : Interner::NO_ID);
+	} while (tok != DONE);
+}
+
+
+/*
+* Parallel tokenizing. The buffer is cut into one chunk per thread and every chunk is lexed at the same time, each
+* one guessing that its first byte is in the START state and counting lines from 0. The guess is wrong when a chunk
+* starts inside a token, a comment or a string, so a short sequential fix-up pass then lexes for real from the end
+* of each chunk into the next one, until it produces a token that starts where one of the next chunk's guessed tokens
+* starts. From there on the guessed tokens are right(the lexer is in START at the start of every token, and the text
+* is the same), and only need their lines shifted. If a chunk never lines up, the fix-up pass has simply lexed it.
+*
+* Identifiers are interned into a per-chunk Interner in parallel, and those are merged into the global one in chunk
+* order, so every identifier ends up with the same id the sequential Tokenize would have given it.
+*/
+namespace {
+	struct Chunk {
+		uint64_t	begin;
+		//Only tokens that start before this belong to the chunk
+		uint64_t	limit;
+
+		//Guessed tokens, lines counted from the start of the chunk
+		vector<uint8_t>	kinds;
+		vector<uint64_t>	offsets;
+		vector<uint32_t>	lengths;
+		vector<int>	lines;
+		//Where the lexer was, and its line, after the last guessed token
+		uint64_t	end;
+		int	endLine;
+
+		//Filled in by the fix-up: tokens lexed for real before lining up, the first guessed token that is
+		//right, and how far the guessed lines are off from there on
+		vector<LexView>	fixed;
+		vector<int>	fixedLines;
+		size_t	sync;
+		int	lineShift;
+
+		//Identifier ids local to this chunk, then their global ids
+		Interner	names;
+		vector<uint32_t>	localIds;
+		vector<uint32_t>	globalIds;
+		size_t	outStart;
+	};
+
+	//Start of the token a LexView came from. A string constant's lexeme leaves off the opening quote
+	inline uint64_t tokenStart(const LexView& tok){
+		return tok.GetOffset() - (tok == SCONST ? 1 : 0);
+	}
+
+	//Guess at one chunk, starting it in START on line line
+	void lexChunk(const char* buf, uint64_t size, Chunk& c, int line){
+		LexCursor cursor(buf, size);
+		cursor.pos = c.begin;
+		c.end = c.begin;
+		c.endLine = line;
+
+		size_t estimate = (c.limit == UINT64_MAX ? size - c.begin : c.limit - c.begin) / 4 + 1;
+		c.kinds.reserve(estimate);
+		c.offsets.reserve(estimate);
+		c.lengths.reserve(estimate);
+		c.lines.reserve(estimate);
+
+		LexView tok;
+		do {
+			tok = getNextToken(cursor, line);
+			if (tokenStart(tok) >= c.limit){
+				break;
+			}
+			c.kinds.push_back((uint8_t)tok.GetToken());
+			c.offsets.push_back(tok.GetOffset());
+			c.lengths.push_back((uint32_t)tok.GetLength());
+			c.lines.push_back(line);
+			c.end = cursor.pos;
+			c.endLine = line;
+		} while (tok != DONE);
+	}
+
+	//Run fn(i) for i in [0, n) with one thread per i
+	template <class F>
+	void forEachChunk(size_t n, F fn){
+		vector<thread> workers;
+		for (size_t i = 1; i < n; i++){
+			workers.emplace_back(fn, i);
+		}
+		fn(0);
+		for (thread& t : workers){
+			t.join();
+		}
+	}
+}
+
+
+/**
+ * Same result as Tokenize, using up to threads threads. Small buffers aren't worth splitting up
+*/
+void TokenBuffer::TokenizeParallel(const char* buf, uint64_t size, unsigned threads, int line){
+	const uint64_t minChunk = 1 << 20;
+	if (threads > size / minChunk){
+		threads = (unsigned)(size / minChunk);
+	}
+	if (threads <= 1){
+		Tokenize(buf, size, line);
+		return;
+	}
+
+	source = buf;
+	firstLine = line;
+
+	vector<Chunk> chunks(threads);
+	for (unsigned i = 0; i < threads; i++){
+		chunks[i].begin = size / threads * i;
+		chunks[i].limit = i + 1 < threads ? size / threads * (i + 1) : UINT64_MAX;
+	}
+
+	//Guess every chunk at once. The first chunk really does start in START, on the real first line
+	forEachChunk(threads, [&](size_t i){
+		lexChunk(buf, size, chunks[i], i == 0 ? line : 0);
+	});
+
+	//Fix up the chunk boundaries in order
+	chunks[0].sync = 0;
+	chunks[0].lineShift = 0;
+	uint64_t pos = chunks[0].end;
+	int realLine = chunks[0].endLine;
+
+	for (unsigned i = 1; i < threads; i++){
+		Chunk& c = chunks[i];
+		LexCursor cursor(buf, size);
+		cursor.pos = pos;
+		size_t j = 0;
+		c.sync = c.kinds.size();
+		c.lineShift = 0;
+
+		while (true){
+			int before = realLine;
+			uint64_t beforePos = cursor.pos;
+			LexView tok = getNextToken(cursor, realLine);
+			uint64_t start = tokenStart(tok);
+
+			//Belongs to the next chunk, leave it for that chunk's fix-up
+			if (start >= c.limit){
+				realLine = before;
+				pos = beforePos;
+				break;
+			}
+
+			while (j < c.kinds.size() && c.offsets[j] - (c.kinds[j] == SCONST ? 1 : 0) < start){
+				j++;
+			}
+			if (j < c.kinds.size() && c.offsets[j] - (c.kinds[j] == SCONST ? 1 : 0) == start){
+				//Lined up, the rest of this chunk's guesses are right
+				c.sync = j;
+				c.lineShift = realLine - c.lines[j];
+				pos = c.end;
+				realLine = c.endLine + c.lineShift;
+				break;
+			}
+
+			c.fixed.push_back(tok);
+			c.fixedLines.push_back(realLine);
+			pos = cursor.pos;
+			if (tok == DONE){
+				break;
+			}
+		}
+	}
+
+	//Where each chunk's tokens go, and every chunk's identifiers interned locally
+	size_t total = 0;
+	for (Chunk& c : chunks){
+		c.outStart = total;
+		total += c.fixed.size() + (c.kinds.size() - c.sync);
+	}
+	forEachChunk(threads, [&](size_t i){
+		Chunk& c = chunks[i];
+		for (const LexView& tok : c.fixed){
+			c.localIds.push_back(tok == IDENT ? c.names.Intern(tok.GetLexeme()) : Interner::NO_ID);
+		}
+		for (size_t k = c.sync; k < c.kinds.size(); k++){
+			c.localIds.push_back(c.kinds[k] == IDENT ? c.names.Intern(string_view(buf + c.offsets[k], c.lengths[k])) : Interner::NO_ID);
+		}
+	});
+
+	//Merge the local names into the global interner in chunk order, which is the order Tokenize would meet them in
+	for (Chunk& c : chunks){
+		c.globalIds.resize(c.names.Size());
+		for (uint32_t id = 0; id < c.names.Size(); id++){
+			c.globalIds[id] = identifiers.Intern(c.names.GetName(id));
+		}
+	}
+
+	//Copy everything into place
+	kinds.resize(total);
+	offsets.resize(total);
+	lengths.resize(total);
+	lines.resize(total);
+	ids.resize(total);
+	forEachChunk(threads, [&](size_t i){
+		Chunk& c = chunks[i];
+		size_t out = c.outStart;
+		size_t local = 0;
+		for (size_t k = 0; k < c.fixed.size(); k++, out++, local++){
+			kinds[out] = (uint8_t)c.fixed[k].GetToken();
+			offsets[out] = c.fixed[k].GetOffset();
+			lengths[out] = (uint32_t)c.fixed[k].GetLength();
+			lines[out] = c.fixedLines[k];
+			ids[out] = c.localIds[local] == Interner::NO_ID ? Interner::NO_ID : c.globalIds[c.localIds[local]];
+		}
+		for (size_t k = c.sync; k < c.kinds.size(); k++, out++, local++){
+			kinds[out] = c.kinds[k];
+			offsets[out] = c.offsets[k];
+			lengths[out] = c.lengths[k];
+			lines[out] = c.lines[k] + c.lineShift;
+			ids[out] = c.localIds[local] == Interner::NO_ID ? Interner::NO_ID : c.globalIds[c.localIds[local]];
+		}
+	});
+}
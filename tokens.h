@@ -0,0 +1,55 @@
+/*
+ * tokens.h
+ *
+ * A whole program lexed up front into flat parallel arrays(structure of arrays): one byte for the
+ * token kind, the offset and length of the lexeme in the source buffer, the line number, and the
+ * interned id of every identifier. The parser can then walk it with a cursor index instead of
+ * calling the lexer, so lookahead and backing up are just moving the index, and lexing and parsing
+ * can be timed separately.
+*/
+
+#ifndef TOKENS_H_
+#define TOKENS_H_
+
+#include <vector>
+#include <string_view>
+#include <cstdint>
+
+#include "lex.h"
+
+using namespace std;
+
+
+//Class definition of TokenBuffer
+class TokenBuffer {
+	const char*	source;
+	int	firstLine;
+
+	vector<uint8_t>	kinds;
+	vector<uint64_t>	offsets;
+	vector<uint32_t>	lengths;
+	vector<int>	lines;
+	vector<uint32_t>	ids;
+
+public:
+	TokenBuffer() {
+		source = nullptr;
+		firstLine = 1;
+	}
+
+	void	Tokenize(const char* buf, uint64_t size, int line = 1);
+	void	TokenizeParallel(const char* buf, uint64_t size, unsigned threads, int line = 1);
+
+	//Always at least one token once tokenized, the last one is DONE
+	size_t	Size() const { return kinds.size(); }
+	int	GetFirstLine() const { return firstLine; }
+
+	Token	GetToken(size_t i) const { return (Token)kinds[i]; }
+	string_view	GetLexeme(size_t i) const { return string_view(source + offsets[i], lengths[i]); }
+	uint64_t	GetOffset(size_t i) const { return offsets[i]; }
+	int	GetLinenum(size_t i) const { return lines[i]; }
+	uint32_t	GetId(size_t i) const { return ids[i]; }
+};
+
+
+#endif /* TOKENS_H_ */
@@ -0,0 +1,263 @@
+/**
+ * VM implementation. The whole interpreter is the one loop in Run. Handlers read their operands straight out of the
+ * instruction and the register file, none of them allocates except CONCAT, and the only checks left are the ones the
+ * language asks for(division by zero, a variable read before it has a value)
+*/
+
+#include "vm.h"
+#include <charconv>
+#include <cstring>
+
+
+/*
+* Dispatch. With GCC and Clang every handler ends by jumping straight to the handler for the next instruction, so
+* each one gets its own indirect branch to predict. Building with -DVM_COMPUTED_GOTO=0 uses a plain switch instead
+*/
+#ifndef VM_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+#endif
+
+#if VM_COMPUTED_GOTO
+#define VM_CASE(name) L_##name
+#define VM_NEXT() goto *dispatch[pc->op]
+#else
+#define VM_CASE(name) case OP_##name
+#define VM_NEXT() goto next
+#endif
+
+//Integer arithmetic wraps instead of being undefined on overflow
+#define WRAP(x, op, y) ((int32_t)((uint32_t)(x) op (uint32_t)(y)))
+
+
+//Append a value the way write and writeln print it. Reals always get two decimals
+static inline void put(string& out, int32_t v){
+	char text[16];
+	out.append(text, to_chars(text, text + sizeof(text), v).ptr - text);
+}
+
+static inline void put(string& out, double v){
+	char text[352];
+	out.append(text, to_chars(text, text + sizeof(text), v, chars_format::fixed, 2).ptr - text);
+}
+
+
+bool VM::Run(const Bytecode& program, ostream& out){
+	regs = program.InitialRegisters();
+	strings = program.Strings();
+	set.assign(program.Vars(), 0);
+	output.clear();
+	error.clear();
+	errorLine = 0;
+
+	const Instr* const code = program.Code();
+	const Instr* pc = code;
+	Slot* r = regs.data();
+	bool ok = true;
+
+#if VM_COMPUTED_GOTO
+	//In the same order as Op
+	static void* const dispatch[OP_COUNT] = {
+		&&L_MOV, &&L_I2R,
+		&&L_ADD_I, &&L_ADD_R, &&L_SUB_I, &&L_SUB_R, &&L_MUL_I, &&L_MUL_R, &&L_DIV_R, &&L_IDIV, &&L_MOD, &&L_CONCAT,
+		&&L_NEG_I, &&L_NEG_R, &&L_NOT, &&L_AND, &&L_OR,
+		&&L_EQ_I, &&L_EQ_R, &&L_EQ_S, &&L_EQ_B, &&L_LT_I, &&L_LT_R, &&L_LT_S, &&L_GT_I, &&L_GT_R, &&L_GT_S,
+		&&L_JMP, &&L_JMPF,
+		&&L_CHECK, &&L_MARK,
+		&&L_WRITE_I, &&L_WRITE_R, &&L_WRITE_S, &&L_WRITE_B, &&L_WRITELN,
+		&&L_HALT,
+	};
+	VM_NEXT();
+#else
+next:
+	switch (pc->op)
+#endif
+	{
+		VM_CASE(MOV):
+			r[pc->a] = r[pc->b];
+			pc++;
+			VM_NEXT();
+		VM_CASE(I2R):
+			r[pc->a].r = r[pc->b].i;
+			pc++;
+			VM_NEXT();
+
+		VM_CASE(ADD_I):
+			r[pc->a].i = WRAP(r[pc->b].i, +, r[pc->c].i);
+			pc++;
+			VM_NEXT();
+		VM_CASE(ADD_R):
+			r[pc->a].r = r[pc->b].r + r[pc->c].r;
+			pc++;
+			VM_NEXT();
+		VM_CASE(SUB_I):
+			r[pc->a].i = WRAP(r[pc->b].i, -, r[pc->c].i);
+			pc++;
+			VM_NEXT();
+		VM_CASE(SUB_R):
+			r[pc->a].r = r[pc->b].r - r[pc->c].r;
+			pc++;
+			VM_NEXT();
+		VM_CASE(MUL_I):
+			r[pc->a].i = WRAP(r[pc->b].i, *, r[pc->c].i);
+			pc++;
+			VM_NEXT();
+		VM_CASE(MUL_R):
+			r[pc->a].r = r[pc->b].r * r[pc->c].r;
+			pc++;
+			VM_NEXT();
+		VM_CASE(DIV_R):
+			if (r[pc->c].r == 0){
+				goto divide_by_zero;
+			}
+			r[pc->a].r = r[pc->b].r / r[pc->c].r;
+			pc++;
+			VM_NEXT();
+		//Dividing the smallest integer by -1 wraps like the other operators do
+		VM_CASE(IDIV):
+			if (r[pc->c].i == 0){
+				goto divide_by_zero;
+			}
+			r[pc->a].i = r[pc->c].i == -1 ? WRAP(0, -, r[pc->b].i) : r[pc->b].i / r[pc->c].i;
+			pc++;
+			VM_NEXT();
+		VM_CASE(MOD):
+			if (r[pc->c].i == 0){
+				goto divide_by_zero;
+			}
+			r[pc->a].i = r[pc->c].i == -1 ? 0 : r[pc->b].i % r[pc->c].i;
+			pc++;
+			VM_NEXT();
+		VM_CASE(CONCAT):
+			strings.push_back(strings[r[pc->b].s] + strings[r[pc->c].s]);
+			r[pc->a].s = (uint32_t)(strings.size() - 1);
+			pc++;
+			VM_NEXT();
+
+		VM_CASE(NEG_I):
+			r[pc->a].i = WRAP(0, -, r[pc->b].i);
+			pc++;
+			VM_NEXT();
+		VM_CASE(NEG_R):
+			r[pc->a].r = -r[pc->b].r;
+			pc++;
+			VM_NEXT();
+		VM_CASE(NOT):
+			r[pc->a].b = !r[pc->b].b;
+			pc++;
+			VM_NEXT();
+		VM_CASE(AND):
+			r[pc->a].b = r[pc->b].b && r[pc->c].b;
+			pc++;
+			VM_NEXT();
+		VM_CASE(OR):
+			r[pc->a].b = r[pc->b].b || r[pc->c].b;
+			pc++;
+			VM_NEXT();
+
+		VM_CASE(EQ_I):
+			r[pc->a].b = r[pc->b].i == r[pc->c].i;
+			pc++;
+			VM_NEXT();
+		VM_CASE(EQ_R):
+			r[pc->a].b = r[pc->b].r == r[pc->c].r;
+			pc++;
+			VM_NEXT();
+		VM_CASE(EQ_S):
+			r[pc->a].b = strings[r[pc->b].s] == strings[r[pc->c].s];
+			pc++;
+			VM_NEXT();
+		VM_CASE(EQ_B):
+			r[pc->a].b = r[pc->b].b == r[pc->c].b;
+			pc++;
+			VM_NEXT();
+		VM_CASE(LT_I):
+			r[pc->a].b = r[pc->b].i < r[pc->c].i;
+			pc++;
+			VM_NEXT();
+		VM_CASE(LT_R):
+			r[pc->a].b = r[pc->b].r < r[pc->c].r;
+			pc++;
+			VM_NEXT();
+		VM_CASE(LT_S):
+			r[pc->a].b = strings[r[pc->b].s] < strings[r[pc->c].s];
+			pc++;
+			VM_NEXT();
+		VM_CASE(GT_I):
+			r[pc->a].b = r[pc->b].i > r[pc->c].i;
+			pc++;
+			VM_NEXT();
+		VM_CASE(GT_R):
+			r[pc->a].b = r[pc->b].r > r[pc->c].r;
+			pc++;
+			VM_NEXT();
+		VM_CASE(GT_S):
+			r[pc->a].b = strings[r[pc->b].s] > strings[r[pc->c].s];
+			pc++;
+			VM_NEXT();
+
+		VM_CASE(JMP):
+			pc = code + pc->a;
+			VM_NEXT();
+		VM_CASE(JMPF):
+			pc = r[pc->a].b ? pc + 1 : code + pc->b;
+			VM_NEXT();
+
+		VM_CASE(CHECK):
+			if (!set[pc->a]){
+				error = "Using uninitialized Variable";
+				goto fail;
+			}
+			pc++;
+			VM_NEXT();
+		VM_CASE(MARK):
+			set[pc->a] = 1;
+			pc++;
+			VM_NEXT();
+
+		VM_CASE(WRITE_I):
+			put(output, r[pc->a].i);
+			pc++;
+			VM_NEXT();
+		VM_CASE(WRITE_R):
+			put(output, r[pc->a].r);
+			pc++;
+			VM_NEXT();
+		VM_CASE(WRITE_S):
+			output += strings[r[pc->a].s];
+			pc++;
+			VM_NEXT();
+		VM_CASE(WRITE_B):
+			output += r[pc->a].b ? "true" : "false";
+			pc++;
+			VM_NEXT();
+		VM_CASE(WRITELN):
+			output += '\n';
+			if (output.size() >= OUTPUT_BUFFER){
+				out.write(output.data(), output.size());
+				output.clear();
+			}
+			pc++;
+			VM_NEXT();
+
+		VM_CASE(HALT):
+			goto done;
+#if !VM_COMPUTED_GOTO
+		case OP_COUNT:
+			goto done;
+#endif
+	}
+
+divide_by_zero:
+	error = "Illegal division by Zero";
+fail:
+	errorLine = program.GetLine(pc - code);
+	ok = false;
+done:
+	out.write(output.data(), output.size());
+	output.clear();
+	return ok;
+}
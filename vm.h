@@ -0,0 +1,49 @@
+/*
+ * vm.h
+ *
+ * Runs compiled programs(bytecode.h). The register file is copied from the program's initial one,
+ * which is what loads every constant, and then instructions are dispatched straight from one
+ * handler to the next(computed goto where the compiler has it, a switch otherwise). What the
+ * program writes is collected in a buffer and handed to the output stream in large pieces.
+*/
+
+#ifndef VM_H_
+#define VM_H_
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdint>
+
+#include "bytecode.h"
+
+using namespace std;
+
+
+//Class definition of VM
+class VM {
+	vector<Slot>	regs;
+	//The program's string constants, then every string made while it runs
+	vector<string>	strings;
+	//Whether each variable has been given a value, for CHECK
+	vector<uint8_t>	set;
+	string	output;
+
+	string	error;
+	int	errorLine;
+
+public:
+	//Output is flushed once it gets this big
+	static const size_t OUTPUT_BUFFER = 64 << 10;
+
+	VM() { errorLine = 0; }
+
+	//Returns false if the program stopped on a run time error
+	bool	Run(const Bytecode& program, ostream& out);
+
+	const string&	GetError() const { return error; }
+	int	GetErrorLine() const { return errorLine; }
+};
+
+
+#endif /* VM_H_ */